@@ -5,30 +5,161 @@
  */
 
 #include <stdio.h>
+#include <errno.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <wchar.h>
 #include <time.h>
 #include <limits.h>
-#define NAME_LENGTH 20
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#define NAME_LENGTH 256       // Longest name accepted, plus its terminator; names are stored at their own length
+#define RECORD_NAME_LENGTH 20 // Name field of the fixed-size records of older class files and journals
 #define CLASS_CODE_LENGTH 10
+#define MAX_AGE 99
+#define MAX_STUDENTS 100000000 // Largest class, limited by the 9 digits accepted when it is created
+#define CHUNK_SHIFT 10
+#define CHUNK_STUDENTS (1 << CHUNK_SHIFT) // Students per roster chunk
+#define IMPORT_BUFFER_SIZE (1 << 20) // Roster files are read in 1 MiB blocks
+#define ARENA_FIRST_BLOCK (64 * 1024) // A class's first arena block; each later one is twice as big
+#define ARENA_MAX_BLOCK (64 << 20)
+#define NAME_POOL_MIN 4096            // Initial size of a class's name pool
+#define NAME_SLOTS_MIN 64             // Initial size of a name pool's intern table (a power of two)
+#define LIST_BUFFER_SIZE (64 * 1024) // Student lists are written in blocks of up to 64 KiB
+#define LIST_ENTRY_MAX (NAME_LENGTH + 64) // Longest text of one student in a student list
+#define EXPORT_BUFFER_SIZE (1 << 20) // Exports are written in blocks of up to 1 MiB
+#define EXPORT_ENTRY_MAX (6 * (NAME_LENGTH + CLASS_CODE_BUFFER) + 64) // Longest record of one student in an export, fully escaped
+#define STREAM_CHUNKS 64 // Chunks of a streamed class file read between handing their pages back
+#define EXPORT_CSV 1
+#define EXPORT_JSON 2
+#define PATH_BUFFER 256
+#define MAX_SNAPSHOTS 32   // Undo steps kept per class; the oldest is dropped to make room
+#define SNAPSHOT_LABEL 40  // Room for a snapshot's label, such as the action it was taken before
+#define FILTER_TEXT 256    // Longest filter expression typed at the prompt, plus its terminator
+#define FILTER_OPS 64      // Most instructions in a compiled filter
+#define FILTER_STACK 16    // Most masks a compiled filter keeps on its stack at once
+#define FILTER_NAMES 8     // Most names a filter compares against
 
-// DCL36-C: This static double is declared with static external linkage to be used in a later macro function and cannot change
-static double student_tax = 27;
+// Class file format: a fixed little-endian header followed by the students. Since version 3 the students are
+// stored as whole roster chunks (a column of names, then one of ages and one of genders, a byte each) so that
+// they can be mapped in place; since version 4 the name column holds offsets into the class's name table,
+// which follows the chunks. Versions 1 and 2 stored CLASS_RECORD_SIZE byte records (name, then gender and age
+// as 32-bit integers), as did version 1 journals.
+#define CLASS_FILE "class_list"
+#define CLASS_FILE_MAGIC "ISUCLASS"
+#define CLASS_FILE_VERSION 4      // Version 2 added the journal id and LSN to the header, 3 the chunk columns, 4 the name table
+#define CLASS_FILE_MIN_VERSION 1  // Oldest version that can still be read
+#define CLASS_FILE_COLUMNS 3      // First version whose students are stored in chunk columns
+#define CLASS_FILE_NAMES 4        // First version whose names are kept in a name table
+#define CLASS_HEADER_SIZE 128
+#define CLASS_RECORD_SIZE 28
+#define CLASS_RECORD_GENDER 20 // Offset of gender within a record
+#define CLASS_RECORD_AGE 24    // Offset of age within a record
+#define AGE_BINS 10            // Age histogram bins of ten years, the last one holding every age from 90
+#define CHECKSUM_INIT 0x9E3779B97F4A7C15ULL
+#define COMPACT_FILE_MAGIC "ISUCPACK"
+#define COMPACT_FILE_VERSION 1
+#define COMPACT_HEADER_SIZE 80
+#define COMPACT_BLOCK 4096 // Names or students per block of a compact class file
+#define COMPACT_BLOCK_MAX (COMPACT_BLOCK * (NAME_LENGTH + 16)) // Largest block payload, a block of the longest names
 
-// PRE01-C: Parentheses are properly placed around macro parameter names
-// PRE02-C: Macro replacement list is properly parenthesized
-// PRE11-C: Macro definition does not conclude with a semicolon
-#define CALCULATE_COST(x, y) ((x) * (y))
+// Journal file format: a header naming the class_list snapshot it belongs to, then entries that each carry a
+// log sequence number (LSN). Entries up to the LSN recorded in class_list are already part of it. An entry is
+// JOURNAL_ENTRY_FIXED bytes plus its name padded to 8 bytes; version 1 journals had fixed-size entries. Each
+// save ends with a commit entry carrying its last LSN; version 1 and 2 journals had no commit entries.
+#define JOURNAL_FILE CLASS_FILE ".journal"
+#define JOURNAL_MAGIC "ISUJRNL3"
+#define JOURNAL_MAGIC_V2 "ISUJRNL2"
+#define JOURNAL_MAGIC_V1 "ISUJRNL"
+#define JOURNAL_HEADER_SIZE 16
+#define JOURNAL_ENTRY_FIXED 40
+#define JOURNAL_ENTRY_MAX (JOURNAL_ENTRY_FIXED + NAME_LENGTH)
+#define JOURNAL_ENTRY_V1_SIZE 56
+#define JOURNAL_SET 1   // Store a student record at an index
+#define JOURNAL_COUNT 2 // Resize the class to a number of students
+#define JOURNAL_COMMIT 3 // End a save of a number of entries; a save without one is not replayed
+#define JOURNAL_COMPACT_MIN (64 * 1024) // Journal bytes below which compaction is never started
 
-// PRE10-C: Multistatement Macro definition is wrapped in a do-while loop so it can be used as a single line statement
-// FLP06-C: Similarly here, to avoid truncation, integer operands are converted to the double 'cost_total' before division.
-#define CALCULATE_TAX(x, y)                                       \
-    do                                                            \
-    {                                                             \
-        double cost_total = (double)CALCULATE_COST(x, y);         \
-        printf("%.2f", (cost_total * (1 + (student_tax / 100)))); \
-    } while (0)
+// Catalog file format: a header, a directory of (offset, length) pairs, then one class file image per class
+#define CATALOG_FILE "class_catalog"
+#define CATALOG_FILE_MAGIC "ISUCATLG"
+#define CATALOG_FILE_VERSION 1
+#define CATALOG_HEADER_SIZE 64
+#define CATALOG_ENTRY_SIZE 16
+#define CATALOG_MIN_SLOTS 64 // Initial size of the class code hash index (a power of two)
+#define CLASS_CODE_BUFFER ((CLASS_CODE_LENGTH * 3) + 3) // Room for CATEGORY-COURSE-SECTION and a terminator
+
+// Pricing: money is 64-bit fixed point in cents, and tax rates are fixed point in hundredths of a percent
+// (basis points), so both are parsed and printed with MONEY_DIGITS decimals
+#define MONEY_SCALE 100
+#define MONEY_DIGITS 2
+#define MONEY_BUFFER 32       // Room for any money amount printed by formatMoney
+#define MONEY_INPUT 16        // Room for a money amount typed at a prompt
+#define TAX_SCALE 10000       // Basis points in 100%
+#define MAX_TAX_RATE 100000   // 1000%
+#define DEFAULT_TAX_RATE 2700 // 27%, applied to every class without a rate of its own
+#define MAX_TIERS 64
+#define MAX_TAXES 256
+#define RATE_SLOTS (4 * (MAX_AGE + 1)) // One per gender code and age
+#define MAX_WORKER_THREADS 64 // Most threads a parallel job (pricing, loading, sorting) runs on
+#define PARALLEL_SORT_MIN 65536 // Distinct names from which sortNameGroups spreads its sort over several threads
+#define PRICE_OVERFLOW -3 // class_price status of a class whose price does not fit in money
+// What student entry and roster import do with a student already in the class (see --duplicates)
+#define DUP_ALLOW 0 // Keep them silently
+#define DUP_WARN 1  // Keep them with a warning
+#define DUP_DROP 2  // Leave them out
+#define DUP_MIN_SLOTS 64
+#define BENCH_WORK 10000000L // Students each benchmarked operation handles per size, summed over its runs
+#define BENCH_MIN_RUNS 3
+#define BENCH_MAX_RUNS 30
+
+// Operation statistics: one counter per menu choice (STAT_MENU + choice), then one per kind of input or file I/O
+#define MENU_OPTIONS 27 // The highest menu choice
+#define STAT_MENU 0
+#define STAT_INPUT (MENU_OPTIONS + 1)
+#define STAT_IMPORT_READ (MENU_OPTIONS + 2) // The first counter of file I/O
+#define STAT_LIST_WRITE (MENU_OPTIONS + 3)
+#define STAT_CLASS_WRITE (MENU_OPTIONS + 4)
+#define STAT_CLASS_MAP (MENU_OPTIONS + 5)
+#define STAT_LEGACY_READ (MENU_OPTIONS + 6)
+#define STAT_JOURNAL_APPEND (MENU_OPTIONS + 7)
+#define STAT_JOURNAL_REPLAY (MENU_OPTIONS + 8)
+#define STAT_JOURNAL_TRIM (MENU_OPTIONS + 9)
+#define STAT_COMPACT_READ (MENU_OPTIONS + 10)
+#define STAT_AUDIT_WRITE (MENU_OPTIONS + 11)
+#define STAT_EXPORT_WRITE (MENU_OPTIONS + 12)
+#define STAT_SOCKET_WRITE (MENU_OPTIONS + 13)
+#define STAT_COUNT (MENU_OPTIONS + 14)
+#define SERVER_BACKLOG 16
+#define SERVER_LINE 512 // Longest request line accepted by the server, with its newline and terminator
+#define MAX_CLIENTS 64
+#define AUDIT_FILE "audit_log.txt"
+#define AUDIT_QUEUE 1024          // Records the audit queue holds (a power of two); any more are dropped and counted
+#define AUDIT_TEXT 224            // Longest text of one audit record, with its terminator
+#define AUDIT_LINE (AUDIT_TEXT + 96) // Longest audit log line: a record with its time, session and user
+#define AUDIT_BATCH (64 * 1024)   // The audit writer writes up to 64 KiB of lines at once
+#define AUDIT_ROTATE (1 << 20)    // Size at which the audit log is rotated
+#define AUDIT_KEEP 4              // Rotated audit logs kept, from AUDIT_FILE.1 (the newest) to AUDIT_FILE.4
+#define AUDIT_IDLE_NS 20000000L   // How long the audit writer sleeps when the queue is empty
+#define AUDIT_USER 20
 
 typedef struct student
 {
@@ -37,157 +168,1105 @@ typedef struct student
     int gender;
     int age;
 } student;
+
+// A student as the original class file format stored it, with its name cut to RECORD_NAME_LENGTH characters
+typedef struct legacy_student
+{
+    char name[RECORD_NAME_LENGTH];
+    int gender;
+    int age;
+} legacy_student;
+
+// CHUNK_STUDENTS students stored column by column, so that a scan over ages or genders reads nothing else.
+// Ages and genders are always valid (see isValidAge and isValidGender), so a byte holds each of them.
+typedef struct student_chunk
+{
+    uint32_t names[CHUNK_STUDENTS]; // Offsets of the names in the class's name pool
+    unsigned char ages[CHUNK_STUDENTS];
+    unsigned char genders[CHUNK_STUDENTS];
+} student_chunk;
+
+// A block of an arena, followed by the memory it hands out
+typedef struct arena_block
+{
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+} arena_block;
+
+// Bump allocator whose memory is only ever released all at once, one free per block
+typedef struct arena
+{
+    arena_block *blocks; // The newest block first
+    size_t next_size;
+} arena;
+
+// A class's names, each stored once: NUL-terminated strings back to back, found again through an intern table
+typedef struct name_pool
+{
+    char *base;          // Offset 0 always holds the empty name
+    uint32_t used;
+    uint32_t capacity;   // 0 while base points into a mapped file (or is NULL)
+    uint32_t *slots;     // Intern table: 0 for an empty slot, otherwise a name's offset plus one; NULL until needed
+    uint32_t slot_count; // Always a power of two
+    uint32_t interned;   // Names in the intern table
+} name_pool;
+
+// The decoded fields of a class file header
+typedef struct class_header
+{
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_count;
+    uint32_t record_size;
+    uint32_t name_offset;
+    uint32_t gender_offset;
+    uint32_t age_offset;
+    uint64_t records_offset;
+    uint64_t records_checksum;
+    uint64_t journal_id;  // Identifies the journal that extends this snapshot, 0 if there is none
+    uint64_t journal_lsn; // The last journal entry already folded into this snapshot
+    uint32_t chunk_students; // Students per chunk when the students are stored in chunk columns
+    uint32_t names_size;     // Bytes of the name table that follows the chunks, from version 4
+    char category[CLASS_CODE_LENGTH];
+    char course_num[CLASS_CODE_LENGTH];
+    char section_num[CLASS_CODE_LENGTH];
+} class_header;
+
+// A class or catalog file mapped into memory, shared by every class whose students point into it
+typedef struct file_map
+{
+    unsigned char *addr;
+    size_t len;
+    int refs;
+    int stream; // Set for a file read once from front to back (see exportFile): pages are given back as they are checked
+} file_map;
+
+// A class's students as they were at some point: its chunk table then, whose chunks are shared with the class
+// until the class writes to them (see writableChunk), and its number of students. Names are offsets into the
+// class's name pool, which only ever grows, so they stay valid.
+typedef struct class_snapshot
+{
+    student_chunk **chunks;
+    int chunk_count;
+    int num;
+    char label[SNAPSHOT_LABEL];
+} class_snapshot;
+
+// One class: its CATEGORY-COURSE-SECTION code and its students
+typedef struct classroom
+{
+    char category[CLASS_CODE_LENGTH];
+    char course_num[CLASS_CODE_LENGTH];
+    char section_num[CLASS_CODE_LENGTH];
+    // Students are stored in fixed-size chunks so that growing a class never moves the students already in it
+    student_chunk **chunks;
+    arena store;        // Holds every allocated chunk, so releasing the class takes a handful of frees
+    name_pool names;
+    int chunk_count;
+    int chunk_capacity; // Room in the chunks table
+    int mapped_chunks;  // The leading chunks that point into map instead of being allocated
+    int num;            // The number of students in the class
+    file_map *map;      // The mapping the first mapped_chunks chunks (and a mapped name pool) point into, or NULL
+    // A class opened by its header alone (see openClassImage): its image in map, whose students pageInClass
+    // checks and brings in the first time they are needed, or NULL once they have been
+    unsigned char *image;
+    size_t image_len;
+    // Journal state: the class_list snapshot and LSN this class was last saved as or loaded from, the
+    // number of students it had then, and the students changed since
+    uint64_t file_id;
+    uint64_t file_lsn;
+    int saved_num;
+    int *dirty;
+    int dirty_count;
+    int dirty_capacity;
+    // Search indexes, built by the first search and then kept up to date as students are added and removed:
+    // the positions of the first index_count students ordered by name, and ordered by age with age_start[a]
+    // the first of those aged a or more
+    int indexed;
+    int index_count;
+    int index_capacity;
+    int *name_order;
+    int *age_order;
+    int age_start[MAX_AGE + 2];
+    // Snapshots: the states Undo goes back to (newest last) and Redo forward to, each array holding up to
+    // MAX_SNAPSHOTS and allocated with the first snapshot. Each one starts a new generation; chunk_gens holds
+    // the generation each chunk was last made writable in, and a chunk of an older one may be shared with a
+    // snapshot. chunk_gens is NULL, and every chunk writable, until the first snapshot.
+    class_snapshot *undo;
+    int undo_count;
+    class_snapshot *redo;
+    int redo_count;
+    uint32_t generation;
+    uint32_t *chunk_gens;
+} classroom;
+
+// Aggregate statistics of a class's ages and genders
+typedef struct class_stats
+{
+    int count;
+    int min_age;
+    int max_age;
+    uint64_t age_sum;
+    int age_bins[AGE_BINS]; // Students aged 0-9, 10-19, ... 90 and over
+    int genders[4];         // Indexed by gender code; 0 is unused
+} class_stats;
+
+typedef int64_t money; // A fixed-point amount of MONEY_SCALE units to the dollar (or euro)
+
+// A per-student rate for the students whose age (or gender code) lies between low and high
+typedef struct price_tier
+{
+    int field; // TIER_AGE or TIER_GENDER
+    int low;
+    int high;
+    money rate;
+} price_tier;
+#define TIER_AGE 0
+#define TIER_GENDER 1
+
+// A tax rate for the classes of one category
+typedef struct tax_rate
+{
+    char category[CLASS_CODE_LENGTH];
+    int rate; // Basis points
+} tax_rate;
+
+// How classes are priced: the first tier a student falls in sets their rate, and students in no tier pay
+// base_rate. A class's tax rate is that of its category, or default_tax.
+typedef struct pricing_table
+{
+    money base_rate;
+    price_tier tiers[MAX_TIERS];
+    int tier_count;
+    tax_rate taxes[MAX_TAXES];
+    int tax_count;
+    int default_tax;
+} pricing_table;
+
+// The price of one class
+typedef struct class_price
+{
+    char code[CLASS_CODE_BUFFER];
+    int students;
+    int tax_rate;
+    money subtotal;
+    money tax;
+    money total;
+    int status; // 0, or -1 if the class file cannot be read, -2 if it is damaged, PRICE_OVERFLOW
+} class_price;
+
+// A batch of classes priced by several threads, taken from the catalog or loaded from class files
+typedef struct pricing_job
+{
+    classroom **classes; // The classes to price, or NULL to load each one from paths
+    char **paths;
+    int count;
+    const pricing_table *table;
+    const money *rates; // RATE_SLOTS rates, from buildRateTable
+    class_price *prices; // One per class, in the same order
+    atomic_int next;     // The next class to be handed out
+} pricing_job;
+
+// A batch of class files to load in parallel, each into its own class
+typedef struct load_job
+{
+    char **paths;
+    int count;
+    classroom *classes; // One per file, in the same order
+    int *status;        // One per file: 0, or the error readClassFile returned
+    atomic_int next;    // The next file to be handed out
+} load_job;
+
+// An export being written: where to, in which format, and the records formatted but not yet written
+typedef struct export_stream
+{
+    int fd;
+    int format;       // EXPORT_CSV or EXPORT_JSON
+    char *buffer;     // EXPORT_BUFFER_SIZE bytes
+    size_t len;
+    int failed;       // Set once a write fails; nothing more is written after it
+    long students;    // Students exported so far
+    uint64_t written; // Bytes written so far
+} export_stream;
+
+// The students of a class that share one name pool offset: the name, where the group starts in the students
+// grouped by offset, how many it holds, and the first of them in roster order
+typedef struct name_group
+{
+    const char *name;
+    int start;
+    int count;
+    int first;
+} name_group;
+
+// One step of a parallel sort of name groups: sort items[low, high), or, when mid is set, merge the sorted
+// runs items[low, mid) and items[mid, high) through scratch
+typedef struct sort_task
+{
+    name_group *items;
+    name_group *scratch;
+    int low;
+    int mid; // -1 to sort instead of merge
+    int high;
+} sort_task;
+
+// Filter instructions: FOP_AGE, FOP_GENDER and FOP_NAME compare a column of the students with a value and push
+// the mask of the students that pass; FOP_AND, FOP_OR and FOP_NOT combine the masks on top of the stack
+#define FOP_AGE 0
+#define FOP_GENDER 1
+#define FOP_NAME 2
+#define FOP_AND 3
+#define FOP_OR 4
+#define FOP_NOT 5
+// The comparisons of a filter instruction; names are only compared with FCMP_EQ and FCMP_NE
+#define FCMP_EQ 0
+#define FCMP_NE 1
+#define FCMP_LT 2
+#define FCMP_LE 3
+#define FCMP_GT 4
+#define FCMP_GE 5
+
+// One instruction of a compiled filter
+typedef struct filter_op
+{
+    unsigned char code; // FOP_*
+    unsigned char cmp;  // FCMP_*, for the comparisons
+    int value;          // The age or gender code compared with, or the name's place in the filter's names
+} filter_op;
+
+// A filter expression compiled by compileFilter into instructions that run a chunk of students at a time
+typedef struct student_filter
+{
+    filter_op ops[FILTER_OPS];
+    int count;
+    char names[FILTER_NAMES][NAME_LENGTH];
+    int name_count;
+    // A filter that compares no names depends only on gender and age, so compileFilter decides it once for
+    // every pair: table[gender * (MAX_AGE + 1) + age] is 1 for the pairs that match
+    unsigned char table[4 * (MAX_AGE + 1)];
+} student_filter;
+
+// compileFilter's place in the expression it compiles, and the first error it found
+typedef struct filter_parser
+{
+    const char *at;
+    student_filter *filter;
+    int depth; // Masks on the stack after the instructions emitted so far
+    const char *error;
+} filter_parser;
+
+// A slot of a duplicate table: the hash of a student's normalized name, gender and age, and the student's
+// position plus one, or 0 for an empty slot
+typedef struct dup_slot
+{
+    uint32_t hash;
+    int student;
+} dup_slot;
+
+// The students of a class seen so far, by name, gender and age, in an open-addressed (linear probing) table
+// that is kept at most half full
+typedef struct dup_table
+{
+    dup_slot *slots;
+    uint32_t mask; // The number of slots less one; the number is a power of two
+    int count;
+} dup_table;
+
+// The calls, time and bytes of one kind of operation. Relaxed atomics keep the counters exact when the pricing
+// workers add to them, at the cost of an uncontended atomic add.
+typedef struct op_stat
+{
+    atomic_ullong calls;
+    atomic_ullong ns;
+    atomic_ullong max_ns;
+    atomic_ullong bytes;
+} op_stat;
+
+// A server client's response. It is built whole in memory and only written out once the request has let go
+// of catalog_lock, so a client that stops reading holds up no one but itself.
+typedef struct reply_buffer
+{
+    int fd;
+    int failed;        // Set once a write fails
+    int out_of_memory; // Set if the response outgrew the memory available; it is replaced by an error
+    size_t len;
+    size_t capacity;   // At least LIST_BUFFER_SIZE
+    char *data;
+} reply_buffer;
+
+// One record of the audit queue. A producer that claims position p fills the slot once seq is p and then
+// sets it to p + 1; the writer takes it at p + 1 and frees it for position p + AUDIT_QUEUE.
+typedef struct audit_slot
+{
+    atomic_uint seq;
+    struct timespec when;
+    char text[AUDIT_TEXT];
+} audit_slot;
+
+// Every class in memory, indexed by class code in an open-addressed hash table
+typedef struct class_catalog
+{
+    classroom **classes;
+    int count;
+    int capacity;
+    int *slots;     // 0 for an empty slot, otherwise the position of the class in classes plus one
+    int slot_count; // Always a power of two
+} class_catalog;
+
 // ARR38-C: pointers are valid for the function parameters
-void prompt(int flag, int *num);
-void createClass(student *p, int *num);
-void addStudents(student *p, int *num);
-void init(int *num);
-void viewClassDetails(int *num);
-void viewClassList(student *p, int *num);
-void load(student *p, int *num, int flag);
-void save(student *p, int *num);
-void calculateCost(int *num);
+void prompt(void);
+int readInput(char *buffer, int size, int *truncated);
+void createClass(void);
+int parseClassCode(const char *code, classroom *cls);
+void addStudents(classroom *cls, int first);
+void addMoreStudents(classroom *cls);
+void removeStudent(classroom *cls);
+int deleteStudentAt(classroom *cls, int index);
+void findDuplicateStudents(classroom *cls);
+int removeMarked(classroom *cls, const unsigned char *marked);
+void takeSnapshot(classroom *cls);
+void undoChange(classroom *cls);
+void redoChange(classroom *cls);
+void viewSnapshot(classroom *cls);
+void diffSnapshot(const classroom *cls, const class_snapshot *snap);
+int checkpoint(classroom *cls, const char *label);
+int captureSnapshot(classroom *cls, class_snapshot *snap, const char *label);
+void restoreSnapshot(classroom *cls, const class_snapshot *snap);
+void freeSnapshots(classroom *cls);
+student_chunk *writableChunk(classroom *cls, int chunk);
+int initDuplicates(dup_table *table, int expected);
+int checkDuplicate(const classroom *cls, dup_table *table, int index);
+int growDuplicates(dup_table *table);
+void freeDuplicates(dup_table *table);
+uint32_t hashStudent(const char *name, int gender, int age);
+int sameName(const char *a, const char *b);
+int nextNameChar(const char **name);
+int isValidGender(int gender);
+int isValidAge(int age);
+int importStudents(const char *path, classroom *cls);
+const char *parseStudentRecord(char *line, student *s);
+void init(classroom *cls, int num);
+void viewClassDetails(classroom *cls);
+void viewClassList(classroom *cls);
+void viewClassListPage(classroom *cls);
+void writeClassListFile(classroom *cls);
+void viewSortedClassList(classroom *cls);
+void filterStudents(classroom *cls);
+int writeStudentList(int fd, const classroom *cls, const int *order, int first, int count);
+char *formatStudent(char *out, const classroom *cls, int i);
+int writeAll(int fd, const char *buffer, size_t len, int stat);
+void exportStudents(classroom *cls);
+int beginExport(export_stream *out, int fd, int format);
+int exportClass(export_stream *out, const classroom *cls, int release);
+int flushExport(export_stream *out);
+int endExport(export_stream *out);
+size_t escapeField(char *out, const char *text, size_t len, int format);
+void releasePages(const file_map *map, const void *from, const void *to);
+int exportFiles(const char *path, int format, const char *output);
+int exportFile(export_stream *out, const char *path);
+void load(void);
+void save(classroom *cls);
+int saveClass(classroom *cls);
+int loadClassList(classroom **out);
+void selectClass(void);
+void viewCatalog(void);
+void saveCatalog(void);
+void loadCatalog(void);
+classroom *findClass(class_catalog *cat, const classroom *key);
+classroom *catalogClass(class_catalog *cat, const classroom *key);
+void clearCatalog(class_catalog *cat);
+uint32_t hashClassCode(const classroom *cls);
+void formatClassCode(const classroom *cls, char *buffer);
+int writeClassImage(FILE *fp, const classroom *cls, uint64_t journal_id, uint64_t journal_lsn, uint64_t *length);
+int mapClassImage(unsigned char *image, size_t len, file_map *map, classroom *cls, class_header *header);
+int mapClassFile(const char *path, classroom *cls, class_header *header);
+int checkClassImage(const unsigned char *image, size_t len, class_header *header, size_t *records_len, uint64_t *names_len);
+int openClassImage(unsigned char *image, size_t len, file_map *map, classroom *cls, class_header *header);
+int openClassFile(const char *path, classroom *cls, class_header *header);
+int pageInClass(classroom *cls);
+int requireStudents(classroom *cls, const char *function);
+int writeCompactImage(FILE *fp, const classroom *cls, uint64_t journal_id, uint64_t journal_lsn, uint64_t *length);
+int writeCompactBlock(FILE *fp, unsigned char *block, size_t len, uint32_t count);
+int loadCompactClassFile(const char *path, classroom *cls, class_header *header);
+int readCompactBlock(FILE *fp, unsigned char *block, size_t *len, uint32_t *count);
+int readClassFile(const char *path, classroom *cls, class_header *header, int lazy);
+size_t putVarint(unsigned char *p, uint32_t value);
+int getVarint(const unsigned char **p, const unsigned char *end, uint32_t *value);
+int appendName(name_pool *pool, const char *name, size_t len, uint32_t *offset);
+int saveSnapshot(classroom *cls);
+int appendJournal(classroom *cls);
+int replayJournal(classroom *cls, const class_header *header, uint64_t *last_lsn);
+void startCompaction(classroom *cls);
+void finishCompaction(int block);
+int trimJournal(uint64_t lsn);
+int writeJournalHeader(int fd, uint64_t journal_id);
+int journalFormat(const unsigned char *header);
+int readJournalEntry(FILE *fp, int format, unsigned char *entry, size_t *length);
+void markDirty(classroom *cls, int index);
+int resizeClass(classroom *cls, int num);
+int reserveStudents(classroom *cls, int count);
+void getStudent(const classroom *cls, int index, student *s);
+const char *studentName(const classroom *cls, int index);
+int studentAge(const classroom *cls, int index);
+void searchStudents(classroom *cls);
+int findByName(const classroom *cls, const char *key, int prefix, int *first);
+int buildIndexes(classroom *cls);
+int sortByName(const classroom *cls, int *order);
+int sortNameGroups(name_group *items, int count);
+void runSortTasks(sort_task *tasks, int count);
+void *sortWorker(void *arg);
+int compareNameGroups(const void *a, const void *b);
+void sortByGender(const classroom *cls, const int *by_name, int *order);
+int compileFilter(const char *text, student_filter *filter, const char **error);
+int parseFilterOr(filter_parser *p);
+int parseFilterAnd(filter_parser *p);
+int parseFilterUnary(filter_parser *p);
+int parseFilterComparison(filter_parser *p);
+int matchFilterToken(filter_parser *p, const char *token);
+int emitFilterOp(filter_parser *p, int code, int cmp, int value);
+int filterClass(const student_filter *filter, const classroom *cls, int *matches);
+void runFilter(const student_filter *filter, const unsigned char *ages, const unsigned char *genders, const uint32_t *names,
+               const char *base, const uint32_t *bound, int n, unsigned char (*stack)[CHUNK_STUDENTS]);
+void compareColumn(const unsigned char *column, int n, int cmp, int value, unsigned char *out);
+int reserveIndexes(classroom *cls, int count);
+void indexInsert(classroom *cls, int index);
+void indexRemove(classroom *cls, int index);
+void dropIndexes(classroom *cls);
+int setStudent(classroom *cls, int index, const student *s);
+void viewClassStatistics(classroom *cls);
+void classStatistics(const classroom *cls, class_stats *stats);
+void columnStatistics(const unsigned char *ages, const unsigned char *genders, int n, class_stats *stats);
+uint64_t classImageLength(int num, uint32_t names_size);
+void *arenaAlloc(arena *a, size_t size);
+void arenaRelease(arena *a);
+int internName(name_pool *pool, const char *name, uint32_t *offset);
+int findName(const name_pool *pool, const char *name, uint32_t *offset);
+int ownNamePool(name_pool *pool);
+void releaseNamePool(name_pool *pool);
+uint32_t hashName(const char *name);
+void decodeStudent(const unsigned char *record, const class_header *header, student *s);
+int compareInts(const void *a, const void *b);
+int compareStrings(const void *a, const void *b);
+int compareDoubles(const void *a, const void *b);
+int loadLegacyClassFile(const char *path, classroom *cls);
+file_map *mapFile(const char *path, int *status);
+void releaseMap(file_map *map);
+void releaseClass(classroom *cls);
+void encodeClassHeader(unsigned char *buffer, const class_header *header);
+int decodeClassHeader(const unsigned char *buffer, class_header *header);
+int columnsMatchMemory(const class_header *header);
+uint64_t checksum64(const void *buffer, size_t len, uint64_t seed);
+uint64_t checksumMapped(const unsigned char *buffer, size_t len, const file_map *map);
+void putLE32(unsigned char *p, uint32_t value);
+void putLE64(unsigned char *p, uint64_t value);
+uint32_t getLE32(const unsigned char *p);
+uint64_t getLE64(const unsigned char *p);
+void calculateCost(classroom *cls);
+void priceCatalog(void);
+int readBaseRate(const char *function, int *currency, money *rate);
+void printMoney(int currency, money amount);
+int parseMoney(const char *text, money *value);
+void formatMoney(money amount, char *buffer);
+int loadPricing(const char *path, pricing_table *table);
+void buildRateTable(const pricing_table *table, money *rates);
+int classTaxRate(const pricing_table *table, const classroom *cls);
+int priceClass(const classroom *cls, const money *rates, int tax_rate, class_price *price);
+int priceStudents(const classroom *cls, const int *students, int count, const money *rates, int tax_rate, class_price *price);
+int priceHistogram(const uint64_t *counts, const money *rates, class_price *price);
+void printCost(const pricing_table *table, const class_price *price, int currency);
+int runWorkers(void *(*work)(void *), void *job, int count, atomic_int *next);
+void *pricingWorker(void *arg);
+int priceDirectory(const char *dir, const pricing_table *table);
+int listDirectory(const char *dir, char ***paths, int *count);
+int loadDirectory(const char *dir);
+void *loadWorker(void *arg);
+void printPriceReport(const class_price *prices, int count, int currency);
+int runBenchmarks(const char *sizes);
+int benchRoster(classroom *cls, int num, uint32_t seed);
+double benchNow(void);
+void benchReport(const char *op, int num, double *samples, int runs, uint64_t bytes);
+uint64_t statsNow(void);
+void statsAdd(int op, uint64_t ns, uint64_t bytes);
+void showStatistics(void);
+void writeStatistics(FILE *fp, int json);
+void dumpStatistics(void);
+int runServer(const char *path);
+void stopServer(int sig);
+void *serveClient(void *arg);
+int handleRequest(reply_buffer *out, char *line);
+void readClass(reply_buffer *out, const char *command, const classroom *cls, const char *args);
+void updateClass(reply_buffer *out, const char *command, const classroom *key, char *args);
+void replyf(reply_buffer *out, const char *format, ...);
+int replyReserve(reply_buffer *out, size_t need);
+int replyFlush(reply_buffer *out);
+int replyEnd(reply_buffer *out);
+int runClient(const char *path);
+int startAudit(void);
+void stopAudit(void);
+void audit(const char *event, const classroom *cls, const char *format, ...);
+void *auditWriter(void *arg);
+int rotateAudit(int fd);
 void logUser();
-void *erase(void *pointer);
+void *erase(void *pointer, size_t size);
 
-// EXP34-C: The 'data' pointer is never dereferenced in the code when it is NULL.
-// ARR02-C: Array bounds are specified, not implicitly defined by initializers.
-// ARR32-C: array defined in valid range
-student *data = NULL;
-char category[CLASS_CODE_LENGTH];
-char course_num[CLASS_CODE_LENGTH];
-char section_num[CLASS_CODE_LENGTH];
+// EXP34-C: The 'current' pointer is never dereferenced in the code when it is NULL.
+class_catalog catalog;
+classroom *current = NULL; // The class that menu actions work on
+// class_list's journal: the snapshot it extends, its last LSN and size, and any compaction still running
+uint64_t class_file_id = 0;
+uint64_t class_file_lsn = 0;
+off_t journal_bytes = 0;
+off_t snapshot_bytes = 0;
+pid_t compaction_pid = 0;
+uint64_t compaction_lsn = 0;
 // STR11-C: No specified dimensions so string literal assignment will automatically include a null terminator
 // ARR32-C: array defined in valid range
 char organization_name[] = "ISU IT"; 
+// Operation statistics, the input wait and file I/O bytes counted so far, and when the session started
+op_stat op_stats[STAT_COUNT];
+uint64_t input_ns = 0; // Only the main thread reads input
+atomic_ullong io_bytes;
+uint64_t session_start = 0;
+const char *stats_file = NULL; // Where dumpStatistics writes them on exit, from --stats-file
+int compact_files = 0;         // Set by --compact: class_list snapshots are written as compact class files
+int duplicate_policy = DUP_WARN; // Set by --duplicates: what entry and import do with a repeated student
+// 0 is not a menu choice, so its counter is never used
+const char *const stat_names[STAT_COUNT] = {
+    "", "Create Class", "View Class Details", "View Student List", "Save Class File", "Load Class File",
+    "Calculate Cost of Class", "Quit", "Select Class", "View Catalog", "Save Catalog File", "Load Catalog File",
+    "Add More Students", "Remove Student", "View Student List Page", "Write Student List to File",
+    "View Class Statistics", "Search Students", "Price All Classes", "Show Statistics", "View Sorted Student List",
+    "Find Duplicate Students", "Take Snapshot", "Undo", "Redo", "View Snapshot",
+    "Filter Students", "Export Students",
+    "input wait", "roster read", "student list write", "class image write", "class file map",
+    "legacy class file read", "journal append", "journal replay", "journal trim",
+    "compact class file read", "audit log write", "export write", "socket write"};
+// Server mode: the lock that lets client requests read the catalog in parallel but change it one at a time,
+// the number of connected clients, and the flag set by SIGINT and SIGTERM
+pthread_rwlock_t catalog_lock = PTHREAD_RWLOCK_INITIALIZER;
+atomic_int client_count;
+volatile sig_atomic_t server_stop = 0;
+// The audit log: the lock-free queue that every thread adds records to, the thread that writes them out, and
+// the user and session that logUser records them under
+audit_slot audit_queue[AUDIT_QUEUE];
+atomic_uint audit_head;  // The next position a producer claims
+unsigned audit_tail = 0; // The next position to write out; only the writer thread uses it
+atomic_uint audit_dropped;
+atomic_int audit_stop;
+int audit_running = 0;
+pthread_t audit_thread;
+char audit_user[AUDIT_USER] = "-";
+long audit_session = 0;
+// The pricing used by the cost calculations; --pricing replaces its tiers, tax table and base rate
+pricing_table pricing = {.default_tax = DEFAULT_TAX_RATE};
+// Gender labels of the student list, indexed by gender code; any other code is listed as Other
+const char *const gender_labels[] = {"Other", "Male", "Female", "Other"};
 
 /**
  * @brief Begins the program
  *
+ * Usage: main [--import ROSTER --class CATEGORY-COURSE-SECTION] [--load-dir DIRECTORY] [--script COMMANDS] [--pricing FILE]
+ *             [--compact] [--duplicates allow|warn|drop]
+ *        main --pricing FILE --price-dir DIRECTORY
+ *        main --bench SIZES
+ *        main --export CLASS_FILE|DIRECTORY [--format csv|json] [--output FILE]
+ *        main [--import ROSTER --class CATEGORY-COURSE-SECTION] [--load-dir DIRECTORY] [--pricing FILE] --serve SOCKET
+ *        main --connect SOCKET
+ * Any of these can add --stats-file FILE to write the operation statistics to FILE as JSON lines on exit.
+ *
+ * A script file holds exactly what would be typed at the prompts, one answer per line (starting with the
+ * user log code), and is replayed in place of stdin. A pricing file sets the tiers and tax rates of the cost
+ * calculations (see loadPricing); with --price-dir, every class file in the directory is priced with it
+ * and the program exits without prompting. --bench times the roster operations on synthetic classes of each of
+ * the comma-separated sizes (see runBenchmarks) and exits. --serve holds the catalog in memory and serves it to
+ * clients over a Unix domain socket (see runServer); --connect sends each line of stdin to such a server.
+ * --load-dir loads every class file in a directory into the catalog in parallel before the prompt or server
+ * starts (see loadDirectory); files that cannot be read are reported and skipped.
+ * --compact saves class_list as a compact class file (see writeCompactImage), several times smaller for
+ * archiving; class files of every format are loaded whether or not it is given.
+ * --duplicates sets what student entry and roster import do with a student whose name (ignoring case and
+ * extra spaces), gender and age match one already in the class: keep them silently, keep them with a warning
+ * (the default), or drop them. Find Duplicate Students reports the duplicates already in a class.
+ * --export writes the students of a class file, or of every class file in a directory, to FILE (or stdout) as
+ * CSV or JSON lines and exits (see exportFiles); its memory does not grow with the size of the classes.
+ *
+ * @param argc The number of command line arguments
+ * @param argv The command line arguments
  * @return int Returns 0 if the program ran an quit successfully
  */
-int main()
+int main(int argc, char *argv[])
 {
     // DCL30-C: Declares following variables within execution of program but not outside of it
-    // EXP33-C: Initializes 'num' and 'flag' variables to 0 to prevent garbage values from being read.
-    int num = 0;
-    int flag = 0;
+    // EXP33-C: Initializes 'key' to zeroes to prevent garbage values from being read.
+    classroom key;
+    const char *import_path = NULL;
+    const char *class_code = NULL;
+    const char *script_path = NULL;
+    const char *pricing_path = NULL;
+    const char *price_dir = NULL;
+    const char *bench_sizes = NULL;
+    const char *serve_path = NULL;
+    const char *connect_path = NULL;
+    const char *load_dir = NULL;
+    const char *export_path = NULL;
+    const char *export_output = NULL;
+    int export_format = EXPORT_CSV;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--import") == 0 && i + 1 < argc)
+        {
+            import_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--class") == 0 && i + 1 < argc)
+        {
+            class_code = argv[++i];
+        }
+        else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc)
+        {
+            script_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--pricing") == 0 && i + 1 < argc)
+        {
+            pricing_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--price-dir") == 0 && i + 1 < argc)
+        {
+            price_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+        {
+            bench_sizes = argv[++i];
+        }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+        {
+            serve_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc)
+        {
+            connect_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--stats-file") == 0 && i + 1 < argc)
+        {
+            stats_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--load-dir") == 0 && i + 1 < argc)
+        {
+            load_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc)
+        {
+            export_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc && (strcmp(argv[i + 1], "csv") == 0 || strcmp(argv[i + 1], "json") == 0))
+        {
+            i++;
+            export_format = argv[i][0] == 'c' ? EXPORT_CSV : EXPORT_JSON;
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            export_output = argv[++i];
+        }
+        else if (strcmp(argv[i], "--compact") == 0)
+        {
+            compact_files = 1;
+        }
+        else if (strcmp(argv[i], "--duplicates") == 0 && i + 1 < argc
+                 && (strcmp(argv[i + 1], "allow") == 0 || strcmp(argv[i + 1], "warn") == 0 || strcmp(argv[i + 1], "drop") == 0))
+        {
+            i++;
+            duplicate_policy = argv[i][0] == 'a' ? DUP_ALLOW : argv[i][0] == 'w' ? DUP_WARN : DUP_DROP;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--import ROSTER --class CATEGORY-COURSE-SECTION] [--load-dir DIRECTORY] [--script COMMANDS] [--pricing FILE] [--compact] [--duplicates allow|warn|drop] [--stats-file FILE]\n"
+                            "       %s --pricing FILE --price-dir DIRECTORY [--stats-file FILE]\n       %s --bench SIZES [--stats-file FILE]\n"
+                            "       %s --export CLASS_FILE|DIRECTORY [--format csv|json] [--output FILE] [--stats-file FILE]\n"
+                            "       %s [--import ROSTER --class CATEGORY-COURSE-SECTION] [--load-dir DIRECTORY] [--pricing FILE] --serve SOCKET [--stats-file FILE]\n"
+                            "       %s --connect SOCKET\n", argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+            return 1;
+        }
+    }
+    if ((import_path == NULL) != (class_code == NULL))
+    {
+        fprintf(stderr, "ERROR: --import and --class must be given together.\n");
+        return 1;
+    }
+    if (export_path == NULL && export_output != NULL)
+    {
+        fprintf(stderr, "ERROR: --output is only used with --export.\n");
+        return 1;
+    }
+    if (price_dir != NULL && pricing_path == NULL)
+    {
+        fprintf(stderr, "ERROR: --price-dir needs the rates of a --pricing file.\n");
+        return 1;
+    }
+    session_start = statsNow();
+    // ERR06-C: The statistics are written by an atexit handler, so every way out of main writes them
+    if (stats_file != NULL && atexit(dumpStatistics) != 0)
+    {
+        fprintf(stderr, "ERROR: Could not arrange for the statistics to be written on exit.\n");
+        return 1;
+    }
+    if (pricing_path != NULL && loadPricing(pricing_path, &pricing) != 0)
+    {
+        return 1;
+    }
+    if (price_dir != NULL)
+    {
+        return priceDirectory(price_dir, &pricing);
+    }
+    if (bench_sizes != NULL)
+    {
+        return runBenchmarks(bench_sizes);
+    }
+    if (export_path != NULL)
+    {
+        return exportFiles(export_path, export_format, export_output);
+    }
+    if (connect_path != NULL)
+    {
+        return runClient(connect_path);
+    }
+
+    memset(&key, 0, sizeof(key));
+    if (class_code != NULL && parseClassCode(class_code, &key) != 0)
+    {
+        fprintf(stderr, "ERROR: Invalid class code '%s'. Expected CATEGORY-COURSE-SECTION with fields fewer than %d characters long.\n", class_code, CLASS_CODE_LENGTH);
+        return 1;
+    }
+
+    // FIO42-C: The script replaces stdin, which is closed by the runtime at exit
+    if (script_path != NULL && freopen(script_path, "r", stdin) == NULL)
+    {
+        fprintf(stderr, "ERROR: Could not open script file '%s'.\n", script_path);
+        return 1;
+    }
 
-    logUser();
-    prompt(flag++, &num);
+    if (serve_path == NULL)
+    {
+        logUser();
+    }
+    if (startAudit() != 0)
+    {
+        fprintf(stderr, "ERROR: Could not start the audit log '%s'. Actions will not be audited.\n", AUDIT_FILE);
+    }
+    if (serve_path != NULL)
+    {
+        audit("serve", NULL, "socket=%s", serve_path);
+    }
+    else
+    {
+        audit("login", NULL, "pid=%ld", (long)getpid());
+    }
+    if (import_path != NULL)
+    {
+        current = catalogClass(&catalog, &key);
+        if (current == NULL || importStudents(import_path, current) != 0)
+        {
+            audit("import", &key, "file=%s failed", import_path);
+            return 1;
+        }
+        audit("import", current, "file=%s students=%d ok", import_path, current->num);
+    }
+    if (load_dir != NULL && loadDirectory(load_dir) != 0)
+    {
+        return 1;
+    }
+    if (serve_path != NULL)
+    {
+        return runServer(serve_path);
+    }
+    prompt();
+    finishCompaction(1);
+    clearCatalog(&catalog);
     return 0;
 }
 
 /**
- * @brief Prompts the user to choose a function of the program
+ * @brief Prompts the user to choose a function of the program until they quit or input ends
  *
- * @param flag Indicates whether data already exists (and needs to be freed)
- * @param num The number of students in the class
+ * Each handler returns here when it is done, so a session of any length runs in constant stack space.
+ * Class actions work on the selected class (current).
  */
-void prompt(int flag, int *num)
+void prompt(void)
 {
     int choice;
     // STR30-C: Uses array representation because it will be modified
     // STR11-C: Array is not initialized to a string literal, so explicit dimensions are valid
     // ARR32-C: array defined in valid range
-    char num_buffer[2];
-    char c; // Character used to flush stdin
+    char num_buffer[3];
+    char code[CLASS_CODE_BUFFER];
+    uint64_t start;
+    uint64_t waited;
+    uint64_t moved;
 
     printf("\nWelcome to the %s class management system!\n", organization_name);
     do
     {
         choice = -1;
-        printf("\t1) Create Class\n\t2) View Class Details\n\t3) View Student List\n\t4) Save Class File\n\t5) Load Class File\n\t6) Calculate Cost of Class\n\t7) Quit\nEnter Option: ");
+        if (current != NULL)
+        {
+            formatClassCode(current, code);
+            printf("Selected class: %s\n", code);
+        }
+        printf("\t1) Create Class\n\t2) View Class Details\n\t3) View Student List\n\t4) Save Class File\n\t5) Load Class File\n\t6) Calculate Cost of Class\n\t7) Quit\n"
+               "\t8) Select Class\n\t9) View Catalog\n\t10) Save Catalog File\n\t11) Load Catalog File\n\t12) Add More Students\n\t13) Remove Student\n"
+               "\t14) View Student List Page\n\t15) Write Student List to File\n\t16) View Class Statistics\n\t17) Search Students\n\t18) Price All Classes\n\t19) Show Statistics\n\t20) View Sorted Student List\n\t21) Find Duplicate Students\n"
+               "\t22) Take Snapshot\n\t23) Undo\n\t24) Redo\n\t25) View Snapshot\n\t26) Filter Students\n\t27) Export Students\nEnter Option: ");
 
         /* FIO20-C: Because the input is just a temporary choice and not important data, we limit the
-                    number of digits to one. If a user did put 100, we would treat it as a 1, prioritizing
+                    number of digits to two. If a user did put 100, we would treat it as a 10, prioritizing
                     prevention of buffer overflow over user freedom.
         */
         /* STR31-C: All uses of fgets use the middle variable to know how many characters to addStudents
                     In all occurences, it is at most the length of the buffer (fgets will stop just 
                     before using the whole buffer)
         */
-        fgets(num_buffer, 2, stdin);
-
-        /* EXP45-C: Intentional assignment to 'c' is happening in the following 'while()' loop.
-                    Usually, assignments in selection statements are UNINTENTIONAL.
-                    This is to ensure the input stream is clean after the line is read from the user.
-        */
-        while ((c = getchar()) != '\n' && c != EOF); // There's at least one trailing \n
+        if (readInput(num_buffer, 3, NULL) < 0)
+        {
+            // End of input (e.g. the end of a script) is treated the same as choosing Quit
+            printf("\nQuitting application...\n");
+            break;
+        }
         // ERR33-C: The error doesn't need to be checked because it will be caught by the switch
         sscanf(num_buffer, "%d", &choice); // Convert char to integer
+        start = statsNow();
+        waited = input_ns;
+        moved = atomic_load_explicit(&io_bytes, memory_order_relaxed);
 
         // MSC20-C: Switch statement does not transition into complex blocks, instead performs simplistic instructions for each case.
         // MSC01-C: Logical completeness in break statements for cases as appropriate, also seen in if statements with matching else statements.
-        // MSC17-C: Each switch case has a break statement with the (acceptable) exception of a clearly acknowledged instance of fallthrough.
+        // MSC17-C: Each switch case has a break statement.
         switch (choice)
         {
         case 1:
-            createClass(data, num);
+            createClass();
             break;
         case 2:
-            viewClassDetails(num);
+            viewClassDetails(current);
             break;
         case 3:
-            viewClassList(data, num);
-            // ***Fallthrough intended here.
+            viewClassList(current);
+            break;
         case 4:
-            save(data, num);
+            save(current);
             break;
         case 5:
-            load(data, num, flag);
+            load();
             break;
         case 6:
-            calculateCost(num);
+            calculateCost(current);
             break;
         case 7:
             printf("\nQuitting application...");
             break;
+        case 8:
+            selectClass();
+            break;
+        case 9:
+            viewCatalog();
+            break;
+        case 10:
+            saveCatalog();
+            break;
+        case 11:
+            loadCatalog();
+            break;
+        case 12:
+            addMoreStudents(current);
+            break;
+        case 13:
+            removeStudent(current);
+            break;
+        case 14:
+            viewClassListPage(current);
+            break;
+        case 15:
+            writeClassListFile(current);
+            break;
+        case 16:
+            viewClassStatistics(current);
+            break;
+        case 17:
+            searchStudents(current);
+            break;
+        case 18:
+            priceCatalog();
+            break;
+        case 19:
+            showStatistics();
+            break;
+        case 20:
+            viewSortedClassList(current);
+            break;
+        case 21:
+            findDuplicateStudents(current);
+            break;
+        case 22:
+            takeSnapshot(current);
+            break;
+        case 23:
+            undoChange(current);
+            break;
+        case 24:
+            redoChange(current);
+            break;
+        case 25:
+            viewSnapshot(current);
+            break;
+        case 26:
+            filterStudents(current);
+            break;
+        case 27:
+            exportStudents(current);
+            break;
         default:
-            printf("\nERROR: Invalid input. Please enter an integer (1-7).\n");
+            printf("\nERROR: Invalid input. Please enter an integer (1-%d).\n", MENU_OPTIONS);
             break;
         }
+        if (choice >= 1 && choice <= MENU_OPTIONS)
+        {
+            // Time spent waiting at the action's own prompts is the user's, not the action's
+            statsAdd(STAT_MENU + choice, statsNow() - start - (input_ns - waited),
+                     atomic_load_explicit(&io_bytes, memory_order_relaxed) - moved);
+        }
         printf("\n");
     } while (choice != 7);
-    exit(0);
+}
+
+/**
+ * @brief Reads one line of input into buffer, discarding whatever part of the line does not fit
+ *
+ * The newline is not stored, so the next read always starts at the beginning of the next line.
+ *
+ * @param buffer The buffer to read into
+ * @param size The size of buffer, including room for the terminator
+ * @param truncated Set to 1 if part of the line was discarded, 0 otherwise (may be NULL)
+ * @return int The length of the stored input, or -1 at end of input
+ */
+int readInput(char *buffer, int size, int *truncated)
+{
+    int c; // INT31-C: getchar() results are kept in an int so EOF is not confused with a valid character
+    int len;
+    uint64_t start = statsNow();
+
+    if (truncated != NULL)
+    {
+        *truncated = 0;
+    }
+    // STR31-C: fgets stops one byte short of size, leaving room for the null terminator
+    if (fgets(buffer, size, stdin) == NULL)
+    {
+        buffer[0] = '\0';
+        input_ns += statsNow() - start;
+        return -1;
+    }
+    len = strlen(buffer);
+    if (len > 0 && buffer[len - 1] == '\n')
+    {
+        buffer[--len] = '\0';
+    }
+    else
+    {
+        /* EXP45-C: Intentional assignment to 'c' is happening in the following 'while()' loop.
+                    Usually, assignments in selection statements are UNINTENTIONAL.
+                    This is to ensure the input stream is clean after the line is read from the user.
+        */
+        while ((c = getchar()) != '\n' && c != EOF)
+        {
+            if (truncated != NULL)
+            {
+                *truncated = 1;
+            }
+        }
+    }
+    uint64_t waited = statsNow() - start;
+    input_ns += waited;
+    statsAdd(STAT_INPUT, waited, (uint64_t)len);
+    return len;
 }
 
 /**
  * @brief Creates a class and gets the number of students and class details
- * 
- * @param p The pointer to the first of num student structs
- * @param num The number of students in the class
+ *
+ * The new class is added to the catalog (replacing any class with the same code) and selected.
  */
-void createClass(student *p, int *num) {
+void createClass(void) {
     // ARR32-C: arrays defined in valid range
-    int max_len = (CLASS_CODE_LENGTH * 3) + 3;
-    char num_buffer[4];
+    int max_len = CLASS_CODE_BUFFER;
+    char num_buffer[10];
     char class_buffer[max_len];
-    int len; // Length of the input string
-    char c;  // Character used to flush stdin
+    classroom key;
+    classroom *cls;
+    int num;
 
     // ARR01-C: 'sizeof(char)' is used in part to get the size of the array appropriately instead of a pointer.
     memset(class_buffer, 0, max_len * sizeof(char));
-    memset(category, 0, CLASS_CODE_LENGTH * sizeof(char));
-    memset(course_num, 0, CLASS_CODE_LENGTH * sizeof(char));
-    memset(section_num, 0, CLASS_CODE_LENGTH * sizeof(char));
+    memset(&key, 0, sizeof(key));
 
     printf("\nClass information is given in the format CATEGORY-COURSE-SECTION. Example: IT-355-001\n\nEnter class information: ");
-    if ((len = strlen(fgets(class_buffer, max_len, stdin))) == max_len - 1 && num_buffer[2] != '\n') 
+    if (readInput(class_buffer, max_len, NULL) < 0)
     {
-        while ((c = getchar()) != '\n' && c != EOF);
+        return;
     }
-    class_buffer[len - 1] = '\0'; // Trim newline
 
-    
-    // STR06-C: Copy of buffer created so strtok doesn't overwrite original
+    switch (parseClassCode(class_buffer, &key)) {
+    case -1:
+        printf("\nERROR: Invalid input. Fields must be fewer than %d characters long.\nCreate Class function failed. Please try again.\n", CLASS_CODE_LENGTH);
+        return;
+    case -2:
+        printf("\nERROR: Invalid input. You must provide three, and only three fields.\nERROR: Create Class function failed. Please try again.\n");
+        return;
+    }
+
+    printf("\nEnter the number of students in the class: ");
+    // FIO20-C: makes sure input isnt truncated
+    // STR32-C: fgets ensures only as many as a 9-digit number can be entered into the array of size 10
+    readInput(num_buffer, 10, NULL);
+    if (sscanf(num_buffer, "%d", &num) != 1 || num < 1 || num > MAX_STUDENTS) 
+    {
+        printf("\nERROR: Invalid input. Input must be an integer in range (1-%d).\nERROR: Add Students function failed. Please try again.\n", MAX_STUDENTS);
+        return;
+    }
+    if ((cls = catalogClass(&catalog, &key)) == NULL)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Create Class function failed. Please try again.\n");
+        return;
+    }
+    current = cls;
+    // MEM31-C: Any previous roster of this class is released before it is replaced
+    releaseClass(cls);
+    init(cls, num);
+    audit("create", cls, "students=%d %s", cls->num, cls->num > 0 ? "ok" : "failed");
+}
+
+/**
+ * @brief Splits a CATEGORY-COURSE-SECTION class code into the category, course_num and section_num fields
+ *
+ * @param code The class code to parse
+ * @param cls The class whose code fields are filled in
+ * @return int 0 on success, -1 if a field is too long, -2 if there are not exactly three fields
+ */
+int parseClassCode(const char *code, classroom *cls)
+{
+    int max_len = CLASS_CODE_BUFFER;
+    // STR06-C: Copy of buffer created so strtok_r doesn't overwrite original
     char buffer_copy[max_len];
-    strcpy(buffer_copy, class_buffer);
-    
+
+    if (strlen(code) > (size_t)max_len - 1)
+    {
+        return -1;
+    }
+    strcpy(buffer_copy, code);
+
     // Parsing information
     char *delim = "-";
-    char *token = strtok(buffer_copy, delim);
-    int index = 0;
+    // CON33-C: strtok_r keeps its position in save, so server threads can parse class codes at the same time
+    char *save;
+    char *token = strtok_r(buffer_copy, delim, &save);
     int tkn_len = 0;
     int tkn_count = 0;
 
@@ -196,341 +1275,8300 @@ void createClass(student *p, int *num) {
         tkn_count++;
         tkn_len = strlen(token);
         if (tkn_len > CLASS_CODE_LENGTH - 1) {
-            printf("\nERROR: Invalid input. Fields must be fewer than %d characters long.\nCreate Class function failed. Please try again.\n", CLASS_CODE_LENGTH);
-            return;
+            return -1;
         } else {
             // STR03-C: Arrays are given enough memory so that strcpy does not truncate the string
             switch(tkn_count) {
             case 1:
-                strcpy(category, token);
+                strcpy(cls->category, token);
                 break; 
             case 2:
-                strcpy(course_num, token);
+                strcpy(cls->course_num, token);
                 break;
             case 3:
-                strcpy(section_num, token);
+                strcpy(cls->section_num, token);
                 break;
             }
         }
-        index += tkn_len + 1;
-        token = strtok(NULL, delim);
-    }
-    if (tkn_count != 3) {
-        printf("\nERROR: Invalid input. You must provide three, and only three fields.\nERROR: Create Class function failed. Please try again.\n");
-        return;
-    }
-
-    printf("\nEnter the number of students in the class: ");
-    // FIO20-C: makes sure input isnt truncated
-    // STR32-C: fgets ensures only as many as a 3-digit number can be entered into the array of size 4
-    if ((len = strlen(fgets(num_buffer, 4, stdin))) == 3 && num_buffer[2] != '\n') 
-    {
-        while ((c = getchar()) != '\n' && c != EOF);
+        token = strtok_r(NULL, delim, &save);
     }
-    if (sscanf(num_buffer, "%d", num) != 1 || *num < 1) 
-    {
-        *num = 0;
-        printf("\nERROR: Invalid input. Input must be an integer in range (1-999).\nERROR: Add Students function failed. Please try again.\n");
-        return;
+    if (tkn_count != 3 || token != NULL) {
+        return -2;
     }
-    init(num);
-    addStudents(data, num);
+    return 0;
 }
 
 /**
- * @brief Allocates sufficient data for num students
+ * @brief Allocates sufficient data for num students and has the user enter them
  *
+ * @param cls The class, with no students yet
  * @param num The number of students in the class
  */
-void init(int *num)
+void init(classroom *cls, int num)
 {
-    // MEM35-C: Sufficient memory is allocated for data based on size of student
-    data = (student *)malloc((*num) * sizeof(student));
-    // MSC15-C: In loops such as this one, rather than checking if the current element has gone beyond its bounds (which could easily
-    // lead to undefined behavior), the element is checked to ensure it remains within its bounds, ending the loop upon reaching said bounds.
-    for (int i = 0; i < *num; i++)
+    // MEM35-C: Sufficient memory is allocated for num students, which start zeroed
+    if (resizeClass(cls, num) != 0)
     {
-        memset(data->name, 0, NAME_LENGTH * sizeof(char));
-        data->gender = 0;
-        data->age = 0;
-        data++;
+        resizeClass(cls, 0);
+        printf("\nERROR: Out of memory.\nERROR: Create Class function failed. Please try again.\n");
+        return;
     }
-    data -= *num;
-    addStudents(data, num);
+    addStudents(cls, 0);
 }
 
 /**
  * @brief Fills students information using data provided by the user
  *
- * @param p The pointer to the first of num student structs
- * @param num The number of students in the class
+ * If an entry is invalid, every student of this batch is dropped (the whole class when it is being created).
+ * A student who is already in the class is flagged or left out as duplicate_policy says, the class shrinking
+ * by the students left out.
+ *
+ * @param cls The class whose students from first up to num are filled in
+ * @param first The first student to fill in
  */
-void addStudents(student *p, int *num)
+void addStudents(classroom *cls, int first)
 {
-    int len = 0;
-    char num_buffer[3]; // Used to accept gender and age data (<= 2 digits + \n)
-    char c; // Used to flush stdin on attempted buffer overflow
+    student entry;
+    student *p = &entry;
+    int *num = &cls->num;
+    char num_buffer[3]; // Used to accept gender and age data (<= 2 digits)
+    int truncated = 0;
     int read_failed = 0;
+    int policy = duplicate_policy;
+    dup_table seen = {0};
+    int kept = first; // Where the next student goes; behind i once a duplicate has been left out
+    int dup = -1;
+
+    if (policy != DUP_ALLOW)
+    {
+        // The students already in the class are seen first, so each entry is checked against all of them
+        dup = initDuplicates(&seen, *num) != 0 ? -2 : -1;
+        for (int i = 0; i < first && dup != -2; i++)
+        {
+            dup = checkDuplicate(cls, &seen, i);
+        }
+        if (dup == -2)
+        {
+            printf("\nWARNING: Out of memory. Duplicate students will not be detected.\n");
+            policy = DUP_ALLOW;
+        }
+    }
 
-    for (int i = 0; i < *num; i++)
+    // MSC15-C: In loops such as this one, rather than checking if the current element has gone beyond its bounds (which could easily
+    // lead to undefined behavior), the element is checked to ensure it remains within its bounds, ending the loop upon reaching said bounds.
+    for (int i = first; i < *num; i++)
     {
+        memset(p, 0, sizeof(student));
         printf("\n\tStudent Name: ");
         // If the entire buffer is used, name may be truncated and input may need to be flushed
-        if ((len = strlen(fgets(p->name, NAME_LENGTH, stdin))) == NAME_LENGTH - 1) 
+        readInput(p->name, NAME_LENGTH, &truncated);
+        if (truncated) 
         {
             printf("\nWARNING: Potential overflow! Student's name may be truncated. Name's should be less than %d characters long.\n\n", NAME_LENGTH);
-            while ((c = getchar()) != '\n' && c != EOF);
         }
-        // Trim newline from student name
-        p->name[strlen(p->name) - 1] = '\0';
         
         printf("\tStudent Gender [1=Male, 2=Female, 3=Other]: ");
-        fgets(num_buffer, 2, stdin);
-        while ((c = getchar()) != '\n' && c != EOF); // There's at least one trailing \n
+        readInput(num_buffer, 2, NULL);
         
         // FIO20-C: Makes sure input isn't truncated
         // ERR33-C: Checking to see if a integer was parsed from the string (and if it's valid)
-        if (sscanf(num_buffer, "%d", &(p->gender)) != 1 || p->gender < 1 || p->gender > 3) 
+        if (sscanf(num_buffer, "%d", &(p->gender)) != 1 || !isValidGender(p->gender)) 
         {
             printf("\nERROR: Ivalid input. Input should be an integer (1-3).\nERROR: Add Students function failed. Please try again.\n");
-            *num = 0; // Number of students set to zero, making the data unreadable
+            resizeClass(cls, first); // The students of this batch are dropped, making them unreadable
             read_failed = 1;
             break;
         } 
 
         printf("\tStudent Age: ");
-        if ((len = strlen(fgets(num_buffer, 3, stdin))) == 2 && num_buffer[1] != '\n') 
+        readInput(num_buffer, 3, NULL);
+        // ERR33-C: Checking to see if a integer was parsed from the string (and if it's valid)
+        if (sscanf(num_buffer, "%d", &(p->age)) != 1 || !isValidAge(p->age)) 
+        {
+            printf("\nERROR: Ivalid input. Input should have be a positive integer (1-99).\nERROR: Add Students function failed. Please try again.\n");
+            resizeClass(cls, first); // The students of this batch are dropped, making them unreadable
+            read_failed = 1;
+            break;
+        } 
+
+        if (setStudent(cls, kept, p) != 0 || (policy != DUP_ALLOW && (dup = checkDuplicate(cls, &seen, kept)) == -2))
+        {
+            printf("\nERROR: Out of memory.\nERROR: Add Students function failed. Please try again.\n");
+            resizeClass(cls, first);
+            read_failed = 1;
+            break;
+        }
+        if (policy != DUP_ALLOW && dup >= 0)
+        {
+            printf("\nWARNING: Student %d has the same name, gender and age.\n", dup + 1);
+            if (policy == DUP_DROP)
+            {
+                printf("Duplicate student dropped. %d students left to add.\n", *num - i - 1);
+                continue;
+            }
+        }
+        indexInsert(cls, kept);
+        markDirty(cls, kept);
+        kept++;
+        printf("\nStudent added! %d students left to add.\n", *num - i - 1);
+    }
+    freeDuplicates(&seen);
+    if (read_failed != 1) {
+        resizeClass(cls, kept); // Only shrinks, by the duplicates dropped
+        printf("All students have been added.\n");
+    }
+}
+
+/**
+ * @brief Adds students to the end of an existing class
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void addMoreStudents(classroom *cls)
+{
+    char num_buffer[10];
+    int count;
+    int first;
+
+    if (cls == NULL)
+    {
+        printf("\nERROR: No class selected. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "Add Students") != 0)
+    {
+        return;
+    }
+    printf("\nEnter the number of students to add: ");
+    // STR32-C: fgets ensures only as many as a 9-digit number can be entered into the array of size 10
+    readInput(num_buffer, 10, NULL);
+    if (sscanf(num_buffer, "%d", &count) != 1 || count < 1 || count > MAX_STUDENTS - cls->num)
+    {
+        printf("\nERROR: Invalid input. Input must be an integer in range (1-%d).\nERROR: Add Students function failed. Please try again.\n", MAX_STUDENTS - cls->num);
+        return;
+    }
+    first = cls->num;
+    if (checkpoint(cls, "Add More Students") != 0)
+    {
+        printf("\nWARNING: Out of memory. This change cannot be undone.\n");
+    }
+    // MEM35-C: Room for the new students is reserved (amortised O(1) per student) before they are entered
+    if (resizeClass(cls, first + count) != 0)
+    {
+        resizeClass(cls, first);
+        printf("\nERROR: Out of memory.\nERROR: Add Students function failed. Please try again.\n");
+        return;
+    }
+    addStudents(cls, first);
+    audit("add", cls, "added=%d students=%d", cls->num - first, cls->num);
+}
+
+/**
+ * @brief Removes a student with a given name from a class, found through the name index
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void removeStudent(classroom *cls)
+{
+    char name[NAME_LENGTH];
+    int first;
+
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nERROR: No student data to remove. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "Remove Student") != 0)
+    {
+        return;
+    }
+    printf("\n\tStudent Name: ");
+    readInput(name, NAME_LENGTH, NULL);
+    if (buildIndexes(cls) != 0)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Remove Student function failed. Please try again.\n");
+        return;
+    }
+    if (findByName(cls, name, 0, &first) > 0)
+    {
+        if (checkpoint(cls, "Remove Student") != 0)
+        {
+            printf("\nWARNING: Out of memory. This change cannot be undone.\n");
+        }
+        if (deleteStudentAt(cls, cls->name_order[first]) != 0)
+        {
+            printf("\nERROR: Out of memory.\nERROR: Remove Student function failed. Please try again.\n");
+            return;
+        }
+        audit("remove", cls, "students=%d", cls->num);
+        printf("\nStudent removed. %d students left in the class.\n", cls->num);
+        return;
+    }
+    printf("\nERROR: No student named %s in the class.\nERROR: Remove Student function failed. Please try again.\n", name);
+}
+
+/**
+ * @brief Removes a student in O(1) by moving the last student into its place
+ *
+ * The order of the remaining students is not kept.
+ *
+ * @param cls The class
+ * @param index The position of the student to remove
+ * @return int 0 on success, -1 if memory ran out copying a chunk shared with a snapshot (nothing is removed)
+ */
+int deleteStudentAt(classroom *cls, int index)
+{
+    int last = cls->num - 1;
+
+    if (index != last && writableChunk(cls, index >> CHUNK_SHIFT) == NULL)
+    {
+        return -1;
+    }
+    indexRemove(cls, last);
+    if (index != last)
+    {
+        student_chunk *from = cls->chunks[last >> CHUNK_SHIFT];
+        student_chunk *to = cls->chunks[index >> CHUNK_SHIFT];
+        int i = last & (CHUNK_STUDENTS - 1);
+        int j = index & (CHUNK_STUDENTS - 1);
+
+        // The moved student keeps its interned name, so only the columns are copied
+        indexRemove(cls, index);
+        to->names[j] = from->names[i];
+        to->ages[j] = from->ages[i];
+        to->genders[j] = from->genders[i];
+        indexInsert(cls, index);
+        markDirty(cls, index);
+    }
+    cls->num = last;
+    return 0;
+}
+
+/**
+ * @brief Reports the students of a class who repeat an earlier student's name, gender and age, and offers to remove them
+ *
+ * One pass over the class through a duplicate table finds them all, so the report takes linear time.
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void findDuplicateStudents(classroom *cls)
+{
+    char answer[3];
+    dup_table seen = {0};
+    int *original;
+    int duplicates = 0;
+    int groups = 0;
+    int failed = 0;
+    student s;
+
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nERROR: No student data to check. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "Find Duplicate Students") != 0)
+    {
+        return;
+    }
+    // MEM35-C: One int per student: the earlier student it repeats, or -1
+    original = malloc(cls->num * sizeof(int));
+    failed = original == NULL || initDuplicates(&seen, cls->num) != 0;
+    for (int i = 0; i < cls->num && !failed; i++)
+    {
+        failed = (original[i] = checkDuplicate(cls, &seen, i)) == -2;
+    }
+    freeDuplicates(&seen);
+    if (failed)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Find Duplicate Students function failed. Please try again.\n");
+        free(original);
+        return;
+    }
+
+    for (int i = 0; i < cls->num; i++)
+    {
+        if (original[i] < 0)
+        {
+            continue;
+        }
+        getStudent(cls, i, &s);
+        printf("Student %d, %s (%s, %d), repeats student %d.\n", i + 1, s.name, gender_labels[s.gender], s.age, original[i] + 1);
+        duplicates++;
+        // A student repeated for the first time starts a group
+        groups += original[original[i]] == -1;
+        original[original[i]] = -2;
+    }
+    if (duplicates == 0)
+    {
+        printf("\nNo duplicate students in the class.\n");
+        free(original);
+        return;
+    }
+    printf("\n%d duplicate students in %d groups. Without them the class would have %d students.\n", duplicates, groups, cls->num - duplicates);
+    printf("Remove the duplicates, keeping the first of each? [y/n]: ");
+    if (readInput(answer, sizeof(answer), NULL) >= 0 && (answer[0] == 'y' || answer[0] == 'Y'))
+    {
+        if (checkpoint(cls, "Remove Duplicates") != 0)
+        {
+            printf("\nWARNING: Out of memory. This change cannot be undone.\n");
+        }
+        // MEM35-C: One byte per student, set for the repeated ones
+        unsigned char *marked = malloc(cls->num);
+        for (int i = 0; i < cls->num && marked != NULL; i++)
+        {
+            marked[i] = original[i] >= 0;
+        }
+        if (marked == NULL || removeMarked(cls, marked) != 0)
+        {
+            free(marked);
+            printf("\nERROR: Out of memory.\nERROR: Find Duplicate Students function failed. Please try again.\n");
+            free(original);
+            return;
+        }
+        free(marked);
+        audit("dedup", cls, "removed=%d students=%d", duplicates, cls->num);
+        printf("\n%d duplicate students removed. %d students left in the class.\n", duplicates, cls->num);
+    }
+    free(original);
+}
+
+/**
+ * @brief Removes the marked students of a class, keeping the others in roster order
+ *
+ * The students are compacted in one pass, so the search indexes are dropped rather than kept up to date.
+ * Every chunk the pass writes is made writable first, so running out of memory leaves the class as it was.
+ *
+ * @param cls The class
+ * @param marked One byte per student, nonzero for the students to remove
+ * @return int 0 on success, -1 if memory ran out
+ */
+int removeMarked(classroom *cls, const unsigned char *marked)
+{
+    int kept = 0;
+    int first = 0;
+
+    while (first < cls->num && !marked[first])
+    {
+        first++;
+    }
+    for (int c = first >> CHUNK_SHIFT; c < cls->chunk_count && (c << CHUNK_SHIFT) < cls->num; c++)
+    {
+        if (writableChunk(cls, c) == NULL)
+        {
+            return -1;
+        }
+    }
+    dropIndexes(cls); // Rebuilt by the next search
+    for (int i = 0; i < cls->num; i++)
+    {
+        if (marked[i])
+        {
+            continue;
+        }
+        if (kept != i)
+        {
+            student_chunk *from = cls->chunks[i >> CHUNK_SHIFT];
+            student_chunk *to = cls->chunks[kept >> CHUNK_SHIFT];
+            int a = i & (CHUNK_STUDENTS - 1);
+            int b = kept & (CHUNK_STUDENTS - 1);
+
+            // The moved student keeps its interned name, so only the columns are copied
+            to->names[b] = from->names[a];
+            to->ages[b] = from->ages[a];
+            to->genders[b] = from->genders[a];
+            markDirty(cls, kept);
+        }
+        kept++;
+    }
+    resizeClass(cls, kept); // Only shrinks
+    return 0;
+}
+
+/**
+ * @brief Takes a labelled snapshot of the current class, which Undo goes back to and View Snapshot shows
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void takeSnapshot(classroom *cls)
+{
+    char label[SNAPSHOT_LABEL];
+    int truncated = 0;
+
+    if (cls == NULL)
+    {
+        printf("\nERROR: No class selected. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "Take Snapshot") != 0)
+    {
+        return;
+    }
+    printf("\nEnter a label for the snapshot: ");
+    if (readInput(label, SNAPSHOT_LABEL, &truncated) < 0 || label[0] == '\0')
+    {
+        snprintf(label, sizeof(label), "Snapshot %d", cls->undo_count + 1);
+    }
+    if (checkpoint(cls, label) != 0)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Take Snapshot function failed. Please try again.\n");
+        return;
+    }
+    audit("snapshot", cls, "students=%d", cls->num);
+    printf("\nSnapshot '%s' of %d students taken.\n", label, cls->num);
+}
+
+/**
+ * @brief Takes the current class back to its newest snapshot, which Redo can undo
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void undoChange(classroom *cls)
+{
+    class_snapshot *snap;
+
+    if (cls == NULL || cls->undo_count == 0)
+    {
+        printf("\nERROR: Nothing to undo.\nERROR: Undo function failed. Please try again.\n");
+        return;
+    }
+    snap = &cls->undo[cls->undo_count - 1];
+    // MEM35-C: Room for MAX_SNAPSHOTS redo steps; Undo and Redo only move snapshots between the two arrays
+    if ((cls->redo == NULL && (cls->redo = malloc(MAX_SNAPSHOTS * sizeof(class_snapshot))) == NULL)
+        || captureSnapshot(cls, &cls->redo[cls->redo_count], snap->label) != 0)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Undo function failed. Please try again.\n");
+        return;
+    }
+    cls->redo_count++;
+    restoreSnapshot(cls, snap);
+    free(snap->chunks);
+    cls->undo_count--;
+    audit("undo", cls, "students=%d", cls->num);
+    printf("\nUndid '%s'. The class has %d students.\n", cls->redo[cls->redo_count - 1].label, cls->num);
+}
+
+/**
+ * @brief Takes the current class forward again to the state the last Undo left
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void redoChange(classroom *cls)
+{
+    class_snapshot *snap;
+
+    if (cls == NULL || cls->redo_count == 0)
+    {
+        printf("\nERROR: Nothing to redo.\nERROR: Redo function failed. Please try again.\n");
+        return;
+    }
+    snap = &cls->redo[cls->redo_count - 1];
+    // A redo step exists only after an Undo, which has allocated the undo array and freed a place in it
+    if (captureSnapshot(cls, &cls->undo[cls->undo_count], snap->label) != 0)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Redo function failed. Please try again.\n");
+        return;
+    }
+    cls->undo_count++;
+    restoreSnapshot(cls, snap);
+    free(snap->chunks);
+    cls->redo_count--;
+    audit("redo", cls, "students=%d", cls->num);
+    printf("\nRedid '%s'. The class has %d students.\n", cls->undo[cls->undo_count - 1].label, cls->num);
+}
+
+/**
+ * @brief Shows one of the current class's snapshots: its student list, or what has changed since it was taken
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void viewSnapshot(classroom *cls)
+{
+    char num_buffer[4];
+    int choice = 0;
+    int view = 0;
+    const class_snapshot *snap;
+
+    if (cls == NULL || cls->undo_count == 0)
+    {
+        printf("\nERROR: No snapshots of this class. Take Snapshot takes one, and so does each change to a class.\n");
+        return;
+    }
+    printf("\n");
+    for (int k = 0; k < cls->undo_count; k++)
+    {
+        printf("\t%d) %s (%d students)\n", k + 1, cls->undo[k].label, cls->undo[k].num);
+    }
+    printf("Enter Snapshot: ");
+    // ERR33-C: A failed conversion leaves choice at 0, which is rejected below
+    if (readInput(num_buffer, sizeof(num_buffer), NULL) < 0 || sscanf(num_buffer, "%d", &choice) != 1
+        || choice < 1 || choice > cls->undo_count)
+    {
+        printf("\nERROR: Invalid input. Input should be an integer (1-%d).\nERROR: View Snapshot function failed. Please try again.\n", cls->undo_count);
+        return;
+    }
+    snap = &cls->undo[choice - 1];
+    printf("\t1) Student List\n\t2) Changes Since\nEnter Option: ");
+    if (readInput(num_buffer, sizeof(num_buffer), NULL) < 0 || sscanf(num_buffer, "%d", &view) != 1 || view < 1 || view > 2)
+    {
+        printf("\nERROR: Invalid input. Input should be an integer (1-2).\nERROR: View Snapshot function failed. Please try again.\n");
+        return;
+    }
+    if (view == 2)
+    {
+        diffSnapshot(cls, snap);
+        return;
+    }
+
+    // The snapshot is listed through a class that borrows its chunk table and the class's name pool
+    classroom past;
+    memset(&past, 0, sizeof(past));
+    past.chunks = snap->chunks;
+    past.chunk_count = snap->chunk_count;
+    past.num = snap->num;
+    past.names = cls->names;
+    // FIO23-C: Anything printf has buffered is flushed first so the list appears in order
+    fflush(stdout);
+    if (writeStudentList(STDOUT_FILENO, &past, NULL, 0, past.num) != 0)
+    {
+        printf("\nERROR: Write Failed!\nERROR: View Snapshot function failed. Please try again.\n");
+    }
+}
+
+/**
+ * @brief Lists the students of a class that differ from a snapshot of it, position by position
+ *
+ * A chunk the class still shares with the snapshot has not been written since, so it is skipped without
+ * looking at its students; the time taken grows with the changes rather than the class.
+ *
+ * @param cls The class
+ * @param snap The snapshot, taken of cls
+ */
+void diffSnapshot(const classroom *cls, const class_snapshot *snap)
+{
+    int common = cls->num < snap->num ? cls->num : snap->num;
+    int changed = 0;
+    student was;
+    student now;
+
+    for (int c = 0; (c << CHUNK_SHIFT) < common; c++)
+    {
+        const student_chunk *old = snap->chunks[c];
+        const student_chunk *cur = cls->chunks[c];
+        int end = (c + 1) << CHUNK_SHIFT;
+
+        if (old == cur)
+        {
+            continue;
+        }
+        for (int i = c << CHUNK_SHIFT; i < common && i < end; i++)
+        {
+            int j = i & (CHUNK_STUDENTS - 1);
+            if (old->ages[j] == cur->ages[j] && old->genders[j] == cur->genders[j]
+                && (old->names[j] == cur->names[j]
+                    || strcmp(cls->names.base + old->names[j], cls->names.base + cur->names[j]) == 0))
+            {
+                continue;
+            }
+            getStudent(cls, i, &now);
+            printf("Student %d: was %s (%s, %d), is %s (%s, %d).\n", i + 1, cls->names.base + old->names[j],
+                   gender_labels[old->genders[j]], old->ages[j], now.name, gender_labels[now.gender], now.age);
+            changed++;
+        }
+    }
+    for (int i = common; i < snap->num; i++)
+    {
+        const student_chunk *old = snap->chunks[i >> CHUNK_SHIFT];
+        int j = i & (CHUNK_STUDENTS - 1);
+        memset(was.name, 0, NAME_LENGTH);
+        strncpy(was.name, cls->names.base + old->names[j], NAME_LENGTH - 1);
+        printf("Student %d: was %s (%s, %d), since removed.\n", i + 1, was.name, gender_labels[old->genders[j]], old->ages[j]);
+    }
+    for (int i = common; i < cls->num; i++)
+    {
+        getStudent(cls, i, &now);
+        printf("Student %d: added, %s (%s, %d).\n", i + 1, now.name, gender_labels[now.gender], now.age);
+    }
+    printf("\n%d students changed, %d added and %d removed since '%s'.\n", changed,
+           cls->num - common, snap->num - common, snap->label);
+}
+
+/**
+ * @brief Takes a snapshot of a class onto its undo steps before a change, which ends any redo steps
+ *
+ * When MAX_SNAPSHOTS undo steps are kept, the oldest is dropped.
+ *
+ * @param cls The class, whose students must be in memory
+ * @param label What the snapshot is taken before, or the operator's label for it
+ * @return int 0 on success, -1 if memory ran out (no snapshot is taken)
+ */
+int checkpoint(classroom *cls, const char *label)
+{
+    // MEM35-C: Room for MAX_SNAPSHOTS undo steps, allocated with the first one
+    if (cls->undo == NULL && (cls->undo = malloc(MAX_SNAPSHOTS * sizeof(class_snapshot))) == NULL)
+    {
+        return -1;
+    }
+    if (cls->undo_count == MAX_SNAPSHOTS)
+    {
+        free(cls->undo[0].chunks);
+        memmove(cls->undo, cls->undo + 1, (MAX_SNAPSHOTS - 1) * sizeof(class_snapshot));
+        cls->undo_count--;
+    }
+    if (captureSnapshot(cls, &cls->undo[cls->undo_count], label) != 0)
+    {
+        return -1;
+    }
+    cls->undo_count++;
+    while (cls->redo_count > 0)
+    {
+        free(cls->redo[--cls->redo_count].chunks);
+    }
+    return 0;
+}
+
+/**
+ * @brief Captures a class's students as a snapshot sharing its chunks, and starts a new generation
+ *
+ * Only the chunk table is copied, one pointer per CHUNK_STUDENTS students; the chunks themselves are copied
+ * later, one at a time, by the first write to each (see writableChunk).
+ *
+ * @param cls The class
+ * @param snap The snapshot to fill in
+ * @param label The snapshot's label, cut to fit
+ * @return int 0 on success, -1 if memory ran out
+ */
+int captureSnapshot(classroom *cls, class_snapshot *snap, const char *label)
+{
+    // MEM35-C: calloc puts every existing chunk in generation 0, which this first snapshot ends
+    if (cls->chunk_gens == NULL
+        && (cls->chunk_gens = calloc(cls->chunk_capacity > 0 ? cls->chunk_capacity : 1, sizeof(uint32_t))) == NULL)
+    {
+        return -1;
+    }
+    if ((snap->chunks = malloc((cls->chunk_count > 0 ? cls->chunk_count : 1) * sizeof(student_chunk *))) == NULL)
+    {
+        return -1;
+    }
+    if (cls->chunk_count > 0)
+    {
+        memcpy(snap->chunks, cls->chunks, cls->chunk_count * sizeof(student_chunk *));
+    }
+    snap->chunk_count = cls->chunk_count;
+    snap->num = cls->num;
+    snprintf(snap->label, sizeof(snap->label), "%s", label);
+    cls->generation++;
+    return 0;
+}
+
+/**
+ * @brief Puts a class's students back as they were in a snapshot
+ *
+ * The class shares every chunk with the snapshot afterwards. The search indexes are dropped, and since the
+ * journal cannot describe the change, the next save writes a full snapshot.
+ *
+ * @param cls The class
+ * @param snap The snapshot, taken of cls; its chunk table still belongs to the caller
+ */
+void restoreSnapshot(classroom *cls, const class_snapshot *snap)
+{
+    // The chunk table never shrinks, so it still has room for every chunk it held when the snapshot was taken
+    memcpy(cls->chunks, snap->chunks, snap->chunk_count * sizeof(student_chunk *));
+    cls->chunk_count = snap->chunk_count;
+    cls->num = snap->num;
+    cls->generation++;
+    dropIndexes(cls);
+    cls->dirty_count = 0;
+    cls->file_id = 0;
+}
+
+/**
+ * @brief Frees a class's snapshots; the chunks they shared live in the class's arena
+ *
+ * @param cls The class, left with no snapshots and every chunk writable
+ */
+void freeSnapshots(classroom *cls)
+{
+    for (int k = 0; k < cls->undo_count; k++)
+    {
+        free(cls->undo[k].chunks);
+    }
+    for (int k = 0; k < cls->redo_count; k++)
+    {
+        free(cls->redo[k].chunks);
+    }
+    free(cls->undo);
+    free(cls->redo);
+    free(cls->chunk_gens);
+    // MEM01-C: The dangling pointers are cleared once their memory is released
+    cls->undo = NULL;
+    cls->redo = NULL;
+    cls->chunk_gens = NULL;
+    cls->undo_count = 0;
+    cls->redo_count = 0;
+    cls->generation = 0;
+}
+
+/**
+ * @brief Checks a gender code against the values accepted by addStudents
+ *
+ * @param gender The gender code (1=Male, 2=Female, 3=Other)
+ * @return int 1 if the code is valid, 0 otherwise
+ */
+int isValidGender(int gender)
+{
+    return gender >= 1 && gender <= 3;
+}
+
+/**
+ * @brief Checks an age against the values accepted by addStudents
+ *
+ * @param age The student's age
+ * @return int 1 if the age is valid, 0 otherwise
+ */
+int isValidAge(int age)
+{
+    return age >= 0 && age <= MAX_AGE;
+}
+
+/**
+ * @brief Parses one name/gender/age roster record, separated by commas or tabs
+ *
+ * The name may be wrapped in double quotes so that it can contain the separator ("Doe, Jane",2,20).
+ *
+ * @param line The NUL-terminated record without its line ending (modified in place)
+ * @param s The student to fill in
+ * @return const char* NULL if the record is valid, otherwise the reason it was rejected
+ */
+const char *parseStudentRecord(char *line, student *s)
+{
+    char delim = strchr(line, '\t') != NULL ? '\t' : ',';
+    char *name = line;
+    char *name_end;
+    char *field;
+    char *end;
+    long value;
+
+    if (*name == '"')
+    {
+        name++;
+        if ((name_end = strchr(name, '"')) == NULL)
+        {
+            return "unterminated quoted name";
+        }
+        field = name_end + 1;
+        if (*field != delim)
+        {
+            return "expected separator after quoted name";
+        }
+    }
+    else
+    {
+        if ((field = strchr(name, delim)) == NULL)
+        {
+            return "expected three fields (name, gender, age)";
+        }
+        name_end = field;
+    }
+    *name_end = '\0';
+    field++;
+
+    if (name_end == name)
+    {
+        return "empty name";
+    }
+    // STR31-C: Names that would not fit in the student record are rejected instead of silently truncated
+    if (name_end - name > NAME_LENGTH - 1)
+    {
+        return "name is too long";
+    }
+
+    // ERR34-C: strtol is used instead of atoi so that conversion errors can be detected
+    // INT31-C: The long is range checked before it is narrowed, so 4294967297 cannot pass as gender 1
+    value = strtol(field, &end, 10);
+    if (end == field || *end != delim || value < INT_MIN || value > INT_MAX || !isValidGender((int)value))
+    {
+        return "gender should be an integer (1-3)";
+    }
+    s->gender = (int)value;
+
+    field = end + 1;
+    value = strtol(field, &end, 10);
+    if (end == field || *end != '\0' || value < INT_MIN || value > INT_MAX || !isValidAge((int)value))
+    {
+        return "age should be an integer (0-99)";
+    }
+    s->age = (int)value;
+
+    memset(s->name, 0, NAME_LENGTH * sizeof(char));
+    memcpy(s->name, name, name_end - name);
+    return NULL;
+}
+
+/**
+ * @brief Fills a class with every valid record of a CSV or TSV roster file in a single pass
+ *
+ * The file is read in IMPORT_BUFFER_SIZE blocks rather than character by character. Invalid lines are
+ * reported and skipped, an optional "name,gender,age" header line is ignored. Records that repeat an earlier
+ * student are reported, and skipped too if duplicate_policy is DUP_DROP.
+ *
+ * @param path The roster file to import
+ * @param cls The class to fill, with no students allocated yet
+ * @return int 0 on success, -1 if the file could not be read
+ */
+int importStudents(const char *path, classroom *cls)
+{
+    char code[CLASS_CODE_BUFFER];
+    FILE *fp = fopen(path, "r");
+    char *buffer;
+    size_t filled = 0;   // Bytes currently held in buffer
+    size_t got;
+    int count = 0;
+    int rejected = 0;
+    long line_no = 0;
+    int skipping = 0;    // Set while discarding the rest of an over-long line
+    int eof = 0;
+    int duplicates = 0;
+    dup_table seen = {0};
+    student parsed;
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "ERROR: Could not open roster file '%s'.\n", path);
+        return -1;
+    }
+
+    // MEM35-C: Sufficient memory is allocated for the read buffer (plus a terminator)
+    buffer = malloc(IMPORT_BUFFER_SIZE + 1);
+    if (buffer == NULL || (duplicate_policy != DUP_ALLOW && initDuplicates(&seen, 0) != 0))
+    {
+        fprintf(stderr, "ERROR: Out of memory while importing '%s'.\n", path);
+        free(buffer);
+        fclose(fp);
+        return -1;
+    }
+
+    while (!eof)
+    {
+        uint64_t start = statsNow();
+        got = fread(buffer + filled, 1, IMPORT_BUFFER_SIZE - filled, fp);
+        statsAdd(STAT_IMPORT_READ, statsNow() - start, got);
+        filled += got;
+        eof = got == 0;
+
+        char *line = buffer;
+        char *end = buffer + filled;
+        char *nl;
+
+        while (line < end)
+        {
+            if ((nl = memchr(line, '\n', end - line)) == NULL)
+            {
+                if (!eof)
+                {
+                    break; // Partial line, wait for the rest of it
+                }
+                nl = end;  // Last line of the file has no line ending
+            }
+            *nl = '\0';
+            line_no++;
+            if (nl > line && nl[-1] == '\r')
+            {
+                nl[-1] = '\0';
+            }
+
+            if (skipping)
+            {
+                skipping = 0;
+            }
+            else if (*line != '\0')
+            {
+                // The class's chunks grow as records arrive, without moving earlier students
+                if (count == MAX_STUDENTS || reserveStudents(cls, count + 1) != 0)
+                {
+                    fprintf(stderr, "ERROR: No room after %d students, import stopped at line %ld.\n", count, line_no);
+                    eof = 1;
+                    break;
+                }
+
+                memset(&parsed, 0, sizeof(parsed));
+                const char *reason = parseStudentRecord(line, &parsed);
+                int dup = -1;
+                if (reason == NULL && (setStudent(cls, count, &parsed) != 0
+                                       || (duplicate_policy != DUP_ALLOW && (dup = checkDuplicate(cls, &seen, count)) == -2)))
+                {
+                    fprintf(stderr, "ERROR: Out of memory, import stopped at line %ld.\n", line_no);
+                    eof = 1;
+                    break;
+                }
+                else if (reason == NULL && dup >= 0)
+                {
+                    fprintf(stderr, "Line %ld %s: same name, gender and age as student %d.\n", line_no,
+                            duplicate_policy == DUP_DROP ? "dropped" : "is a duplicate", dup + 1);
+                    duplicates++;
+                    count += duplicate_policy != DUP_DROP;
+                }
+                else if (reason == NULL)
+                {
+                    count++;
+                }
+                else if (line_no == 1 && strncasecmp(line, "name", 4) == 0)
+                {
+                    // Header line
+                }
+                else
+                {
+                    fprintf(stderr, "Line %ld rejected: %s.\n", line_no, reason);
+                    rejected++;
+                }
+            }
+            line = nl + 1;
+        }
+
+        if (line >= end)
+        {
+            filled = 0;
+        }
+        else if (line > buffer)
+        {
+            // Move the partial line to the front so the next block can complete it
+            filled = end - line;
+            memmove(buffer, line, filled);
+        }
+        else if (filled == IMPORT_BUFFER_SIZE)
+        {
+            // A single line filled the whole buffer; it cannot be a valid record
+            if (!skipping)
+            {
+                fprintf(stderr, "Line %ld rejected: line is too long.\n", line_no + 1);
+                rejected++;
+                skipping = 1;
+            }
+            filled = 0;
+        }
+    }
+
+    if (ferror(fp))
+    {
+        fprintf(stderr, "ERROR: Read error in '%s', import stopped at line %ld.\n", path, line_no);
+    }
+    fclose(fp);
+    free(buffer);
+    freeDuplicates(&seen);
+
+    cls->num = count;
+    formatClassCode(cls, code);
+    printf("\nImported %d students into %s from %s (%d lines rejected", count, code, path, rejected);
+    if (duplicates > 0)
+    {
+        printf(", %d duplicates %s", duplicates, duplicate_policy == DUP_DROP ? "dropped" : "kept");
+    }
+    printf(").\n");
+    return 0;
+}
+
+/**
+ * @brief Outputs the details of the class.
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void viewClassDetails(classroom *cls) {
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nERROR: No class data to display. You may enter new, or load existing data.\n");
+    }
+    else
+    {
+        printf("\nCategory: %s\nCourse:   %s\nSection:  %s\n", cls->category, cls->course_num, cls->section_num);
+    }
+}
+
+/**
+ * @brief Outputs the current class data
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void viewClassList(classroom *cls)
+{
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nERROR: No student data to display. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "View Student List") != 0)
+    {
+        return;
+    }
+    // FIO23-C: Anything printf has buffered is flushed first so the list appears in order
+    fflush(stdout);
+    if (writeStudentList(STDOUT_FILENO, cls, NULL, 0, cls->num) != 0)
+    {
+        printf("\nERROR: Write Failed!\nERROR: View Student List function failed. Please try again.\n");
+    }
+}
+
+/**
+ * @brief Outputs one page of the current class data
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void viewClassListPage(classroom *cls)
+{
+    char num_buffer[10];
+    int size;
+    int page;
+    int pages;
+
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nERROR: No student data to display. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "View Student List Page") != 0)
+    {
+        return;
+    }
+    printf("\nEnter the number of students per page: ");
+    // STR32-C: fgets ensures only as many as a 9-digit number can be entered into the array of size 10
+    readInput(num_buffer, 10, NULL);
+    if (sscanf(num_buffer, "%d", &size) != 1 || size < 1)
+    {
+        printf("\nERROR: Invalid input. Input must be a positive integer.\nERROR: View Student List Page function failed. Please try again.\n");
+        return;
+    }
+    pages = cls->num / size + (cls->num % size != 0);
+    printf("Enter the page number (1-%d): ", pages);
+    readInput(num_buffer, 10, NULL);
+    if (sscanf(num_buffer, "%d", &page) != 1 || page < 1 || page > pages)
+    {
+        printf("\nERROR: Invalid input. Input must be an integer in range (1-%d).\nERROR: View Student List Page function failed. Please try again.\n", pages);
+        return;
+    }
+
+    // INT32-C: page is at most pages, so the first student of the page is below num and cannot overflow
+    int first = (page - 1) * size;
+    int count = cls->num - first < size ? cls->num - first : size;
+    printf("\nPage %d of %d (students %d-%d of %d)\n", page, pages, first + 1, first + count, cls->num);
+    fflush(stdout);
+    if (writeStudentList(STDOUT_FILENO, cls, NULL, first, count) != 0)
+    {
+        printf("\nERROR: Write Failed!\nERROR: View Student List Page function failed. Please try again.\n");
+    }
+}
+
+/**
+ * @brief Writes the current class data straight to a file of the user's choosing
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void writeClassListFile(classroom *cls)
+{
+    char path[PATH_BUFFER];
+    int truncated = 0;
+    int failed;
+    int fd;
+
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nERROR: No student data to write. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "Write Student List") != 0)
+    {
+        return;
+    }
+    printf("\nEnter the file to write the student list to: ");
+    if (readInput(path, PATH_BUFFER, &truncated) < 0 || truncated || path[0] == '\0')
+    {
+        printf("\nERROR: Invalid input. Input must be a file name of fewer than %d characters.\nERROR: Write Student List function failed. Please try again.\n", PATH_BUFFER);
+        return;
+    }
+
+    // FIO24-C: file opened only once
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        printf("\nERROR: Could not open '%s'.\nERROR: Write Student List function failed. Please try again.\n", path);
+        return;
+    }
+    failed = writeStudentList(fd, cls, NULL, 0, cls->num) != 0;
+    failed |= close(fd) != 0;
+    if (failed)
+    {
+        printf("\nERROR: Write Failed!\nERROR: Write Student List function failed. Please try again.\n");
+        return;
+    }
+    printf("\nStudent list of %d students written to %s.\n", cls->num, path);
+}
+
+/**
+ * @brief Outputs the current class data sorted by name, by age, or by gender and then name, to the screen or a file
+ *
+ * The orders come from the search indexes (see buildIndexes), and gender order from a counting sort of the
+ * name order, so only a permutation of positions is sorted and the students stay where they are.
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void viewSortedClassList(classroom *cls)
+{
+    char num_buffer[3];
+    char path[PATH_BUFFER];
+    int truncated = 0;
+    int key = 0;
+    int *by_gender = NULL;
+    const int *order;
+    int failed;
+    int fd = STDOUT_FILENO;
+
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nERROR: No student data to display. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "View Sorted Student List") != 0)
+    {
+        return;
+    }
+    printf("\nSort by (1 = Name, 2 = Age, 3 = Gender then Name): ");
+    // ERR33-C: A failed conversion leaves key at 0, which is rejected below
+    if (readInput(num_buffer, sizeof(num_buffer), NULL) < 0 || sscanf(num_buffer, "%d", &key) != 1 || key < 1 || key > 3)
+    {
+        printf("\nERROR: Invalid input. Input should be an integer (1-3).\nERROR: View Sorted Student List function failed. Please try again.\n");
+        return;
+    }
+    printf("\nEnter the file to write the sorted list to (leave blank for the screen): ");
+    if (readInput(path, PATH_BUFFER, &truncated) < 0 || truncated)
+    {
+        printf("\nERROR: Invalid input. Input must be a file name of fewer than %d characters.\nERROR: View Sorted Student List function failed. Please try again.\n", PATH_BUFFER);
+        return;
+    }
+
+    // MEM35-C: Gender order needs one int per student besides the indexes
+    if (buildIndexes(cls) != 0 || (key == 3 && (by_gender = malloc(cls->num * sizeof(int))) == NULL))
+    {
+        printf("\nERROR: Out of memory.\nERROR: View Sorted Student List function failed. Please try again.\n");
+        return;
+    }
+    if (key == 3)
+    {
+        sortByGender(cls, cls->name_order, by_gender);
+    }
+    order = key == 1 ? cls->name_order : key == 2 ? cls->age_order : by_gender;
+
+    // FIO24-C: file opened only once
+    if (path[0] != '\0' && (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        printf("\nERROR: Could not open '%s'.\nERROR: View Sorted Student List function failed. Please try again.\n", path);
+        free(by_gender);
+        return;
+    }
+    // FIO23-C: Anything printf has buffered is flushed first so the list appears in order
+    fflush(stdout);
+    failed = writeStudentList(fd, cls, order, 0, cls->num) != 0;
+    failed |= fd != STDOUT_FILENO && close(fd) != 0;
+    free(by_gender);
+    if (failed)
+    {
+        printf("\nERROR: Write Failed!\nERROR: View Sorted Student List function failed. Please try again.\n");
+        return;
+    }
+    if (fd != STDOUT_FILENO)
+    {
+        printf("\nSorted student list of %d students written to %s.\n", cls->num, path);
+    }
+}
+
+/**
+ * @brief Lists, writes to a file, prices or removes the students of the current class that pass a filter
+ *
+ * The filter is an expression over age, gender and name, such as age >= 21 && gender == 2 (see
+ * compileFilter); it is compiled once and then run over the class in a single scan.
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void filterStudents(classroom *cls)
+{
+    char text[FILTER_TEXT];
+    char num_buffer[3];
+    char path[PATH_BUFFER];
+    student_filter *filter;
+    const char *error = NULL;
+    int truncated = 0;
+    int action = 0;
+    int position;
+    int *matches;
+    int count;
+
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nERROR: No student data to filter. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "Filter Students") != 0)
+    {
+        return;
+    }
+    printf("\nEnter a filter over age, gender and name (e.g. age >= 21 && gender == 2 || name == \"Ann Lee\"): ");
+    if (readInput(text, FILTER_TEXT, &truncated) < 0 || truncated)
+    {
+        printf("\nERROR: Invalid input. A filter must be fewer than %d characters.\nERROR: Filter Students function failed. Please try again.\n", FILTER_TEXT);
+        return;
+    }
+    // MEM35-C: The compiled filter holds FILTER_NAMES names, too much for the stack; matches hold one int per student
+    filter = malloc(sizeof(student_filter));
+    matches = malloc(cls->num * sizeof(int));
+    if (filter == NULL || matches == NULL)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Filter Students function failed. Please try again.\n");
+        free(filter);
+        free(matches);
+        return;
+    }
+    if ((position = compileFilter(text, filter, &error)) != 0)
+    {
+        printf("\nERROR: Invalid filter at character %d: %s.\nERROR: Filter Students function failed. Please try again.\n", position, error);
+        free(filter);
+        free(matches);
+        return;
+    }
+    count = filterClass(filter, cls, matches);
+    free(filter);
+    printf("\n%d of %d students pass the filter.\n\t1) List\n\t2) Write to File\n\t3) Calculate Cost\n\t4) Remove\nEnter Option: ", count, cls->num);
+    // ERR33-C: A failed conversion leaves action at 0, which is rejected below
+    if (readInput(num_buffer, sizeof(num_buffer), NULL) < 0 || sscanf(num_buffer, "%d", &action) != 1 || action < 1 || action > 4)
+    {
+        printf("\nERROR: Invalid input. Input should be an integer (1-4).\nERROR: Filter Students function failed. Please try again.\n");
+        free(matches);
+        return;
+    }
+
+    if (action == 1)
+    {
+        // FIO23-C: Anything printf has buffered is flushed first so the list appears in order
+        fflush(stdout);
+        if (writeStudentList(STDOUT_FILENO, cls, matches, 0, count) != 0)
+        {
+            printf("\nERROR: Write Failed!\nERROR: Filter Students function failed. Please try again.\n");
+        }
+    }
+    else if (action == 2)
+    {
+        int fd;
+        int failed;
+        printf("\nEnter the file to write the students to: ");
+        if (readInput(path, PATH_BUFFER, &truncated) < 0 || truncated || path[0] == '\0')
+        {
+            printf("\nERROR: Invalid input. Input must be a file name of fewer than %d characters.\nERROR: Filter Students function failed. Please try again.\n", PATH_BUFFER);
+        }
+        // FIO24-C: file opened only once
+        else if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        {
+            printf("\nERROR: Could not open '%s'.\nERROR: Filter Students function failed. Please try again.\n", path);
+        }
+        else
+        {
+            failed = writeStudentList(fd, cls, matches, 0, count) != 0;
+            failed |= close(fd) != 0;
+            if (failed)
+            {
+                printf("\nERROR: Write Failed!\nERROR: Filter Students function failed. Please try again.\n");
+            }
+            else
+            {
+                printf("\nStudent list of %d students written to %s.\n", count, path);
+            }
+        }
+    }
+    else if (action == 3)
+    {
+        pricing_table table = pricing;
+        money rates[RATE_SLOTS];
+        class_price price;
+        int currency;
+        if (readBaseRate("Filter Students", &currency, &table.base_rate) == 0)
+        {
+            buildRateTable(&table, rates);
+            // INT32-C: The price is computed in 64-bit money with every product and sum checked, so it is either exact or refused
+            if (priceStudents(cls, matches, count, rates, classTaxRate(&table, cls), &price) != 0)
+            {
+                printf("\nERROR: Resulting calculation with given input would exceed maximum value, smaller values must be used.\n");
+            }
+            else
+            {
+                printf("\n\tStudents priced: %d", count);
+                printCost(&table, &price, currency);
+            }
+        }
+    }
+    else if (count == 0)
+    {
+        // Nothing to remove, so no undo checkpoint is taken and nothing is audited
+        printf("\nNo students pass the filter. No students removed.\n");
+    }
+    else
+    {
+        // MEM35-C: One byte per student, set for the students that pass
+        unsigned char *marked = calloc(cls->num, 1);
+        if (marked != NULL && checkpoint(cls, "Remove Filtered") != 0)
+        {
+            printf("\nWARNING: Out of memory. This change cannot be undone.\n");
+        }
+        for (int k = 0; k < count && marked != NULL; k++)
+        {
+            marked[matches[k]] = 1;
+        }
+        if (marked == NULL || removeMarked(cls, marked) != 0)
+        {
+            printf("\nERROR: Out of memory.\nERROR: Filter Students function failed. Please try again.\n");
+        }
+        else
+        {
+            audit("remove", cls, "filter=%d students=%d", count, cls->num);
+            printf("\n%d students removed. %d students left in the class.\n", count, cls->num);
+        }
+        free(marked);
+    }
+    free(matches);
+}
+
+/**
+ * @brief Exports the selected class's students to a file as CSV or JSON lines, for other programs to read
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void exportStudents(classroom *cls)
+{
+    char num_buffer[3];
+    char path[PATH_BUFFER];
+    char code[CLASS_CODE_BUFFER];
+    export_stream out;
+    int truncated = 0;
+    int format = 0;
+    int failed;
+    int fd;
+
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nERROR: No student data to export. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "Export Students") != 0)
+    {
+        return;
+    }
+    printf("\nExport as:\n\t1) CSV\n\t2) JSON lines\nEnter Option: ");
+    // ERR33-C: A failed conversion leaves format at 0, which is rejected below
+    if (readInput(num_buffer, sizeof(num_buffer), NULL) < 0 || sscanf(num_buffer, "%d", &format) != 1 || format < 1 || format > 2)
+    {
+        printf("\nERROR: Invalid input. Input should be an integer (1-2).\nERROR: Export Students function failed. Please try again.\n");
+        return;
+    }
+    printf("\nEnter the file to export the students to: ");
+    if (readInput(path, PATH_BUFFER, &truncated) < 0 || truncated || path[0] == '\0')
+    {
+        printf("\nERROR: Invalid input. Input must be a file name of fewer than %d characters.\nERROR: Export Students function failed. Please try again.\n", PATH_BUFFER);
+        return;
+    }
+    // FIO24-C: file opened only once
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        printf("\nERROR: Could not open '%s'.\nERROR: Export Students function failed. Please try again.\n", path);
+        return;
+    }
+    if (beginExport(&out, fd, format == 1 ? EXPORT_CSV : EXPORT_JSON) != 0)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Export Students function failed. Please try again.\n");
+        close(fd);
+        return;
+    }
+    // The class stays in use, and its mapped pages may hold changes, so none of them are given back
+    exportClass(&out, cls, 0);
+    failed = endExport(&out) != 0;
+    failed |= close(fd) != 0;
+    if (failed)
+    {
+        printf("\nERROR: Write Failed!\nERROR: Export Students function failed. Please try again.\n");
+        return;
+    }
+    formatClassCode(cls, code);
+    audit("export", cls, "file=%s format=%s students=%d", path, format == 1 ? "csv" : "json", cls->num);
+    printf("\nClass %s of %d students exported to %s.\n", code, cls->num, path);
+}
+
+/**
+ * @brief Streams part of a class's student list to a file descriptor
+ *
+ * The list is formatted by hand into a LIST_BUFFER_SIZE buffer, which is written out whenever it fills, so a
+ * roster of any size takes a handful of write calls and no stdio formatting.
+ *
+ * @param fd The file descriptor to write to
+ * @param cls The class
+ * @param order The positions of the students in the order to list them, or NULL for roster order
+ * @param first The first entry of order (or the first student) to list
+ * @param count The number of students to list
+ * @return int 0 on success, -1 if a write failed
+ */
+int writeStudentList(int fd, const classroom *cls, const int *order, int first, int count)
+{
+    char *buffer = malloc(LIST_BUFFER_SIZE);
+    char *out;
+    int failed = 0;
+
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+    out = buffer;
+    for (int k = first; k < first + count && !failed; k++)
+    {
+        if (out - buffer > LIST_BUFFER_SIZE - LIST_ENTRY_MAX)
+        {
+            failed = writeAll(fd, buffer, out - buffer, STAT_LIST_WRITE) != 0;
+            out = buffer;
+        }
+        out = formatStudent(out, cls, order != NULL ? order[k] : k);
+    }
+    if (!failed && out > buffer)
+    {
+        failed = writeAll(fd, buffer, out - buffer, STAT_LIST_WRITE) != 0;
+    }
+    free(buffer);
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Formats one student's entry of a student list by hand
+ *
+ * @param out Where to put the entry, with room for LIST_ENTRY_MAX bytes
+ * @param cls The class
+ * @param i The student's position in the class
+ * @return char* The end of the entry
+ */
+char *formatStudent(char *out, const classroom *cls, int i)
+{
+    const student_chunk *chunk = cls->chunks[i >> CHUNK_SHIFT];
+    int j = i & (CHUNK_STUDENTS - 1);
+    const char *name = cls->names.base + chunk->names[j];
+    int gender = chunk->genders[j];
+    const char *label = gender_labels[gender >= 1 && gender <= 3 ? gender : 0];
+    // STR31-C: At most NAME_LENGTH - 1 characters of a name are copied, leaving room in LIST_ENTRY_MAX
+    size_t name_len = strnlen(name, NAME_LENGTH - 1);
+    size_t label_len = strlen(label);
+    unsigned int value = chunk->ages[j];
+    char digits[4];
+    int n = 0;
+
+    memcpy(out, "\nStudent Name:\t", 15);
+    out += 15;
+    memcpy(out, name, name_len);
+    out += name_len;
+    memcpy(out, "\n\tGender:\t", 10);
+    out += 10;
+    memcpy(out, label, label_len);
+    out += label_len;
+    memcpy(out, "\n\tAge:\t", 7);
+    out += 7;
+    do
+    {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (n > 0)
+    {
+        *out++ = digits[--n];
+    }
+    *out++ = '\n';
+    return out;
+}
+
+/**
+ * @brief Writes a whole buffer to a file descriptor, retrying short and interrupted writes
+ *
+ * @param fd The file descriptor
+ * @param buffer The bytes to write
+ * @param len The number of bytes
+ * @param stat The statistics counter the write is timed under (STAT_LIST_WRITE, STAT_EXPORT_WRITE, ...)
+ * @return int 0 on success, -1 if a write failed
+ */
+int writeAll(int fd, const char *buffer, size_t len, int stat)
+{
+    uint64_t start = statsNow();
+    size_t total = len;
+
+    while (len > 0)
+    {
+        ssize_t written = write(fd, buffer, len);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        buffer += written;
+        len -= (size_t)written;
+    }
+    statsAdd(stat, statsNow() - start, total);
+    return 0;
+}
+
+/**
+ * @brief Starts an export to a file descriptor, writing the CSV header row if the export is CSV
+ *
+ * @param out The export
+ * @param fd The file descriptor to write to
+ * @param format EXPORT_CSV or EXPORT_JSON
+ * @return int 0 on success, -1 if memory ran out
+ */
+int beginExport(export_stream *out, int fd, int format)
+{
+    memset(out, 0, sizeof(*out));
+    out->fd = fd;
+    out->format = format;
+    // MEM35-C: One buffer for the whole export, however many classes and students go through it
+    if ((out->buffer = malloc(EXPORT_BUFFER_SIZE)) == NULL)
+    {
+        return -1;
+    }
+    if (format == EXPORT_CSV)
+    {
+        memcpy(out->buffer, "class,name,gender,age\n", 22);
+        out->len = 22;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes out the records an export has formatted so far
+ *
+ * @param out The export; failed is set if the write fails
+ * @return int 0 on success, -1 if this or an earlier write failed
+ */
+int flushExport(export_stream *out)
+{
+    if (!out->failed && out->len > 0)
+    {
+        out->failed = writeAll(out->fd, out->buffer, out->len, STAT_EXPORT_WRITE) != 0;
+        out->written += out->len;
+    }
+    out->len = 0;
+    return out->failed ? -1 : 0;
+}
+
+/**
+ * @brief Appends a class's students to an export, one CSV row or JSON object per student in roster order
+ *
+ * Each CSV row holds the class code, name, gender code and age; each JSON line an object with the same fields.
+ * Records are formatted by hand into the export's buffer, which is written out whenever it fills. With
+ * release, the pages of a mapped class are handed back to the kernel behind the export, so a class of any
+ * size takes no more memory than a window of STREAM_CHUNKS chunks.
+ *
+ * @param out The export
+ * @param cls The class, with its students in place
+ * @param release Nonzero if the class's mapped pages may be dropped: only for a class that is about to be
+ *                released and has never been changed, since changes live in its private pages
+ * @return int 0 on success, -1 if a write failed
+ */
+int exportClass(export_stream *out, const classroom *cls, int release)
+{
+    char code[CLASS_CODE_BUFFER];
+    char prefix[6 * CLASS_CODE_BUFFER + 32];
+    size_t prefix_len;
+    const file_map *map = release ? cls->map : NULL;
+    int released = 0; // The chunks before this one have been handed back
+
+    formatClassCode(cls, code);
+    if (out->format == EXPORT_CSV)
+    {
+        prefix_len = escapeField(prefix, code, strlen(code), EXPORT_CSV);
+        prefix[prefix_len++] = ',';
+    }
+    else
+    {
+        memcpy(prefix, "{\"class\":\"", 10);
+        prefix_len = 10 + escapeField(prefix + 10, code, strlen(code), EXPORT_JSON);
+        memcpy(prefix + prefix_len, "\",\"name\":\"", 10);
+        prefix_len += 10;
+    }
+    if (map != NULL)
+    {
+        // Whatever checking the class left in memory is given back, and the file is read again in order
+        releasePages(map, map->addr, map->addr + map->len);
+        madvise(map->addr, map->len, MADV_SEQUENTIAL);
+    }
+
+    for (int i = 0; i < cls->num && !out->failed; i++)
+    {
+        const student_chunk *chunk = cls->chunks[i >> CHUNK_SHIFT];
+        int j = i & (CHUNK_STUDENTS - 1);
+        const char *name = cls->names.base + chunk->names[j];
+        // STR31-C: At most NAME_LENGTH - 1 characters of a name are copied, leaving room in EXPORT_ENTRY_MAX
+        size_t name_len = strnlen(name, NAME_LENGTH - 1);
+        unsigned int value = chunk->ages[j];
+        char digits[4];
+        int n = 0;
+        char *p;
+
+        if (j == 0 && map != NULL && (i >> CHUNK_SHIFT) - released >= STREAM_CHUNKS && (i >> CHUNK_SHIFT) <= cls->mapped_chunks)
+        {
+            int last = (i >> CHUNK_SHIFT) - 1;
+            releasePages(map, cls->chunks[released], cls->chunks[last] + 1);
+            // Names are mostly met in roster order, so few of the dropped name pages are read again
+            releasePages(map, cls->names.base, cls->names.base + cls->names.used);
+            released = last + 1;
+        }
+        if (out->len > EXPORT_BUFFER_SIZE - EXPORT_ENTRY_MAX && flushExport(out) != 0)
+        {
+            break;
+        }
+        p = out->buffer + out->len;
+        memcpy(p, prefix, prefix_len);
+        p += prefix_len;
+        p += escapeField(p, name, name_len, out->format);
+        if (out->format == EXPORT_CSV)
+        {
+            *p++ = ',';
+            *p++ = (char)('0' + chunk->genders[j]);
+            *p++ = ',';
+        }
+        else
+        {
+            memcpy(p, "\",\"gender\":", 11);
+            p += 11;
+            *p++ = (char)('0' + chunk->genders[j]);
+            memcpy(p, ",\"age\":", 7);
+            p += 7;
+        }
+        do
+        {
+            digits[n++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (n > 0)
+        {
+            *p++ = digits[--n];
+        }
+        if (out->format == EXPORT_JSON)
+        {
+            *p++ = '}';
+        }
+        *p++ = '\n';
+        out->len = (size_t)(p - out->buffer);
+        out->students++;
+    }
+    return out->failed ? -1 : 0;
+}
+
+/**
+ * @brief Writes out what is left of an export and frees its buffer
+ *
+ * @param out The export
+ * @return int 0 on success, -1 if any write failed or the export never started
+ */
+int endExport(export_stream *out)
+{
+    int failed = out->buffer == NULL || flushExport(out) != 0;
+
+    free(out->buffer);
+    out->buffer = NULL;
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Copies text into an export as one field, quoted or escaped as the export's format requires
+ *
+ * A CSV field is put in quotes only when it holds a comma, quote, CR or LF, and its quotes are doubled
+ * (RFC 4180). A JSON string's quotes are left to the caller; its quotes, backslashes and control characters
+ * are escaped here.
+ *
+ * @param out Where to copy the field, with room for six bytes per byte of text
+ * @param text The text
+ * @param len The length of the text
+ * @param format EXPORT_CSV or EXPORT_JSON
+ * @return size_t The number of bytes copied
+ */
+size_t escapeField(char *out, const char *text, size_t len, int format)
+{
+    static const char hex[] = "0123456789abcdef";
+    char *start = out;
+    size_t plain = 0;
+
+    if (format == EXPORT_CSV)
+    {
+        while (plain < len && text[plain] != ',' && text[plain] != '"' && text[plain] != '\r' && text[plain] != '\n')
+        {
+            plain++;
+        }
+        if (plain == len)
+        {
+            memcpy(out, text, len);
+            return len;
+        }
+        *out++ = '"';
+        for (size_t k = 0; k < len; k++)
+        {
+            if (text[k] == '"')
+            {
+                *out++ = '"';
+            }
+            *out++ = text[k];
+        }
+        *out++ = '"';
+        return (size_t)(out - start);
+    }
+    for (size_t k = 0; k < len; k++)
+    {
+        unsigned char c = (unsigned char)text[k];
+        if (c == '"' || c == '\\')
+        {
+            *out++ = '\\';
+            *out++ = (char)c;
+        }
+        else if (c < 0x20)
+        {
+            memcpy(out, "\\u00", 4);
+            out += 4;
+            *out++ = hex[c >> 4];
+            *out++ = hex[c & 15];
+        }
+        else
+        {
+            *out++ = (char)c;
+        }
+    }
+    return (size_t)(out - start);
+}
+
+/**
+ * @brief Hands the whole pages of a mapping that lie between two addresses back to the kernel
+ *
+ * The mapping is private and only read, so a dropped page is simply read from the file again if it is needed.
+ * Nothing is dropped unless both addresses lie in the mapping.
+ *
+ * @param map The mapping
+ * @param from The first address
+ * @param to The address just past the last
+ */
+void releasePages(const file_map *map, const void *from, const void *to)
+{
+    uintptr_t base = (uintptr_t)map->addr;
+    uintptr_t end = base + map->len;
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)from;
+    uintptr_t last = (uintptr_t)to;
+
+    if (first < base || last > end || first >= last)
+    {
+        return;
+    }
+    // Only whole pages are dropped, since the pages at either end may hold data still to be read
+    first = (first + page - 1) & ~(page - 1);
+    last = last == end ? last : last & ~(page - 1);
+    if (first < last)
+    {
+        // ERR33-C: A page that is not dropped only costs memory, so a failure is not an error
+        madvise((void *)first, last - first, MADV_DONTNEED);
+    }
+}
+
+/**
+ * @brief Finds students by name, name prefix or age range using the class's search indexes
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void searchStudents(classroom *cls)
+{
+    char num_buffer[4];
+    char key[NAME_LENGTH];
+    int choice;
+    int first;
+    int count;
+    int low;
+    int high;
+    const int *order;
+
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nERROR: No student data to search. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "Search Students") != 0)
+    {
+        return;
+    }
+    if (buildIndexes(cls) != 0)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Search Students function failed. Please try again.\n");
+        return;
+    }
+    printf("\nSearch by:\n\t1) Name\n\t2) Name Prefix\n\t3) Age Range\nEnter Option: ");
+    readInput(num_buffer, 2, NULL);
+    if (sscanf(num_buffer, "%d", &choice) != 1 || choice < 1 || choice > 3)
+    {
+        printf("\nERROR: Invalid input. Input should be an integer (1-3).\nERROR: Search Students function failed. Please try again.\n");
+        return;
+    }
+
+    if (choice == 3)
+    {
+        printf("\tMinimum Age: ");
+        readInput(num_buffer, 3, NULL);
+        if (sscanf(num_buffer, "%d", &low) != 1 || !isValidAge(low))
+        {
+            printf("\nERROR: Ivalid input. Input should have be a positive integer (0-%d).\nERROR: Search Students function failed. Please try again.\n", MAX_AGE);
+            return;
+        }
+        printf("\tMaximum Age: ");
+        readInput(num_buffer, 3, NULL);
+        if (sscanf(num_buffer, "%d", &high) != 1 || !isValidAge(high) || high < low)
+        {
+            printf("\nERROR: Ivalid input. Input should have be a positive integer (%d-%d).\nERROR: Search Students function failed. Please try again.\n", low, MAX_AGE);
+            return;
+        }
+        order = cls->age_order;
+        first = cls->age_start[low];
+        count = cls->age_start[high + 1] - first;
+    }
+    else
+    {
+        printf("\tStudent Name%s: ", choice == 2 ? " Prefix" : "");
+        readInput(key, NAME_LENGTH, NULL);
+        order = cls->name_order;
+        count = findByName(cls, key, choice == 2, &first);
+    }
+
+    printf("\n%d students found.\n", count);
+    fflush(stdout);
+    if (count > 0 && writeStudentList(STDOUT_FILENO, cls, order, first, count) != 0)
+    {
+        printf("\nERROR: Write Failed!\nERROR: Search Students function failed. Please try again.\n");
+    }
+}
+
+/**
+ * @brief Finds the run of the name index holding a name, or every name that starts with a prefix
+ *
+ * @param cls The class, with its indexes built
+ * @param key The name or prefix
+ * @param prefix 1 to match names that start with key, 0 to match key exactly
+ * @param first Set to the position in name_order of the first match
+ * @return int The number of matches, which follow one another in name_order
+ */
+int findByName(const classroom *cls, const char *key, int prefix, int *first)
+{
+    size_t key_len = strlen(key);
+    int low = 0;
+    int high = cls->index_count;
+    int end;
+
+    // Binary search for the first name not below key; every match starts there
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (strncmp(studentName(cls, cls->name_order[mid]), key, NAME_LENGTH) < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    end = low;
+    while (end < cls->index_count
+           && (prefix ? strncmp(studentName(cls, cls->name_order[end]), key, key_len)
+                      : strncmp(studentName(cls, cls->name_order[end]), key, NAME_LENGTH)) == 0)
+    {
+        end++;
+    }
+    *first = low;
+    return end - low;
+}
+
+/**
+ * @brief Builds a class's search indexes unless they are already up to date
+ *
+ * Names are ordered by sortByName, ages by a counting sort over the MAX_AGE + 1 possible ages.
+ *
+ * @param cls The class
+ * @return int 0 on success, -1 if memory ran out
+ */
+int buildIndexes(classroom *cls)
+{
+    int n = cls->num;
+
+    if (cls->indexed)
+    {
+        return 0;
+    }
+    if (reserveIndexes(cls, n) != 0 || sortByName(cls, cls->name_order) != 0)
+    {
+        return -1;
+    }
+
+    memset(cls->age_start, 0, sizeof(cls->age_start));
+    for (int i = 0; i < n; i++)
+    {
+        cls->age_start[studentAge(cls, i) + 1]++;
+    }
+    for (int age = 1; age <= MAX_AGE + 1; age++)
+    {
+        cls->age_start[age] += cls->age_start[age - 1];
+    }
+    for (int i = 0; i < n; i++)
+    {
+        // Each bucket is filled from its start, which is moved back afterwards
+        cls->age_order[cls->age_start[studentAge(cls, i)]++] = i;
+    }
+    for (int age = MAX_AGE; age > 0; age--)
+    {
+        cls->age_start[age] = cls->age_start[age - 1];
+    }
+    cls->age_start[0] = 0;
+
+    cls->index_count = n;
+    cls->indexed = 1;
+    return 0;
+}
+
+/**
+ * @brief Orders the students of a class by name, comparing each distinct name only once
+ *
+ * Students with the same name share one offset in the name pool, so an LSD radix sort of the offsets
+ * (one pass per byte the largest offset needs) first gathers each name's students together, still in roster
+ * order. Only the distinct names are then compared, by sortNameGroups, and their groups laid out in name
+ * order. The students are never moved, and the time is linear in the students plus the sort of the names.
+ *
+ * @param cls The class, whose students must be in memory
+ * @param order Filled with the positions of the class's students ordered by name
+ * @return int 0 on success, -1 if memory ran out
+ */
+int sortByName(const classroom *cls, int *order)
+{
+    int n = cls->num;
+    uint32_t *keys;
+    uint32_t *next_keys;
+    int *students;
+    int *next_students;
+    name_group *groups = NULL;
+    uint32_t largest = 0;
+    int count = 0;
+    int status = -1;
+
+    // MEM35-C: Two offsets and one position per student, for the radix sort's passes to move between
+    keys = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+    next_keys = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+    next_students = malloc((n > 0 ? n : 1) * sizeof(int));
+    students = order;
+    if (keys == NULL || next_keys == NULL || next_students == NULL)
+    {
+        goto done;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        keys[i] = cls->chunks[i >> CHUNK_SHIFT]->names[i & (CHUNK_STUDENTS - 1)];
+        students[i] = i;
+        largest |= keys[i];
+    }
+    for (int shift = 0; shift < 32 && (largest >> shift) != 0; shift += 8)
+    {
+        int start[257] = {0};
+        uint32_t *swap_keys = keys;
+        int *swap_students = students;
+
+        for (int i = 0; i < n; i++)
+        {
+            start[((keys[i] >> shift) & 0xFF) + 1]++;
+        }
+        for (int b = 1; b <= 256; b++)
+        {
+            start[b] += start[b - 1];
+        }
+        for (int i = 0; i < n; i++)
+        {
+            int at = start[(keys[i] >> shift) & 0xFF]++;
+            next_keys[at] = keys[i];
+            next_students[at] = students[i];
+        }
+        keys = next_keys;
+        students = next_students;
+        next_keys = swap_keys;
+        next_students = swap_students;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        count += i == 0 || keys[i] != keys[i - 1];
+    }
+    if ((groups = malloc((count > 0 ? count : 1) * sizeof(name_group))) == NULL)
+    {
+        goto done;
+    }
+    count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (i == 0 || keys[i] != keys[i - 1])
+        {
+            groups[count].name = cls->names.base + keys[i];
+            groups[count].start = i;
+            groups[count].count = 0;
+            groups[count].first = students[i];
+            count++;
+        }
+        groups[count - 1].count++;
+    }
+    if (sortNameGroups(groups, count) != 0)
+    {
+        goto done;
+    }
+    // The last pass may have left the grouped students in order itself, so they are copied out of the other array
+    if (students == order)
+    {
+        memcpy(next_students, order, n * sizeof(int));
+        students = next_students;
+    }
+    for (int g = 0, at = 0; g < count; g++)
+    {
+        memcpy(order + at, students + groups[g].start, groups[g].count * sizeof(int));
+        at += groups[g].count;
+    }
+    status = 0;
+
+done:
+    // The passes swap the buffers around, but the allocated ones are always the key arrays and the position array that is not order
+    free(keys);
+    free(next_keys);
+    free(students == order ? next_students : students);
+    free(groups);
+    return status;
+}
+
+/**
+ * @brief Sorts name groups by name, with a parallel merge sort when there are many of them
+ *
+ * From PARALLEL_SORT_MIN groups, each of up to one thread per core sorts a slice, and then neighbouring
+ * sorted runs are merged pairwise, the merges of each round running in parallel, until one run is left.
+ *
+ * @param items The groups
+ * @param count The number of groups
+ * @return int 0 on success, -1 if memory ran out
+ */
+int sortNameGroups(name_group *items, int count)
+{
+    sort_task tasks[MAX_WORKER_THREADS];
+    int bounds[MAX_WORKER_THREADS + 1];
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int runs = cores < 1 ? 1 : cores > MAX_WORKER_THREADS ? MAX_WORKER_THREADS : (int)cores;
+    name_group *scratch;
+
+    if (count < PARALLEL_SORT_MIN || runs == 1)
+    {
+        qsort(items, count, sizeof(name_group), compareNameGroups);
+        return 0;
+    }
+    if ((scratch = malloc(count * sizeof(name_group))) == NULL)
+    {
+        return -1;
+    }
+    for (int r = 0; r <= runs; r++)
+    {
+        bounds[r] = (int)((int64_t)count * r / runs);
+    }
+    for (int r = 0; r < runs; r++)
+    {
+        tasks[r] = (sort_task){items, scratch, bounds[r], -1, bounds[r + 1]};
+    }
+    runSortTasks(tasks, runs);
+    while (runs > 1)
+    {
+        int merges = runs / 2;
+        for (int r = 0; r < merges; r++)
+        {
+            tasks[r] = (sort_task){items, scratch, bounds[2 * r], bounds[2 * r + 1], bounds[2 * r + 2]};
+        }
+        runSortTasks(tasks, merges);
+        // An odd run out is carried into the next round as it is
+        for (int r = 0; r <= merges; r++)
+        {
+            bounds[r] = bounds[2 * r < runs ? 2 * r : runs];
+        }
+        bounds[(runs + 1) / 2] = count;
+        runs = (runs + 1) / 2;
+    }
+    free(scratch);
+    return 0;
+}
+
+/**
+ * @brief Runs sort tasks, one per thread; the calling thread runs the first
+ *
+ * A task whose thread cannot be started is run by the calling thread, so every task completes.
+ *
+ * @param tasks The tasks, which touch disjoint parts of the items
+ * @param count The number of tasks, at most MAX_WORKER_THREADS
+ */
+void runSortTasks(sort_task *tasks, int count)
+{
+    pthread_t workers[MAX_WORKER_THREADS];
+    int started[MAX_WORKER_THREADS] = {0};
+
+    for (int t = 1; t < count; t++)
+    {
+        started[t] = pthread_create(&workers[t], NULL, sortWorker, &tasks[t]) == 0;
+    }
+    sortWorker(&tasks[0]);
+    for (int t = 1; t < count; t++)
+    {
+        if (started[t])
+        {
+            pthread_join(workers[t], NULL);
+        }
+        else
+        {
+            sortWorker(&tasks[t]);
+        }
+    }
+}
+
+/**
+ * @brief Runs one sort task: sorts its slice, or merges its two sorted runs
+ *
+ * Ties go to the left run, so the merge keeps the order compareNameGroups gives.
+ *
+ * @param arg The sort_task
+ * @return void* NULL
+ */
+void *sortWorker(void *arg)
+{
+    sort_task *task = arg;
+    name_group *items = task->items;
+    int a = task->low;
+    int b = task->mid;
+    int k = task->low;
+
+    if (task->mid < 0)
+    {
+        qsort(items + task->low, task->high - task->low, sizeof(name_group), compareNameGroups);
+        return NULL;
+    }
+    while (a < task->mid && b < task->high)
+    {
+        task->scratch[k++] = compareNameGroups(&items[b], &items[a]) < 0 ? items[b++] : items[a++];
+    }
+    while (a < task->mid)
+    {
+        task->scratch[k++] = items[a++];
+    }
+    while (b < task->high)
+    {
+        task->scratch[k++] = items[b++];
+    }
+    memcpy(items + task->low, task->scratch + task->low, (task->high - task->low) * sizeof(name_group));
+    return NULL;
+}
+
+/**
+ * @brief Orders name groups by name, and groups with the same name by their first student
+ *
+ * Two groups only share a name when a mapped name pool holds a name twice.
+ *
+ * @param a The first name_group
+ * @param b The second name_group
+ * @return int Negative, zero or positive as a comes before, with or after b
+ */
+int compareNameGroups(const void *a, const void *b)
+{
+    const name_group *x = a;
+    const name_group *y = b;
+    int diff = strncmp(x->name, y->name, NAME_LENGTH);
+
+    if (diff != 0)
+    {
+        return diff;
+    }
+    return (x->first > y->first) - (x->first < y->first);
+}
+
+/**
+ * @brief Orders the students of a class by gender, and by name within each gender
+ *
+ * A counting sort over the four gender codes, which keeps the name order within each gender.
+ *
+ * @param cls The class
+ * @param by_name The positions of the class's students ordered by name
+ * @param order Filled with the positions ordered by gender and then name
+ */
+void sortByGender(const classroom *cls, const int *by_name, int *order)
+{
+    int start[5] = {0};
+
+    for (int i = 0; i < cls->num; i++)
+    {
+        start[cls->chunks[i >> CHUNK_SHIFT]->genders[i & (CHUNK_STUDENTS - 1)] + 1]++;
+    }
+    for (int g = 1; g <= 4; g++)
+    {
+        start[g] += start[g - 1];
+    }
+    for (int i = 0; i < cls->num; i++)
+    {
+        int s = by_name[i];
+        order[start[cls->chunks[s >> CHUNK_SHIFT]->genders[s & (CHUNK_STUDENTS - 1)]]++] = s;
+    }
+}
+
+/**
+ * @brief Compiles a filter expression such as "age >= 21 && gender == 2" into filter instructions
+ *
+ * The grammar, loosest first: expr := and ("||" and)*, and := unary ("&&" unary)*,
+ * unary := "!" unary | "(" expr ")" | comparison, and comparison := ("age" | "gender") op number
+ * | "name" ("==" | "!=") "quoted name", where op is one of == != < <= > >=. The instructions are postfix,
+ * so they run on a stack of masks without any jumps. A filter that compares no names is also decided for
+ * every gender and age, into its table.
+ *
+ * @param text The expression
+ * @param filter Filled with the compiled filter
+ * @param error Set to what is wrong with the expression when it does not compile
+ * @return int 0 on success, otherwise the position in text (from 1) where compiling stopped
+ */
+int compileFilter(const char *text, student_filter *filter, const char **error)
+{
+    filter_parser p = {text, filter, 0, NULL};
+    unsigned char ages[4 * (MAX_AGE + 1)];
+    unsigned char genders[4 * (MAX_AGE + 1)];
+    unsigned char stack[FILTER_STACK][CHUNK_STUDENTS];
+
+    memset(filter, 0, sizeof(*filter));
+    if (parseFilterOr(&p) == 0 && *(p.at += strspn(p.at, " \t")) != '\0')
+    {
+        p.error = "expected && or || or the end of the filter";
+    }
+    if (p.error != NULL)
+    {
+        *error = p.error;
+        return (int)(p.at - text) + 1;
+    }
+    if (filter->name_count == 0)
+    {
+        for (int k = 0; k < 4 * (MAX_AGE + 1); k++)
+        {
+            genders[k] = (unsigned char)(k / (MAX_AGE + 1));
+            ages[k] = (unsigned char)(k % (MAX_AGE + 1));
+        }
+        runFilter(filter, ages, genders, NULL, NULL, NULL, 4 * (MAX_AGE + 1), stack);
+        memcpy(filter->table, stack[0], sizeof(filter->table));
+    }
+    return 0;
+}
+
+/**
+ * @brief Compiles the alternatives of a filter expression, joined by ||
+ *
+ * @param p The parser
+ * @return int 0 on success, -1 if the expression is invalid (see p->error)
+ */
+int parseFilterOr(filter_parser *p)
+{
+    if (parseFilterAnd(p) != 0)
+    {
+        return -1;
+    }
+    while (matchFilterToken(p, "||"))
+    {
+        if (parseFilterAnd(p) != 0 || emitFilterOp(p, FOP_OR, 0, 0) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Compiles the terms of a filter expression joined by &&
+ *
+ * @param p The parser
+ * @return int 0 on success, -1 if the expression is invalid (see p->error)
+ */
+int parseFilterAnd(filter_parser *p)
+{
+    if (parseFilterUnary(p) != 0)
+    {
+        return -1;
+    }
+    while (matchFilterToken(p, "&&"))
+    {
+        if (parseFilterUnary(p) != 0 || emitFilterOp(p, FOP_AND, 0, 0) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Compiles a negated term, a parenthesized expression or a comparison
+ *
+ * @param p The parser
+ * @return int 0 on success, -1 if the expression is invalid (see p->error)
+ */
+int parseFilterUnary(filter_parser *p)
+{
+    if (matchFilterToken(p, "!"))
+    {
+        return parseFilterUnary(p) != 0 || emitFilterOp(p, FOP_NOT, 0, 0) != 0 ? -1 : 0;
+    }
+    if (matchFilterToken(p, "("))
+    {
+        if (parseFilterOr(p) != 0)
+        {
+            return -1;
+        }
+        if (!matchFilterToken(p, ")"))
+        {
+            p->error = "expected )";
+            return -1;
+        }
+        return 0;
+    }
+    return parseFilterComparison(p);
+}
+
+/**
+ * @brief Compiles a comparison of age, gender or name with a value
+ *
+ * @param p The parser
+ * @return int 0 on success, -1 if the expression is invalid (see p->error)
+ */
+int parseFilterComparison(filter_parser *p)
+{
+    static const char *const operators[] = {"==", "!=", "<=", ">=", "<", ">"};
+    static const int comparisons[] = {FCMP_EQ, FCMP_NE, FCMP_LE, FCMP_GE, FCMP_LT, FCMP_GT};
+    int code;
+    int cmp = -1;
+
+    p->at += strspn(p->at, " \t");
+    if (strncmp(p->at, "age", 3) == 0)
+    {
+        code = FOP_AGE;
+        p->at += 3;
+    }
+    else if (strncmp(p->at, "gender", 6) == 0)
+    {
+        code = FOP_GENDER;
+        p->at += 6;
+    }
+    else if (strncmp(p->at, "name", 4) == 0)
+    {
+        code = FOP_NAME;
+        p->at += 4;
+    }
+    else
+    {
+        p->error = "expected age, gender, name, ! or (";
+        return -1;
+    }
+    for (int k = 0; k < 6 && cmp < 0; k++)
+    {
+        if (matchFilterToken(p, operators[k]))
+        {
+            cmp = comparisons[k];
+        }
+    }
+    if (cmp < 0 || (code == FOP_NAME && cmp != FCMP_EQ && cmp != FCMP_NE))
+    {
+        p->error = code == FOP_NAME ? "expected == or !=" : "expected ==, !=, <, <=, > or >=";
+        return -1;
+    }
+
+    p->at += strspn(p->at, " \t");
+    if (code == FOP_NAME)
+    {
+        const char *end = *p->at == '"' ? strchr(p->at + 1, '"') : NULL;
+        if (end == NULL || end - p->at - 1 >= NAME_LENGTH)
+        {
+            p->error = "expected a name in double quotes, shorter than 256 characters";
+            return -1;
+        }
+        if (p->filter->name_count == FILTER_NAMES)
+        {
+            p->error = "too many names";
+            return -1;
+        }
+        // STR31-C: The name is shorter than NAME_LENGTH, so it fits with its terminator
+        char *name = p->filter->names[p->filter->name_count];
+        memcpy(name, p->at + 1, end - p->at - 1);
+        name[end - p->at - 1] = '\0';
+        p->at = end + 1;
+        return emitFilterOp(p, FOP_NAME, cmp, p->filter->name_count++);
+    }
+    // ERR34-C: strtol reports where the digits end, and values beyond any age or gender code are kept in range
+    char *end;
+    long value = strtol(p->at, &end, 10);
+    if (end == p->at || *p->at == '-' || *p->at == '+')
+    {
+        p->error = "expected a number";
+        return -1;
+    }
+    p->at = end;
+    return emitFilterOp(p, code, cmp, value > 1000 ? 1000 : (int)value);
+}
+
+/**
+ * @brief Consumes a token of a filter expression if it comes next, after any spaces
+ *
+ * @param p The parser
+ * @param token The token
+ * @return int 1 if the token was consumed, 0 otherwise
+ */
+int matchFilterToken(filter_parser *p, const char *token)
+{
+    size_t len = strlen(token);
+
+    p->at += strspn(p->at, " \t");
+    if (strncmp(p->at, token, len) != 0)
+    {
+        return 0;
+    }
+    p->at += len;
+    return 1;
+}
+
+/**
+ * @brief Appends an instruction to a filter, keeping track of the masks it leaves on the stack
+ *
+ * @param p The parser
+ * @param code The instruction, FOP_*
+ * @param cmp The comparison, for FOP_AGE, FOP_GENDER and FOP_NAME
+ * @param value The value compared with
+ * @return int 0 on success, -1 if the filter is too long or too deeply nested
+ */
+int emitFilterOp(filter_parser *p, int code, int cmp, int value)
+{
+    student_filter *filter = p->filter;
+
+    p->depth += code <= FOP_NAME ? 1 : code == FOP_NOT ? 0 : -1;
+    if (filter->count == FILTER_OPS || p->depth > FILTER_STACK)
+    {
+        p->error = "the filter is too long or too deeply nested";
+        return -1;
+    }
+    filter->ops[filter->count].code = (unsigned char)code;
+    filter->ops[filter->count].cmp = (unsigned char)cmp;
+    filter->ops[filter->count].value = value;
+    filter->count++;
+    return 0;
+}
+
+/**
+ * @brief Finds the students of a class that pass a filter, in roster order
+ *
+ * The filter runs a chunk at a time, each instruction over a whole column, and the matches are gathered
+ * without a branch per student. A filter on gender and age alone is one lookup per student in its table;
+ * one that compares names looks each name up in the class's intern table once, so every student is
+ * matched by name offset, unless the names are still those of a mapped file.
+ *
+ * @param filter The compiled filter
+ * @param cls The class, whose students must be in memory
+ * @param matches Filled with the positions of the students that pass; room for every student of the class
+ * @return int The number of students that pass
+ */
+int filterClass(const student_filter *filter, const classroom *cls, int *matches)
+{
+    unsigned char stack[FILTER_STACK][CHUNK_STUDENTS];
+    uint32_t bound[FILTER_NAMES];
+    int count = 0;
+
+    for (int k = 0; k < filter->name_count && cls->names.slots != NULL; k++)
+    {
+        // A name the class does not hold matches no offset, since offsets stay below UINT32_MAX / 2
+        if (findName(&cls->names, filter->names[k], &bound[k]) != 0)
+        {
+            bound[k] = UINT32_MAX;
+        }
+    }
+    for (int i = 0; i < cls->num; i += CHUNK_STUDENTS)
+    {
+        const student_chunk *chunk = cls->chunks[i >> CHUNK_SHIFT];
+        int n = cls->num - i < CHUNK_STUDENTS ? cls->num - i : CHUNK_STUDENTS;
+
+        if (filter->name_count == 0)
+        {
+            // ARR30-C: Genders and ages are always valid, so every table index is in range
+            for (int j = 0; j < n; j++)
+            {
+                stack[0][j] = filter->table[chunk->genders[j] * (MAX_AGE + 1) + chunk->ages[j]];
+            }
+        }
+        else
+        {
+            runFilter(filter, chunk->ages, chunk->genders, chunk->names, cls->names.base,
+                      cls->names.slots != NULL ? bound : NULL, n, stack);
+        }
+        // Every student is written, and the count only moves past the ones that pass
+        for (int j = 0; j < n; j++)
+        {
+            matches[count] = i + j;
+            count += stack[0][j];
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Runs a compiled filter over n students, leaving their mask (1 for a pass) in stack[0]
+ *
+ * Each instruction is one loop over the students, with the comparison chosen outside it.
+ *
+ * @param filter The compiled filter
+ * @param ages The students' ages
+ * @param genders The students' gender codes
+ * @param names The students' name offsets, or NULL if the filter compares no names
+ * @param base The name pool the offsets point into
+ * @param bound The offset of each of the filter's names in the pool, or NULL to compare the names as strings
+ * @param n The number of students, at most CHUNK_STUDENTS
+ * @param stack FILTER_STACK masks of CHUNK_STUDENTS bytes
+ */
+void runFilter(const student_filter *filter, const unsigned char *ages, const unsigned char *genders, const uint32_t *names,
+               const char *base, const uint32_t *bound, int n, unsigned char (*stack)[CHUNK_STUDENTS])
+{
+    int top = 0; // The number of masks on the stack
+
+    for (int k = 0; k < filter->count; k++)
+    {
+        const filter_op *op = &filter->ops[k];
+        unsigned char *out = stack[top];
+        unsigned char *left = top >= 2 ? stack[top - 2] : NULL;
+        unsigned char *right = top >= 1 ? stack[top - 1] : NULL;
+
+        switch (op->code)
+        {
+        case FOP_AGE:
+            compareColumn(ages, n, op->cmp, op->value, out);
+            top++;
+            break;
+        case FOP_GENDER:
+            compareColumn(genders, n, op->cmp, op->value, out);
+            top++;
+            break;
+        case FOP_NAME:
+        {
+            unsigned char negate = op->cmp == FCMP_NE;
+            if (bound != NULL)
+            {
+                uint32_t offset = bound[op->value];
+                for (int j = 0; j < n; j++)
+                {
+                    out[j] = (unsigned char)((names[j] == offset) ^ negate);
+                }
+            }
+            else
+            {
+                for (int j = 0; j < n; j++)
+                {
+                    out[j] = (unsigned char)((strcmp(base + names[j], filter->names[op->value]) == 0) ^ negate);
+                }
+            }
+            top++;
+            break;
+        }
+        case FOP_AND:
+            for (int j = 0; j < n; j++)
+            {
+                left[j] &= right[j];
+            }
+            top--;
+            break;
+        case FOP_OR:
+            for (int j = 0; j < n; j++)
+            {
+                left[j] |= right[j];
+            }
+            top--;
+            break;
+        default: // FOP_NOT
+            for (int j = 0; j < n; j++)
+            {
+                right[j] ^= 1;
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Compares a column of byte values with a value, writing 1 for each one that passes and 0 otherwise
+ *
+ * @param column The values
+ * @param n The number of values
+ * @param cmp The comparison, FCMP_*
+ * @param value The value compared with
+ * @param out The mask
+ */
+void compareColumn(const unsigned char *column, int n, int cmp, int value, unsigned char *out)
+{
+    switch (cmp)
+    {
+    case FCMP_EQ:
+        for (int j = 0; j < n; j++)
+        {
+            out[j] = column[j] == value;
+        }
+        break;
+    case FCMP_NE:
+        for (int j = 0; j < n; j++)
+        {
+            out[j] = column[j] != value;
+        }
+        break;
+    case FCMP_LT:
+        for (int j = 0; j < n; j++)
+        {
+            out[j] = column[j] < value;
+        }
+        break;
+    case FCMP_LE:
+        for (int j = 0; j < n; j++)
+        {
+            out[j] = column[j] <= value;
+        }
+        break;
+    case FCMP_GT:
+        for (int j = 0; j < n; j++)
+        {
+            out[j] = column[j] > value;
+        }
+        break;
+    default: // FCMP_GE
+        for (int j = 0; j < n; j++)
+        {
+            out[j] = column[j] >= value;
+        }
+        break;
+    }
+}
+
+/**
+ * @brief Makes sure a class's index arrays have room for count students
+ *
+ * @param cls The class
+ * @param count The number of students needed
+ * @return int 0 on success, -1 if memory ran out
+ */
+int reserveIndexes(classroom *cls, int count)
+{
+    if (count > cls->index_capacity)
+    {
+        int capacity = cls->index_capacity > 0 && cls->index_capacity <= INT_MAX / 2 && cls->index_capacity * 2 > count
+                           ? cls->index_capacity * 2 : count;
+        int *name_order = realloc(cls->name_order, (size_t)capacity * sizeof(int));
+        if (name_order == NULL)
+        {
+            return -1;
+        }
+        cls->name_order = name_order;
+        int *age_order = realloc(cls->age_order, (size_t)capacity * sizeof(int));
+        if (age_order == NULL)
+        {
+            return -1;
+        }
+        cls->age_order = age_order;
+        cls->index_capacity = capacity;
+    }
+    return 0;
+}
+
+/**
+ * @brief Adds a student to a class's search indexes, if they are built
+ *
+ * Binary search finds the student's place by name; by age it goes at the end of its age's bucket.
+ *
+ * @param cls The class
+ * @param index The position of the student, already stored
+ */
+void indexInsert(classroom *cls, int index)
+{
+    int first;
+    int age = studentAge(cls, index);
+    int at;
+
+    if (!cls->indexed)
+    {
+        return;
+    }
+    if (reserveIndexes(cls, cls->index_count + 1) != 0)
+    {
+        dropIndexes(cls); // Rebuilt by the next search
+        return;
+    }
+    // Students with the same name stay in the order they were added
+    at = findByName(cls, studentName(cls, index), 0, &first) + first;
+    memmove(cls->name_order + at + 1, cls->name_order + at, (size_t)(cls->index_count - at) * sizeof(int));
+    cls->name_order[at] = index;
+
+    at = cls->age_start[age + 1];
+    memmove(cls->age_order + at + 1, cls->age_order + at, (size_t)(cls->index_count - at) * sizeof(int));
+    cls->age_order[at] = index;
+    for (int a = age + 1; a <= MAX_AGE + 1; a++)
+    {
+        cls->age_start[a]++;
+    }
+    cls->index_count++;
+}
+
+/**
+ * @brief Removes a student from a class's search indexes, if they are built
+ *
+ * @param cls The class
+ * @param index The position of the student, still stored
+ */
+void indexRemove(classroom *cls, int index)
+{
+    int first;
+    int age = studentAge(cls, index);
+    int count;
+    int at;
+
+    if (!cls->indexed)
+    {
+        return;
+    }
+    count = findByName(cls, studentName(cls, index), 0, &first);
+    for (at = first; at < first + count - 1 && cls->name_order[at] != index; at++)
+    {
+    }
+    memmove(cls->name_order + at, cls->name_order + at + 1, (size_t)(cls->index_count - at - 1) * sizeof(int));
+
+    for (at = cls->age_start[age]; at < cls->age_start[age + 1] - 1 && cls->age_order[at] != index; at++)
+    {
+    }
+    memmove(cls->age_order + at, cls->age_order + at + 1, (size_t)(cls->index_count - at - 1) * sizeof(int));
+    for (int a = age + 1; a <= MAX_AGE + 1; a++)
+    {
+        cls->age_start[a]--;
+    }
+    cls->index_count--;
+}
+
+/**
+ * @brief Frees a class's search indexes; the next search builds them again
+ *
+ * @param cls The class
+ */
+void dropIndexes(classroom *cls)
+{
+    free(cls->name_order);
+    free(cls->age_order);
+    // MEM01-C: The dangling pointers are cleared once their memory is released
+    cls->name_order = NULL;
+    cls->age_order = NULL;
+    cls->index_capacity = 0;
+    cls->index_count = 0;
+    cls->indexed = 0;
+}
+
+/**
+ * @brief Outputs the age and gender statistics of the current class
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void viewClassStatistics(classroom *cls)
+{
+    class_stats stats;
+    char code[CLASS_CODE_BUFFER];
+
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nERROR: No student data to summarize. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "View Class Statistics") != 0)
+    {
+        return;
+    }
+    classStatistics(cls, &stats);
+    formatClassCode(cls, code);
+    printf("\nStatistics for %s (%d students)\n", code, stats.count);
+    // FLP06-C: The sum is converted to double before division so that the mean is not truncated
+    printf("Age:\tmin %d, max %d, mean %.2f\n", stats.min_age, stats.max_age, (double)stats.age_sum / stats.count);
+    for (int i = 0; i < AGE_BINS - 1; i++)
+    {
+        printf("\t%2d-%2d:\t%d\n", i * 10, i * 10 + 9, stats.age_bins[i]);
+    }
+    printf("\t%d+:\t%d\n", (AGE_BINS - 1) * 10, stats.age_bins[AGE_BINS - 1]);
+    printf("Gender:\tMale %d, Female %d, Other %d\n", stats.genders[1], stats.genders[2], stats.genders[3]);
+}
+
+/**
+ * @brief Computes the age and gender statistics of a class a chunk at a time
+ *
+ * @param cls The class, with at least one student
+ * @param stats Filled with the statistics
+ */
+void classStatistics(const classroom *cls, class_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->min_age = UCHAR_MAX;
+    for (int i = 0; i < cls->num; i += CHUNK_STUDENTS)
+    {
+        const student_chunk *chunk = cls->chunks[i >> CHUNK_SHIFT];
+        int n = cls->num - i < CHUNK_STUDENTS ? cls->num - i : CHUNK_STUDENTS;
+        columnStatistics(chunk->ages, chunk->genders, n, stats);
+    }
+}
+
+/**
+ * @brief Adds n students' ages and genders, given as byte columns, to a set of statistics
+ *
+ * With SSE2 sixteen students are handled per step: min/max with unsigned byte compares, the age sum with
+ * sums of absolute differences, and the histogram and gender counts with byte compares accumulated in
+ * byte lanes, which are widened before they can overflow. Anything left over is counted one at a time.
+ *
+ * @param ages The age column
+ * @param genders The gender column
+ * @param n The number of students
+ * @param stats The statistics to add to; min_age must start at UCHAR_MAX
+ */
+void columnStatistics(const unsigned char *ages, const unsigned char *genders, int n, class_stats *stats)
+{
+    uint64_t below[AGE_BINS - 1] = {0}; // Students younger than 10, 20, ... 90
+    uint64_t male = 0;
+    uint64_t female = 0;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i twos = _mm_set1_epi8(2);
+    __m128i low = _mm_set1_epi8((char)UCHAR_MAX);
+    __m128i high = zero;
+    __m128i sum = zero;
+    __m128i below_sum[AGE_BINS - 1];
+    __m128i male_sum = zero;
+    __m128i female_sum = zero;
+    uint64_t lanes[2];
+    unsigned char bytes[16];
+
+    for (int k = 0; k < AGE_BINS - 1; k++)
+    {
+        below_sum[k] = zero;
+    }
+    while (n - i >= 16)
+    {
+        __m128i below_count[AGE_BINS - 1];
+        __m128i male_count = zero;
+        __m128i female_count = zero;
+
+        for (int k = 0; k < AGE_BINS - 1; k++)
+        {
+            below_count[k] = zero;
+        }
+        // INT31-C: Each byte lane counts at most 255 matches before it is widened
+        for (int step = 0; step < 255 && n - i >= 16; step++, i += 16)
+        {
+            __m128i age = _mm_loadu_si128((const __m128i *)(ages + i));
+            __m128i gender = _mm_loadu_si128((const __m128i *)(genders + i));
+
+            low = _mm_min_epu8(low, age);
+            high = _mm_max_epu8(high, age);
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(age, zero));
+            for (int k = 0; k < AGE_BINS - 1; k++)
+            {
+                // age < limit exactly when min(age, limit - 1) == age; a match is -1, so subtracting counts it
+                __m128i last = _mm_set1_epi8((char)(10 * (k + 1) - 1));
+                below_count[k] = _mm_sub_epi8(below_count[k], _mm_cmpeq_epi8(_mm_min_epu8(age, last), age));
+            }
+            male_count = _mm_sub_epi8(male_count, _mm_cmpeq_epi8(gender, ones));
+            female_count = _mm_sub_epi8(female_count, _mm_cmpeq_epi8(gender, twos));
+        }
+        for (int k = 0; k < AGE_BINS - 1; k++)
+        {
+            below_sum[k] = _mm_add_epi64(below_sum[k], _mm_sad_epu8(below_count[k], zero));
+        }
+        male_sum = _mm_add_epi64(male_sum, _mm_sad_epu8(male_count, zero));
+        female_sum = _mm_add_epi64(female_sum, _mm_sad_epu8(female_count, zero));
+    }
+
+    _mm_storeu_si128((__m128i *)lanes, sum);
+    stats->age_sum += lanes[0] + lanes[1];
+    for (int k = 0; k < AGE_BINS - 1; k++)
+    {
+        _mm_storeu_si128((__m128i *)lanes, below_sum[k]);
+        below[k] = lanes[0] + lanes[1];
+    }
+    _mm_storeu_si128((__m128i *)lanes, male_sum);
+    male = lanes[0] + lanes[1];
+    _mm_storeu_si128((__m128i *)lanes, female_sum);
+    female = lanes[0] + lanes[1];
+    if (i > 0)
+    {
+        _mm_storeu_si128((__m128i *)bytes, low);
+        for (int k = 0; k < 16; k++)
+        {
+            stats->min_age = bytes[k] < stats->min_age ? bytes[k] : stats->min_age;
+        }
+        _mm_storeu_si128((__m128i *)bytes, high);
+        for (int k = 0; k < 16; k++)
+        {
+            stats->max_age = bytes[k] > stats->max_age ? bytes[k] : stats->max_age;
+        }
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        int age = ages[i];
+        stats->min_age = age < stats->min_age ? age : stats->min_age;
+        stats->max_age = age > stats->max_age ? age : stats->max_age;
+        stats->age_sum += age;
+        for (int k = age / 10; k < AGE_BINS - 1; k++)
+        {
+            below[k]++;
+        }
+        male += genders[i] == 1;
+        female += genders[i] == 2;
+    }
+
+    stats->age_bins[0] += (int)below[0];
+    for (int k = 1; k < AGE_BINS - 1; k++)
+    {
+        stats->age_bins[k] += (int)(below[k] - below[k - 1]);
+    }
+    stats->age_bins[AGE_BINS - 1] += n - (int)below[AGE_BINS - 2];
+    stats->genders[1] += (int)male;
+    stats->genders[2] += (int)female;
+    stats->genders[3] += n - (int)(male + female); // Genders are always valid, so the rest are Other
+    stats->count += n;
+}
+
+/**
+ * @brief Saves the selected class to class_list
+ *
+ * When class_list already holds this class, only the students changed since the last save are appended to
+ * its journal, and the journal is folded back into class_list by a background compaction once it grows.
+ * Any other class is written as a new snapshot.
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void save(classroom *cls)
+{
+    if (cls == NULL)
+    {
+        printf("\nERROR: No class to save. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "Save Class File") != 0)
+    {
+        return;
+    }
+    if (saveClass(cls) != 0)
+    {
+        audit("save", cls, "file=%s failed", CLASS_FILE);
+        printf("\nERROR: Write Failed!\nERROR: Save Class File function failed. Please try again.\n");
+        return;
+    }
+    audit("save", cls, "file=%s students=%d ok", CLASS_FILE, cls->num);
+    printf("\nClass Saved.\n");
+}
+
+/**
+ * @brief Saves a class to class_list, journaling its changes when class_list already holds it
+ *
+ * @param cls The class
+ * @return int 0 on success, 1 if a write failed
+ */
+int saveClass(classroom *cls)
+{
+    int failed;
+
+    finishCompaction(0);
+    if (cls->file_id != 0 && cls->file_id == class_file_id && cls->file_lsn == class_file_lsn)
+    {
+        failed = appendJournal(cls);
+        if (!failed && journal_bytes > JOURNAL_COMPACT_MIN && journal_bytes > snapshot_bytes / 2)
+        {
+            startCompaction(cls);
+        }
+    }
+    else
+    {
+        failed = saveSnapshot(cls);
+    }
+    return failed;
+}
+
+/**
+ * @brief Loads a class from class_list (and its journal) into the catalog and selects it
+ *
+ * Files in the current format are memory-mapped and, when the records match the in-memory layout of
+ * student, used in place without being copied. Changes recorded in the journal since the snapshot are
+ * then replayed. Files written by older versions are still read. A class already in the catalog with the
+ * same code is replaced.
+ */
+void load(void)
+{
+    classroom *cls;
+    char code[CLASS_CODE_BUFFER];
+    int status = loadClassList(&cls);
+
+    if (status != 0)
+    {
+        audit("load", NULL, "file=%s failed", CLASS_FILE);
+    }
+    if (status == -1)
+    {
+        printf("\nERROR: Read Failed!\nERROR: Load Class File function failed. Please try again.\n");
+        return;
+    }
+    else if (status == -2)
+    {
+        printf("\nERROR: Class file is damaged or from an unsupported version.\nERROR: Load Class File function failed. Please try again.\n");
+        return;
+    }
+    else if (status != 0)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Load Class File function failed. Please try again.\n");
+        return;
+    }
+    audit("load", cls, "file=%s students=%d ok", CLASS_FILE, cls->num);
+    current = cls;
+    formatClassCode(cls, code);
+    printf("\nClass %s of %d students loaded.\n", code, cls->num);
+}
+
+/**
+ * @brief Loads the class in class_list (and its journal) into the catalog
+ *
+ * @param out Set to the loaded class's place in the catalog
+ * @return int 0 on success, -1 if class_list cannot be read, -2 if it is damaged or from an unsupported
+ *             version, -3 if memory ran out
+ */
+int loadClassList(classroom **out)
+{
+    classroom loaded;
+    classroom *cls;
+    class_header header;
+    uint64_t last_lsn = 0;
+    int status;
+    int replayed = 0;
+
+    memset(&loaded, 0, sizeof(loaded));
+    memset(&header, 0, sizeof(header));
+
+    // ERR33-C: If the file cannot be read, the user is alerted and the program returns to the prompt
+    status = readClassFile(CLASS_FILE, &loaded, &header, 1);
+    if (status == 0 && header.journal_id != 0 && (replayed = replayJournal(&loaded, &header, &last_lsn)) < 0)
+    {
+        releaseClass(&loaded);
+        status = -2;
+    }
+
+    if (status != 0)
+    {
+        return status == -1 ? -1 : -2;
+    }
+    if ((cls = catalogClass(&catalog, &loaded)) == NULL)
+    {
+        releaseClass(&loaded);
+        return -3;
+    }
+    // MEM34-C: The class being replaced was dynamically allocated (or mapped) and thus can be released
+    releaseClass(cls);
+    *cls = loaded;
+    cls->file_id = class_file_id = header.journal_id;
+    cls->file_lsn = class_file_lsn = last_lsn;
+    cls->saved_num = cls->num;
+    if (replayed == 1)
+    {
+        cls->file_id = 0; // An old-format journal is not extended; the next save starts a new snapshot
+    }
+    // An interrupted save left after the last whole one is cut off, so that later saves follow whole ones
+    else if (header.journal_id != 0 && journal_bytes > 0 && truncate(JOURNAL_FILE, journal_bytes) != 0)
+    {
+        cls->file_id = 0;
+    }
+    *out = cls;
+    return 0;
+}
+
+/**
+ * @brief Selects a class in the catalog by its code for the other menu actions to work on
+ */
+void selectClass(void)
+{
+    char class_buffer[CLASS_CODE_BUFFER];
+    classroom key;
+    classroom *cls;
+
+    if (catalog.count == 0)
+    {
+        printf("\nERROR: The catalog is empty. You may enter new, or load existing data.\n");
+        return;
+    }
+    memset(&key, 0, sizeof(key));
+    printf("\nEnter class information (CATEGORY-COURSE-SECTION): ");
+    if (readInput(class_buffer, CLASS_CODE_BUFFER, NULL) < 0)
+    {
+        return;
+    }
+    if (parseClassCode(class_buffer, &key) != 0 || (cls = findClass(&catalog, &key)) == NULL)
+    {
+        printf("\nERROR: No class %s in the catalog.\nERROR: Select Class function failed. Please try again.\n", class_buffer);
+        return;
+    }
+    current = cls;
+    printf("\nClass %s selected.\n", class_buffer);
+}
+
+/**
+ * @brief Lists every class in the catalog with its number of students
+ */
+void viewCatalog(void)
+{
+    char code[CLASS_CODE_BUFFER];
+
+    if (catalog.count == 0)
+    {
+        printf("\nERROR: The catalog is empty. You may enter new, or load existing data.\n");
+        return;
+    }
+    printf("\n");
+    for (int i = 0; i < catalog.count; i++)
+    {
+        formatClassCode(catalog.classes[i], code);
+        printf("%c %-*s %d students\n", catalog.classes[i] == current ? '*' : ' ', CLASS_CODE_BUFFER, code, catalog.classes[i]->num);
+    }
+    printf("%d classes.\n", catalog.count);
+}
+
+/**
+ * @brief Saves every class in the catalog to a single class_catalog file
+ *
+ * Each class is stored as a complete class file image, so a loaded catalog maps its students in place.
+ */
+void saveCatalog(void)
+{
+    unsigned char header[CATALOG_HEADER_SIZE];
+    unsigned char *directory;
+    size_t directory_len = (size_t)catalog.count * CATALOG_ENTRY_SIZE;
+    uint64_t offset = CATALOG_HEADER_SIZE + directory_len;
+    uint64_t length;
+    int failed = 0;
+
+    if (catalog.count == 0)
+    {
+        printf("\nERROR: The catalog is empty. You may enter new, or load existing data.\n");
+        return;
+    }
+    for (int i = 0; i < catalog.count; i++)
+    {
+        if (requireStudents(catalog.classes[i], "Save Catalog File") != 0)
+        {
+            return;
+        }
+    }
+    // MEM35-C: One directory entry is allocated per class
+    if ((directory = calloc(catalog.count, CATALOG_ENTRY_SIZE)) == NULL)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Save Catalog File function failed. Please try again.\n");
+        return;
+    }
+
+    // FIO24-C: file opened only once
+    FILE *fp = fopen(CATALOG_FILE ".tmp", "wb");
+
+    if (fp)
+    {
+        // The header and directory are written last, once every class offset is known
+        memset(header, 0, CATALOG_HEADER_SIZE);
+        failed |= fwrite(header, CATALOG_HEADER_SIZE, 1, fp) != 1;
+        failed |= fwrite(directory, CATALOG_ENTRY_SIZE, catalog.count, fp) != (size_t)catalog.count;
+
+        for (int i = 0; i < catalog.count && !failed; i++)
+        {
+            // Images start on 8-byte boundaries so that mapped student records stay aligned
+            while (offset % 8 != 0)
+            {
+                failed |= fputc(0, fp) == EOF;
+                offset++;
+            }
+            failed |= writeClassImage(fp, catalog.classes[i], 0, 0, &length) != 0;
+            putLE64(directory + (size_t)i * CATALOG_ENTRY_SIZE, offset);
+            putLE64(directory + (size_t)i * CATALOG_ENTRY_SIZE + 8, length);
+            offset += length;
+        }
+
+        memcpy(header, CATALOG_FILE_MAGIC, 8);
+        putLE32(header + 8, CATALOG_FILE_VERSION);
+        putLE32(header + 12, (uint32_t)catalog.count);
+        putLE64(header + 16, CATALOG_HEADER_SIZE);
+        putLE64(header + 24, checksum64(directory, directory_len, CHECKSUM_INIT));
+        putLE64(header + CATALOG_HEADER_SIZE - 8, checksum64(header, CATALOG_HEADER_SIZE - 8, CHECKSUM_INIT));
+        failed |= fseek(fp, 0L, SEEK_SET) != 0;
+        failed |= fwrite(header, CATALOG_HEADER_SIZE, 1, fp) != 1;
+        failed |= fwrite(directory, CATALOG_ENTRY_SIZE, catalog.count, fp) != (size_t)catalog.count;
+        // FIO23-C: Buffered data is flushed (and the file closed) before it is renamed into place
+        failed |= fclose(fp) != 0;
+        failed |= rename(CATALOG_FILE ".tmp", CATALOG_FILE) != 0;
+    }
+    else
+    {
+        failed = 1;
+    }
+    free(directory);
+
+    if (failed)
+    {
+        remove(CATALOG_FILE ".tmp");
+        audit("save-catalog", NULL, "file=%s failed", CATALOG_FILE);
+        printf("\nERROR: Write Failed!\nERROR: Save Catalog File function failed. Please try again.\n");
+        return;
+    }
+    audit("save-catalog", NULL, "file=%s classes=%d ok", CATALOG_FILE, catalog.count);
+    printf("\nCatalog of %d classes saved.\n", catalog.count);
+}
+
+/**
+ * @brief Replaces the catalog with the classes in class_catalog
+ *
+ * The whole file is mapped once and every class is opened by its header alone, so browsing the catalog
+ * reads only the headers; each class's students are checked and used in place the first time an action
+ * needs them (see pageInClass). The current catalog is only replaced once the new one has been read
+ * successfully.
+ */
+void loadCatalog(void)
+{
+    class_catalog loaded;
+    classroom cls;
+    classroom *slot;
+    int status;
+    file_map *map = mapFile(CATALOG_FILE, &status);
+
+    if (map == NULL)
+    {
+        printf("\nERROR: Read Failed!\nERROR: Load Catalog File function failed. Please try again.\n");
+        return;
+    }
+
+    const unsigned char *header = map->addr;
+    uint32_t count = 0;
+    uint64_t directory_offset = 0;
+
+    if (map->len < CATALOG_HEADER_SIZE || memcmp(header, CATALOG_FILE_MAGIC, 8) != 0
+        || getLE64(header + CATALOG_HEADER_SIZE - 8) != checksum64(header, CATALOG_HEADER_SIZE - 8, CHECKSUM_INIT)
+        || getLE32(header + 8) != CATALOG_FILE_VERSION)
+    {
+        status = -2;
+    }
+    else
+    {
+        count = getLE32(header + 12);
+        directory_offset = getLE64(header + 16);
+        // INT30-C: Sizes are checked by division so that a corrupt count cannot wrap the multiplication
+        if (count > INT_MAX || directory_offset > map->len
+            || count > (map->len - directory_offset) / CATALOG_ENTRY_SIZE
+            || getLE64(header + 24) != checksum64(map->addr + directory_offset, (size_t)count * CATALOG_ENTRY_SIZE, CHECKSUM_INIT))
+        {
+            status = -2;
+        }
+    }
+
+    memset(&loaded, 0, sizeof(loaded));
+    for (uint32_t i = 0; i < count && status == 0; i++)
+    {
+        const unsigned char *entry = map->addr + directory_offset + (size_t)i * CATALOG_ENTRY_SIZE;
+        uint64_t offset = getLE64(entry);
+        uint64_t length = getLE64(entry + 8);
+
+        memset(&cls, 0, sizeof(cls));
+        if (offset > map->len || length > map->len - offset || offset % 8 != 0
+            || openClassImage(map->addr + offset, length, map, &cls, NULL) != 0)
+        {
+            status = -2;
+        }
+        else if ((slot = catalogClass(&loaded, &cls)) == NULL)
+        {
+            releaseClass(&cls);
+            status = -1;
+        }
+        else
+        {
+            releaseClass(slot); // A repeated class code keeps the last copy
+            *slot = cls;
+        }
+    }
+    releaseMap(map); // Classes that use the mapping hold their own references
+
+    if (status != 0)
+    {
+        clearCatalog(&loaded);
+        audit("load-catalog", NULL, "file=%s failed", CATALOG_FILE);
+        printf("\nERROR: %s\nERROR: Load Catalog File function failed. Please try again.\n",
+               status == -1 ? "Out of memory." : "Catalog file is damaged or from an unsupported version.");
+        return;
+    }
+    clearCatalog(&catalog);
+    catalog = loaded;
+    current = NULL;
+    audit("load-catalog", NULL, "file=%s classes=%d ok", CATALOG_FILE, catalog.count);
+    printf("\nCatalog of %d classes loaded. Select a class to work on.\n", catalog.count);
+}
+
+/**
+ * @brief Looks up a class by its code in O(1) through the catalog's hash index
+ *
+ * @param cat The catalog to search
+ * @param key A class whose code fields identify the class to find
+ * @return classroom* The class, or NULL if the catalog has no class with that code
+ */
+classroom *findClass(class_catalog *cat, const classroom *key)
+{
+    if (cat->slot_count == 0)
+    {
+        return NULL;
+    }
+    uint32_t mask = (uint32_t)cat->slot_count - 1;
+
+    // Linear probing: the load factor is kept at or below one half, so probe sequences stay short
+    for (uint32_t i = hashClassCode(key) & mask; cat->slots[i] != 0; i = (i + 1) & mask)
+    {
+        classroom *cls = cat->classes[cat->slots[i] - 1];
+        if (strcmp(cls->category, key->category) == 0 && strcmp(cls->course_num, key->course_num) == 0
+            && strcmp(cls->section_num, key->section_num) == 0)
+        {
+            return cls;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finds the class with the code of key, adding an empty class with that code if there is none
+ *
+ * @param cat The catalog to search
+ * @param key A class whose code fields identify the class
+ * @return classroom* The class, or NULL if memory ran out
+ */
+classroom *catalogClass(class_catalog *cat, const classroom *key)
+{
+    classroom *cls = findClass(cat, key);
+
+    if (cls != NULL)
+    {
+        return cls;
+    }
+
+    if (cat->count == cat->capacity)
+    {
+        int capacity = cat->capacity > 0 ? cat->capacity * 2 : 16;
+        classroom **classes = realloc(cat->classes, capacity * sizeof(classroom *));
+        if (classes == NULL)
+        {
+            return NULL;
+        }
+        cat->classes = classes;
+        cat->capacity = capacity;
+    }
+
+    // Keep the index at most half full so that it never fills up and lookups stay O(1)
+    if (2 * (cat->count + 1) > cat->slot_count)
+    {
+        int slot_count = cat->slot_count > 0 ? cat->slot_count * 2 : CATALOG_MIN_SLOTS;
+        int *slots = calloc(slot_count, sizeof(int));
+        if (slots == NULL)
+        {
+            return NULL;
+        }
+        for (int i = 0; i < cat->count; i++)
+        {
+            uint32_t j = hashClassCode(cat->classes[i]) & (uint32_t)(slot_count - 1);
+            while (slots[j] != 0)
+            {
+                j = (j + 1) & (uint32_t)(slot_count - 1);
+            }
+            slots[j] = i + 1;
+        }
+        free(cat->slots);
+        cat->slots = slots;
+        cat->slot_count = slot_count;
+    }
+
+    if ((cls = calloc(1, sizeof(classroom))) == NULL)
+    {
+        return NULL;
+    }
+    memcpy(cls->category, key->category, CLASS_CODE_LENGTH);
+    memcpy(cls->course_num, key->course_num, CLASS_CODE_LENGTH);
+    memcpy(cls->section_num, key->section_num, CLASS_CODE_LENGTH);
+
+    uint32_t mask = (uint32_t)cat->slot_count - 1;
+    uint32_t i = hashClassCode(cls) & mask;
+    while (cat->slots[i] != 0)
+    {
+        i = (i + 1) & mask;
+    }
+    cat->classes[cat->count++] = cls;
+    cat->slots[i] = cat->count;
+    return cls;
+}
+
+/**
+ * @brief Releases every class in a catalog and empties it
+ *
+ * @param cat The catalog to clear
+ */
+void clearCatalog(class_catalog *cat)
+{
+    for (int i = 0; i < cat->count; i++)
+    {
+        releaseClass(cat->classes[i]);
+        free(cat->classes[i]);
+    }
+    free(cat->classes);
+    free(cat->slots);
+    memset(cat, 0, sizeof(*cat));
+}
+
+/**
+ * @brief Hashes a class code (FNV-1a over the three code fields)
+ *
+ * @param cls The class whose code is hashed
+ * @return uint32_t The hash
+ */
+uint32_t hashClassCode(const classroom *cls)
+{
+    const char *fields[3] = {cls->category, cls->course_num, cls->section_num};
+    uint32_t h = 2166136261u;
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (const char *c = fields[i]; *c != '\0'; c++)
+        {
+            h = (h ^ (unsigned char)*c) * 16777619u;
+        }
+        h = (h ^ '-') * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief Formats the CATEGORY-COURSE-SECTION code of a class
+ *
+ * @param cls The class
+ * @param buffer A buffer of at least CLASS_CODE_BUFFER characters
+ */
+void formatClassCode(const classroom *cls, char *buffer)
+{
+    snprintf(buffer, CLASS_CODE_BUFFER, "%s-%s-%s", cls->category, cls->course_num, cls->section_num);
+}
+
+/**
+ * @brief Writes a class as a class file image (header, roster chunks, name table) at the current position of fp
+ *
+ * Only the names still in use are written to the name table, so names left behind by removed students are
+ * dropped along the way.
+ *
+ * @param fp The file to write, positioned where the image starts
+ * @param cls The class to write
+ * @param journal_id The journal that will extend this image, or 0 for none
+ * @param journal_lsn The last journal entry that the image includes
+ * @param length Set to the number of bytes written
+ * @return int 0 on success, -1 if a write failed
+ */
+int writeClassImage(FILE *fp, const classroom *cls, uint64_t journal_id, uint64_t journal_lsn, uint64_t *length)
+{
+    unsigned char header_buffer[CLASS_HEADER_SIZE];
+    class_header header;
+    const name_pool *pool = &cls->names;
+    size_t pool_size = pool->base != NULL ? pool->used : 1;
+    uint64_t started = statsNow();
+    int num = cls->num;
+    uint32_t names_size = 1; // The empty name comes first
+    long start = ftell(fp);
+    int failed = start < 0;
+
+    // MEM35-C: The name table never outgrows the pool it is taken from, plus its padding to 8 bytes
+    student_chunk *copy = malloc(sizeof(student_chunk));
+    uint32_t *renumber = calloc(pool_size, sizeof(uint32_t)); // By old offset: the new offset plus one, once written
+    char *names = malloc(pool_size + 8);
+    failed |= copy == NULL || renumber == NULL || names == NULL;
+    if (!failed)
+    {
+        names[0] = '\0';
+        renumber[0] = 1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.version = CLASS_FILE_VERSION;
+    header.header_size = CLASS_HEADER_SIZE;
+    header.record_count = num;
+    header.record_size = sizeof(student_chunk);
+    header.name_offset = offsetof(student_chunk, names);
+    header.gender_offset = offsetof(student_chunk, genders);
+    header.age_offset = offsetof(student_chunk, ages);
+    header.records_offset = CLASS_HEADER_SIZE;
+    header.journal_id = journal_id;
+    header.journal_lsn = journal_lsn;
+    header.chunk_students = CHUNK_STUDENTS;
+    memcpy(header.category, cls->category, CLASS_CODE_LENGTH);
+    memcpy(header.course_num, cls->course_num, CLASS_CODE_LENGTH);
+    memcpy(header.section_num, cls->section_num, CLASS_CODE_LENGTH);
+
+    // The header is written last, once the records checksum is known
+    memset(header_buffer, 0, CLASS_HEADER_SIZE);
+    failed |= fwrite(header_buffer, CLASS_HEADER_SIZE, 1, fp) != 1;
+
+    // Chunks are a multiple of 8 bytes long, so checksumming them one after another matches the loader
+    header.records_checksum = CHECKSUM_INIT;
+    for (int i = 0; i < num && !failed; i += CHUNK_STUDENTS)
+    {
+        const student_chunk *chunk = cls->chunks[i >> CHUNK_SHIFT];
+        int used = num - i < CHUNK_STUDENTS ? num - i : CHUNK_STUDENTS;
+
+        // The unused end of the last chunk is written as zeroes, so removed students never reach the file
+        if (used < CHUNK_STUDENTS)
+        {
+            memset(copy, 0, sizeof(student_chunk));
+        }
+        for (int j = 0; j < used; j++)
+        {
+            uint32_t old = chunk->names[j];
+            if (renumber[old] == 0)
+            {
+                size_t len = strlen(pool->base + old) + 1;
+                memcpy(names + names_size, pool->base + old, len);
+                renumber[old] = names_size + 1;
+                names_size += (uint32_t)len;
+            }
+            putLE32((unsigned char *)&copy->names[j], renumber[old] - 1);
+        }
+        memcpy(copy->ages, chunk->ages, used);
+        memcpy(copy->genders, chunk->genders, used);
+        header.records_checksum = checksum64(copy, sizeof(student_chunk), header.records_checksum);
+        failed |= fwrite(copy, sizeof(student_chunk), 1, fp) != 1;
+    }
+    if (!failed)
+    {
+        size_t padded = ((size_t)names_size + 7) & ~(size_t)7;
+        memset(names + names_size, 0, padded - names_size);
+        header.records_checksum = checksum64(names, padded, header.records_checksum);
+        failed |= fwrite(names, 1, padded, fp) != padded;
+    }
+    free(copy);
+    free(renumber);
+    free(names);
+
+    header.names_size = names_size;
+    *length = classImageLength(num, names_size);
+    encodeClassHeader(header_buffer, &header);
+    failed |= fseek(fp, start, SEEK_SET) != 0;
+    failed |= fwrite(header_buffer, CLASS_HEADER_SIZE, 1, fp) != 1;
+    failed |= fseek(fp, 0L, SEEK_END) != 0;
+    statsAdd(STAT_CLASS_WRITE, statsNow() - started, *length);
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Computes the length of a class file image
+ *
+ * @param num The number of students in the class
+ * @param names_size The size of its name table
+ * @return uint64_t The image length in bytes
+ */
+uint64_t classImageLength(int num, uint32_t names_size)
+{
+    return CLASS_HEADER_SIZE + (((uint64_t)num + CHUNK_STUDENTS - 1) >> CHUNK_SHIFT) * sizeof(student_chunk)
+         + (((uint64_t)names_size + 7) & ~(uint64_t)7);
+}
+
+/**
+ * @brief Decodes the header of a class file image and checks that the records and name table it describes fit
+ *
+ * @param image The start of the image
+ * @param len The number of bytes available from image
+ * @param header Filled with the image's header
+ * @param records_len Set to the length of the records (chunks, or fixed-size records before version 3)
+ * @param names_len Set to the length of the name table with its padding (0 before version 4)
+ * @return int 0 if they fit, 1 if the image is not in the current format, -2 if it is truncated or from an
+ *             unsupported version
+ */
+int checkClassImage(const unsigned char *image, size_t len, class_header *header, size_t *records_len, uint64_t *names_len)
+{
+    uint64_t blocks = 0; // Chunks, or records before version 3
+
+    *names_len = 0;
+    if (len < CLASS_HEADER_SIZE)
+    {
+        return 1;
+    }
+    int status = decodeClassHeader(image, header);
+    if (status == 0)
+    {
+        blocks = header->version >= CLASS_FILE_COLUMNS
+                     ? ((uint64_t)header->record_count + header->chunk_students - 1) / header->chunk_students
+                     : header->record_count;
+        *names_len = header->version >= CLASS_FILE_NAMES ? ((uint64_t)header->names_size + 7) & ~(uint64_t)7 : 0;
+    }
+    // INT30-C: Sizes are checked by division so that a corrupt count cannot wrap the multiplication
+    if (status == 0 && (header->record_count > MAX_STUDENTS
+        || header->names_size > UINT32_MAX / 2
+        || header->records_offset > len
+        || blocks > (len - header->records_offset) / header->record_size
+        || *names_len > len - header->records_offset - blocks * header->record_size))
+    {
+        status = -2;
+    }
+    *records_len = (size_t)blocks * header->record_size;
+    return status;
+}
+
+/**
+ * @brief Points a class at the students of a class file image held in a mapped file
+ *
+ * @param image The start of the image
+ * @param len The number of bytes available from image
+ * @param map The mapping that holds the image; referenced by cls if its students are used in place
+ * @param cls Filled with the class code and students
+ * @param header_out Filled with the image's header (may be NULL)
+ * @return int 0 on success, 1 if the image is not in the current format, -1 if memory ran out,
+ *             -2 if it is truncated, corrupt or from an unsupported version
+ */
+int mapClassImage(unsigned char *image, size_t len, file_map *map, classroom *cls, class_header *header_out)
+{
+    class_header header;
+    size_t records_len;
+    uint64_t names_len;
+    int status = checkClassImage(image, len, &header, &records_len, &names_len);
+
+    if (status == 0 && checksumMapped(image + header.records_offset, records_len + names_len, map) != header.records_checksum)
+    {
+        status = -2;
+    }
+    unsigned char *records = image + header.records_offset;
+    char *names = (char *)records + records_len;
+    // STR32-C: The name table must start with the empty name and end with a terminator
+    if (status == 0 && header.version >= CLASS_FILE_NAMES && (names[0] != '\0' || names[header.names_size - 1] != '\0'))
+    {
+        status = -2;
+    }
+    if (status != 0)
+    {
+        return status;
+    }
+
+    uint64_t blocks = records_len / header.record_size;
+    int count = (int)header.record_count;
+    if (columnsMatchMemory(&header))
+    {
+        // Every chunk, including a partly used last one, and the name table are used straight from the private
+        // mapping. The columns are still checked, since the rest of the program relies on every age, gender
+        // and name offset being valid.
+        for (int i = 0; i < count; i++)
+        {
+            const student_chunk *chunk = (const student_chunk *)(records + (size_t)(i >> CHUNK_SHIFT) * sizeof(student_chunk));
+            int j = i & (CHUNK_STUDENTS - 1);
+            if (!isValidAge(chunk->ages[j]) || !isValidGender(chunk->genders[j]) || chunk->names[j] >= header.names_size)
+            {
+                return -2;
+            }
+            if (map != NULL && map->stream && j == CHUNK_STUDENTS - 1 && ((i >> CHUNK_SHIFT) + 1) % STREAM_CHUNKS == 0)
+            {
+                releasePages(map, chunk + 1 - STREAM_CHUNKS, chunk + 1);
+            }
+        }
+        if (blocks > 0 && (cls->chunks = malloc((size_t)blocks * sizeof(student_chunk *))) == NULL)
+        {
+            return -1;
+        }
+        for (uint64_t i = 0; i < blocks; i++)
+        {
+            cls->chunks[i] = (student_chunk *)(records + i * sizeof(student_chunk));
+        }
+        cls->chunk_count = (int)blocks;
+        cls->chunk_capacity = (int)blocks;
+        cls->mapped_chunks = (int)blocks;
+        cls->names.base = names;
+        cls->names.used = header.names_size;
+        cls->map = map;
+        map->refs++;
+    }
+    else
+    {
+        // The file was written with another layout, so each student is decoded and checked into place
+        student s;
+        if (reserveStudents(cls, count) != 0)
+        {
+            releaseClass(cls);
+            return -1;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            if (header.version >= CLASS_FILE_COLUMNS)
+            {
+                const unsigned char *chunk = records + (size_t)(i / header.chunk_students) * header.record_size;
+                uint32_t j = i % header.chunk_students;
+                memset(s.name, 0, NAME_LENGTH);
+                if (header.version >= CLASS_FILE_NAMES)
+                {
+                    uint32_t offset = getLE32(chunk + header.name_offset + (size_t)j * sizeof(uint32_t));
+                    if (offset >= header.names_size)
+                    {
+                        releaseClass(cls);
+                        return -2;
+                    }
+                    strncpy(s.name, names + offset, NAME_LENGTH - 1);
+                }
+                else
+                {
+                    memcpy(s.name, chunk + header.name_offset + (size_t)j * RECORD_NAME_LENGTH, RECORD_NAME_LENGTH - 1);
+                }
+                s.gender = chunk[header.gender_offset + j];
+                s.age = chunk[header.age_offset + j];
+            }
+            else
+            {
+                decodeStudent(records + (size_t)i * header.record_size, &header, &s);
+            }
+            if (!isValidGender(s.gender) || !isValidAge(s.age))
+            {
+                releaseClass(cls);
+                return -2;
+            }
+            if (setStudent(cls, i, &s) != 0)
+            {
+                releaseClass(cls);
+                return -1;
+            }
+        }
+    }
+
+    memcpy(cls->category, header.category, CLASS_CODE_LENGTH);
+    memcpy(cls->course_num, header.course_num, CLASS_CODE_LENGTH);
+    memcpy(cls->section_num, header.section_num, CLASS_CODE_LENGTH);
+    cls->num = count;
+    if (header_out != NULL)
+    {
+        *header_out = header;
+    }
+    return 0;
+}
+
+/**
+ * @brief Maps a class file into memory and points a class at its students
+ *
+ * @param path The class file to map
+ * @param cls Filled with the class code and students
+ * @param header Filled with the file's header (may be NULL)
+ * @return int 0 on success, 1 if the file is not in the current format, -1 if it cannot be read,
+ *             -2 if it is truncated, corrupt or from an unsupported version
+ */
+int mapClassFile(const char *path, classroom *cls, class_header *header)
+{
+    int status;
+    file_map *map = mapFile(path, &status);
+
+    if (map == NULL)
+    {
+        return status;
+    }
+    status = mapClassImage(map->addr, map->len, map, cls, header);
+    releaseMap(map); // cls holds its own reference if it uses the mapping
+    return status;
+}
+
+/**
+ * @brief Opens a class file image by its header alone, leaving its students to be paged in when needed
+ *
+ * Only the header is read, so opening a class costs the same whatever its size; the records are not even
+ * checked against their checksum until pageInClass needs them.
+ *
+ * @param image The start of the image
+ * @param len The number of bytes available from image
+ * @param map The mapping that holds the image; referenced by cls until its students are paged in
+ * @param cls Filled with the class code and number of students
+ * @param header_out Filled with the image's header (may be NULL)
+ * @return int 0 on success, 1 if the image is not in the current format, -2 if it is truncated or from an
+ *             unsupported version
+ */
+int openClassImage(unsigned char *image, size_t len, file_map *map, classroom *cls, class_header *header_out)
+{
+    class_header header;
+    size_t records_len;
+    uint64_t names_len;
+    int status = checkClassImage(image, len, &header, &records_len, &names_len);
+
+    if (status != 0)
+    {
+        return status;
+    }
+    memcpy(cls->category, header.category, CLASS_CODE_LENGTH);
+    memcpy(cls->course_num, header.course_num, CLASS_CODE_LENGTH);
+    memcpy(cls->section_num, header.section_num, CLASS_CODE_LENGTH);
+    cls->num = (int)header.record_count;
+    cls->image = image;
+    cls->image_len = len;
+    cls->map = map;
+    map->refs++;
+    if (header_out != NULL)
+    {
+        *header_out = header;
+    }
+    return 0;
+}
+
+/**
+ * @brief Maps a class file into memory and opens it by its header alone (see openClassImage)
+ *
+ * @param path The class file to map
+ * @param cls Filled with the class code and number of students
+ * @param header Filled with the file's header (may be NULL)
+ * @return int 0 on success, 1 if the file is not in the current format, -1 if it cannot be read,
+ *             -2 if it is truncated or from an unsupported version
+ */
+int openClassFile(const char *path, classroom *cls, class_header *header)
+{
+    int status;
+    file_map *map = mapFile(path, &status);
+
+    if (map == NULL)
+    {
+        return status;
+    }
+    status = openClassImage(map->addr, map->len, map, cls, header);
+    releaseMap(map); // cls holds its own reference until its students are paged in
+    return status;
+}
+
+/**
+ * @brief Brings in the students of a class opened by its header alone, checking them as mapClassImage does
+ *
+ * Does nothing for a class whose students are already in place. The mapping's pages are only read from
+ * here on, so a class that is never listed, searched or changed never costs more than its header.
+ *
+ * @param cls The class
+ * @return int 0 on success, -1 if memory ran out, -2 if the image is corrupt; the class is left as it was
+ */
+int pageInClass(classroom *cls)
+{
+    classroom loaded;
+    file_map *map = cls->map;
+
+    if (cls->image == NULL)
+    {
+        return 0;
+    }
+    memset(&loaded, 0, sizeof(loaded));
+    int status = mapClassImage(cls->image, cls->image_len, map, &loaded, NULL);
+    if (status != 0)
+    {
+        return status < 0 ? status : -2;
+    }
+    // loaded holds its own reference if it uses the mapping in place, so the class's reference is dropped
+    cls->chunks = loaded.chunks;
+    cls->store = loaded.store;
+    cls->names = loaded.names;
+    cls->chunk_count = loaded.chunk_count;
+    cls->chunk_capacity = loaded.chunk_capacity;
+    cls->mapped_chunks = loaded.mapped_chunks;
+    cls->map = loaded.map;
+    cls->image = NULL;
+    cls->image_len = 0;
+    releaseMap(map);
+    return 0;
+}
+
+/**
+ * @brief Pages in the students of a class for a menu action that uses them, telling the user if it cannot
+ *
+ * @param cls The selected class (may be NULL)
+ * @param function The menu action, named in its error messages
+ * @return int 0 if the action can go ahead, -1 if the students could not be brought in (the user has been told)
+ */
+int requireStudents(classroom *cls, const char *function)
+{
+    int status = cls != NULL ? pageInClass(cls) : 0;
+
+    if (status == -1)
+    {
+        printf("\nERROR: Out of memory.\nERROR: %s function failed. Please try again.\n", function);
+    }
+    else if (status != 0)
+    {
+        printf("\nERROR: Class file is damaged or from an unsupported version.\nERROR: %s function failed. Please try again.\n", function);
+    }
+    return status != 0 ? -1 : 0;
+}
+
+/**
+ * @brief Reads a class file written before the versioned format (count, raw students, class code)
+ *
+ * @param path The class file to read
+ * @param cls Filled with the class code and students
+ * @return int 0 on success, -1 if the file cannot be read
+ */
+int loadLegacyClassFile(const char *path, classroom *cls)
+{
+    // FIO24-C: file opened only once
+    FILE *fp = fopen(path, "rb");
+    int count = 0;
+    int failed = 0;
+    legacy_student *block;
+    student s;
+    uint64_t start = statsNow();
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    if (fread(&count, sizeof(int), 1, fp) != 1 || count < 0)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    // MEM35-C: The raw students are read a chunk at a time through a buffer sized for CHUNK_STUDENTS of them
+    block = malloc(CHUNK_STUDENTS * sizeof(legacy_student));
+    if (block == NULL || count > MAX_STUDENTS || reserveStudents(cls, count) != 0)
+    {
+        free(block);
+        fclose(fp);
+        releaseClass(cls);
+        return -1;
+    }
+    for (int i = 0; i < count && !failed; i += CHUNK_STUDENTS)
+    {
+        int n = count - i < CHUNK_STUDENTS ? count - i : CHUNK_STUDENTS;
+        failed |= fread(block, sizeof(legacy_student), n, fp) != (size_t)n;
+        for (int j = 0; j < n && !failed; j++)
+        {
+            memcpy(s.name, block[j].name, RECORD_NAME_LENGTH - 1);
+            s.name[RECORD_NAME_LENGTH - 1] = '\0';
+            s.gender = block[j].gender;
+            s.age = block[j].age;
+            failed |= !isValidGender(s.gender) || !isValidAge(s.age) || setStudent(cls, i + j, &s) != 0;
+        }
+    }
+    free(block);
+    failed |= fread(cls->category, sizeof(char), CLASS_CODE_LENGTH, fp) != CLASS_CODE_LENGTH;
+    failed |= fread(cls->course_num, sizeof(char), CLASS_CODE_LENGTH, fp) != CLASS_CODE_LENGTH;
+    failed |= fread(cls->section_num, sizeof(char), CLASS_CODE_LENGTH, fp) != CLASS_CODE_LENGTH;
+    fclose(fp);
+    statsAdd(STAT_LEGACY_READ, statsNow() - start, sizeof(int) + (uint64_t)count * sizeof(legacy_student) + 3 * CLASS_CODE_LENGTH);
+
+    if (failed)
+    {
+        releaseClass(cls);
+        return -1;
+    }
+    // STR32-C: The class code fields are always null-terminated, even in a damaged file
+    cls->category[CLASS_CODE_LENGTH - 1] = '\0';
+    cls->course_num[CLASS_CODE_LENGTH - 1] = '\0';
+    cls->section_num[CLASS_CODE_LENGTH - 1] = '\0';
+    cls->num = count;
+    return 0;
+}
+
+/**
+ * @brief Writes a class as a compact class file image, for archiving
+ *
+ * The image is a COMPACT_HEADER_SIZE byte header followed by blocks, each with its payload length, item
+ * count and its own checksum, so a reader can decode and check one block at a time. The first blocks hold
+ * the distinct names in byte order, front-coded: each name is stored as the length it shares with the
+ * previous name of its block and the rest of its bytes, both lengths as varints. The student blocks that
+ * follow hold, for COMPACT_BLOCK students, each one's place in that dictionary bit-packed at the width its
+ * block needs, the genders at two bits each and the ages as varints.
+ *
+ * @param fp The file to write, positioned where the image starts
+ * @param cls The class to write
+ * @param journal_id The journal that will extend this image, or 0 for none
+ * @param journal_lsn The last journal entry that the image includes
+ * @param length Set to the number of bytes written
+ * @return int 0 on success, -1 if a write failed or memory ran out
+ */
+int writeCompactImage(FILE *fp, const classroom *cls, uint64_t journal_id, uint64_t journal_lsn, uint64_t *length)
+{
+    unsigned char header[COMPACT_HEADER_SIZE];
+    const name_pool *pool = &cls->names;
+    size_t pool_size = pool->base != NULL ? pool->used : 1;
+    uint64_t started = statsNow();
+    uint64_t written = COMPACT_HEADER_SIZE;
+    uint32_t name_count = 0;
+    int num = cls->num;
+
+    // MEM35-C: A class has no more distinct names than students, and no block is longer than COMPACT_BLOCK_MAX
+    uint32_t *rank = calloc(pool_size, sizeof(uint32_t)); // By name offset: its place in the dictionary plus one
+    const char **names = malloc((num > 0 ? (size_t)num : 1) * sizeof(char *));
+    unsigned char *block = malloc(COMPACT_BLOCK_MAX + 16);
+    int failed = rank == NULL || names == NULL || block == NULL;
+
+    for (int i = 0; i < num && !failed; i++)
+    {
+        uint32_t offset = cls->chunks[i >> CHUNK_SHIFT]->names[i & (CHUNK_STUDENTS - 1)];
+        if (rank[offset] == 0)
+        {
+            rank[offset] = 1;
+            names[name_count++] = pool->base + offset;
+        }
+    }
+    if (!failed)
+    {
+        qsort(names, name_count, sizeof(char *), compareStrings);
+        for (uint32_t k = 0; k < name_count; k++)
+        {
+            rank[names[k] - pool->base] = k + 1;
+        }
+    }
+
+    memset(header, 0, COMPACT_HEADER_SIZE);
+    memcpy(header, COMPACT_FILE_MAGIC, 8);
+    putLE32(header + 8, COMPACT_FILE_VERSION);
+    putLE32(header + 12, (uint32_t)num);
+    putLE32(header + 16, name_count);
+    putLE32(header + 20, COMPACT_BLOCK);
+    putLE64(header + 24, journal_id);
+    putLE64(header + 32, journal_lsn);
+    memcpy(header + 40, cls->category, CLASS_CODE_LENGTH);
+    memcpy(header + 50, cls->course_num, CLASS_CODE_LENGTH);
+    memcpy(header + 60, cls->section_num, CLASS_CODE_LENGTH);
+    putLE64(header + COMPACT_HEADER_SIZE - 8, checksum64(header, COMPACT_HEADER_SIZE - 8, CHECKSUM_INIT));
+    failed |= fwrite(header, COMPACT_HEADER_SIZE, 1, fp) != 1;
+
+    // Front coding restarts with each block, so every block decodes without the ones before it
+    for (uint32_t k = 0; k < name_count && !failed; k += COMPACT_BLOCK)
+    {
+        uint32_t n = name_count - k < COMPACT_BLOCK ? name_count - k : COMPACT_BLOCK;
+        const char *prev = "";
+        size_t prev_len = 0;
+        size_t len = 8;
+        for (uint32_t m = k; m < k + n; m++)
+        {
+            size_t name_len = strnlen(names[m], NAME_LENGTH - 1);
+            size_t shared = 0;
+            while (shared < prev_len && shared < name_len && prev[shared] == names[m][shared])
+            {
+                shared++;
+            }
+            len += putVarint(block + len, (uint32_t)shared);
+            len += putVarint(block + len, (uint32_t)(name_len - shared));
+            memcpy(block + len, names[m] + shared, name_len - shared);
+            len += name_len - shared;
+            prev = names[m];
+            prev_len = name_len;
+        }
+        failed |= writeCompactBlock(fp, block, len, n) != 0;
+        written += len + 8;
+    }
+
+    for (int i = 0; i < num && !failed; i += COMPACT_BLOCK)
+    {
+        int n = num - i < COMPACT_BLOCK ? num - i : COMPACT_BLOCK;
+        uint32_t max_rank = 0;
+        uint64_t bits = 0;
+        int width = 0;
+        int pending = 0;
+        size_t len = 8;
+
+        for (int k = i; k < i + n; k++)
+        {
+            uint32_t r = rank[cls->chunks[k >> CHUNK_SHIFT]->names[k & (CHUNK_STUDENTS - 1)]] - 1;
+            max_rank = r > max_rank ? r : max_rank;
+        }
+        while (width < 32 && (max_rank >> width) != 0)
+        {
+            width++;
+        }
+        block[len++] = (unsigned char)width;
+        for (int k = i; k < i + n; k++)
+        {
+            bits |= (uint64_t)(rank[cls->chunks[k >> CHUNK_SHIFT]->names[k & (CHUNK_STUDENTS - 1)]] - 1) << pending;
+            for (pending += width; pending >= 8; pending -= 8)
+            {
+                block[len++] = (unsigned char)bits;
+                bits >>= 8;
+            }
+        }
+        if (pending > 0)
+        {
+            block[len++] = (unsigned char)bits;
+        }
+        memset(block + len, 0, (size_t)(n + 3) / 4);
+        for (int k = 0; k < n; k++)
+        {
+            block[len + k / 4] |= (unsigned char)(cls->chunks[(i + k) >> CHUNK_SHIFT]->genders[(i + k) & (CHUNK_STUDENTS - 1)] << (2 * (k % 4)));
+        }
+        len += (size_t)(n + 3) / 4;
+        for (int k = i; k < i + n; k++)
+        {
+            len += putVarint(block + len, cls->chunks[k >> CHUNK_SHIFT]->ages[k & (CHUNK_STUDENTS - 1)]);
+        }
+        failed |= writeCompactBlock(fp, block, len, (uint32_t)n) != 0;
+        written += len + 8;
+    }
+
+    free(rank);
+    free(names);
+    free(block);
+    *length = written;
+    statsAdd(STAT_CLASS_WRITE, statsNow() - started, written);
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Frames and writes one block of a compact class file
+ *
+ * @param fp The file to write
+ * @param block The block, with 8 bytes left free for its length and count before the payload and 8 after it
+ *              for its checksum
+ * @param len The length of the block, counting the 8 bytes before the payload
+ * @param count The number of names or students in the block
+ * @return int 0 on success, -1 if the write failed
+ */
+int writeCompactBlock(FILE *fp, unsigned char *block, size_t len, uint32_t count)
+{
+    putLE32(block, (uint32_t)(len - 8));
+    putLE32(block + 4, count);
+    putLE64(block + len, checksum64(block, len, CHECKSUM_INIT));
+    return fwrite(block, len + 8, 1, fp) == 1 ? 0 : -1;
+}
+
+/**
+ * @brief Reads a compact class file (see writeCompactImage) one block at a time
+ *
+ * Only a block is held at once besides the class itself, so the file is never read into memory whole.
+ *
+ * @param path The class file to read
+ * @param cls Filled with the class code and students
+ * @param header Filled with the record count, name table size and journal of the file (may be NULL)
+ * @return int 0 on success, 1 if the file is not a compact class file, -1 if it cannot be read or memory ran
+ *             out, -2 if it is truncated, corrupt or from an unsupported version
+ */
+int loadCompactClassFile(const char *path, classroom *cls, class_header *header)
+{
+    unsigned char head[COMPACT_HEADER_SIZE];
+    uint64_t started = statsNow();
+    uint64_t read_bytes = COMPACT_HEADER_SIZE;
+    char name[NAME_LENGTH];
+    int status = 0;
+
+    // FIO24-C: file opened only once
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    if (fread(head, COMPACT_HEADER_SIZE, 1, fp) != 1 || memcmp(head, COMPACT_FILE_MAGIC, 8) != 0)
+    {
+        fclose(fp);
+        return 1;
+    }
+    uint32_t count = getLE32(head + 12);
+    uint32_t name_count = getLE32(head + 16);
+    if (getLE64(head + COMPACT_HEADER_SIZE - 8) != checksum64(head, COMPACT_HEADER_SIZE - 8, CHECKSUM_INIT)
+        || getLE32(head + 8) != COMPACT_FILE_VERSION || getLE32(head + 20) != COMPACT_BLOCK
+        || count > MAX_STUDENTS || name_count > count)
+    {
+        fclose(fp);
+        return -2;
+    }
+
+    // MEM35-C: One offset per dictionary name, and one block buffer of the largest size a block may have
+    uint32_t *offsets = malloc((name_count > 0 ? name_count : 1) * sizeof(uint32_t));
+    unsigned char *block = malloc(COMPACT_BLOCK_MAX + 16);
+    cls->names.base = malloc(NAME_POOL_MIN);
+    if (offsets == NULL || block == NULL || cls->names.base == NULL || reserveStudents(cls, (int)count) != 0)
+    {
+        status = -1;
+    }
+    else
+    {
+        // The pool is filled without an intern table; the first name added later builds one (see ownNamePool)
+        cls->names.base[0] = '\0';
+        cls->names.used = 1;
+        cls->names.capacity = NAME_POOL_MIN;
+    }
+
+    for (uint32_t k = 0; k < name_count && status == 0; )
+    {
+        size_t len;
+        uint32_t n;
+        if (readCompactBlock(fp, block, &len, &n) != 0 || n == 0 || n > COMPACT_BLOCK || n > name_count - k)
+        {
+            status = -2;
+            break;
+        }
+        read_bytes += len + 16;
+        const unsigned char *p = block + 8;
+        const unsigned char *end = p + len;
+        uint32_t name_len = 0;
+        for (uint32_t m = 0; m < n && status == 0; m++, k++)
+        {
+            uint32_t shared;
+            uint32_t rest;
+            // STR31-C: The shared prefix and the rest must fit the name buffer with its terminator
+            if (getVarint(&p, end, &shared) != 0 || getVarint(&p, end, &rest) != 0 || shared > name_len
+                || rest > NAME_LENGTH - 1 - shared || rest > (size_t)(end - p))
+            {
+                status = -2;
+                break;
+            }
+            memcpy(name + shared, p, rest);
+            p += rest;
+            name_len = shared + rest;
+            name[name_len] = '\0';
+            // STR32-C: A name with a terminator inside it would not read back as the name that was stored
+            if (memchr(name, '\0', name_len) != NULL)
+            {
+                status = -2;
+            }
+            else if (appendName(&cls->names, name, name_len, &offsets[k]) != 0)
+            {
+                status = -1;
+            }
+        }
+        if (status == 0 && p != end)
+        {
+            status = -2;
+        }
+    }
+
+    for (uint32_t i = 0; i < count && status == 0; i += COMPACT_BLOCK)
+    {
+        uint32_t expected = count - i < COMPACT_BLOCK ? count - i : COMPACT_BLOCK;
+        size_t len;
+        uint32_t n;
+        if (readCompactBlock(fp, block, &len, &n) != 0 || n != expected || len < 1)
+        {
+            status = -2;
+            break;
+        }
+        read_bytes += len + 16;
+        const unsigned char *p = block + 8;
+        const unsigned char *end = p + len;
+        int width = *p++;
+        size_t packed = ((size_t)n * width + 7) / 8;
+        size_t gender_bytes = ((size_t)n + 3) / 4;
+        if (width > 32 || packed + gender_bytes > (size_t)(end - p))
+        {
+            status = -2;
+            break;
+        }
+        const unsigned char *genders = p + packed;
+        const unsigned char *ages = genders + gender_bytes;
+        uint64_t bits = 0;
+        int pending = 0;
+        for (uint32_t k = 0; k < n && status == 0; k++)
+        {
+            uint32_t index = i + k;
+            student_chunk *chunk = cls->chunks[index >> CHUNK_SHIFT];
+            int j = index & (CHUNK_STUDENTS - 1);
+            int gender = (genders[k / 4] >> (2 * (k % 4))) & 3;
+            uint32_t age;
+            while (pending < width)
+            {
+                bits |= (uint64_t)*p++ << pending;
+                pending += 8;
+            }
+            uint32_t r = (uint32_t)(bits & (((uint64_t)1 << width) - 1));
+            bits >>= width;
+            pending -= width;
+            if (r >= name_count || !isValidGender(gender) || getVarint(&ages, end, &age) != 0 || !isValidAge((int)age))
+            {
+                status = -2;
+                break;
+            }
+            chunk->names[j] = offsets[r];
+            chunk->genders[j] = (unsigned char)gender;
+            chunk->ages[j] = (unsigned char)age;
+        }
+        if (status == 0 && ages != end)
+        {
+            status = -2;
+        }
+    }
+    free(offsets);
+    free(block);
+    fclose(fp);
+    statsAdd(STAT_COMPACT_READ, statsNow() - started, read_bytes);
+
+    if (status != 0)
+    {
+        releaseClass(cls);
+        return status;
+    }
+    // STR32-C: The class code fields are always null-terminated, even in a damaged file
+    memcpy(cls->category, head + 40, CLASS_CODE_LENGTH);
+    memcpy(cls->course_num, head + 50, CLASS_CODE_LENGTH);
+    memcpy(cls->section_num, head + 60, CLASS_CODE_LENGTH);
+    cls->category[CLASS_CODE_LENGTH - 1] = '\0';
+    cls->course_num[CLASS_CODE_LENGTH - 1] = '\0';
+    cls->section_num[CLASS_CODE_LENGTH - 1] = '\0';
+    cls->num = (int)count;
+    if (header != NULL)
+    {
+        memset(header, 0, sizeof(*header));
+        header->record_count = count;
+        header->names_size = cls->names.used;
+        header->journal_id = getLE64(head + 24);
+        header->journal_lsn = getLE64(head + 32);
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads one block of a compact class file and checks it against its checksum
+ *
+ * @param fp The file to read
+ * @param block Filled with the block, its payload starting 8 bytes in; COMPACT_BLOCK_MAX + 16 bytes long
+ * @param len Set to the length of the payload
+ * @param count Set to the number of names or students in the block
+ * @return int 0 on success, -1 if the block is truncated, too long or corrupt
+ */
+int readCompactBlock(FILE *fp, unsigned char *block, size_t *len, uint32_t *count)
+{
+    if (fread(block, 8, 1, fp) != 1)
+    {
+        return -1;
+    }
+    *len = getLE32(block);
+    *count = getLE32(block + 4);
+    if (*len > COMPACT_BLOCK_MAX || fread(block + 8, *len + 8, 1, fp) != 1)
+    {
+        return -1;
+    }
+    return getLE64(block + 8 + *len) == checksum64(block, 8 + *len, CHECKSUM_INIT) ? 0 : -1;
+}
+
+/**
+ * @brief Reads a class file in any format: mapped in place when it can be, otherwise decoded
+ *
+ * @param path The class file to read
+ * @param cls Filled with the class code and students
+ * @param header Filled with the file's header (may be NULL); left alone for a file from before the versioned format
+ * @param lazy Nonzero to open a file in the current format by its header alone (see openClassFile); files in
+ *             the other formats are always read whole
+ * @return int 0 on success, -1 if the file cannot be read or memory ran out, -2 if it is truncated, corrupt
+ *             or from an unsupported version
+ */
+int readClassFile(const char *path, classroom *cls, class_header *header, int lazy)
+{
+    int status = lazy ? openClassFile(path, cls, header) : mapClassFile(path, cls, header);
+
+    if (status == 1)
+    {
+        status = loadCompactClassFile(path, cls, header);
+    }
+    if (status == 1)
+    {
+        status = loadLegacyClassFile(path, cls);
+    }
+    return status;
+}
+
+/**
+ * @brief Stores a value as a varint: seven bits per byte, low bits first, the top bit set on all but the last
+ *
+ * @param p Where to store it; up to 5 bytes
+ * @return size_t The number of bytes stored
+ */
+size_t putVarint(unsigned char *p, uint32_t value)
+{
+    size_t len = 0;
+
+    while (value >= 0x80)
+    {
+        p[len++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    p[len++] = (unsigned char)value;
+    return len;
+}
+
+/**
+ * @brief Reads a varint (see putVarint)
+ *
+ * @param p The position to read from; moved past the varint
+ * @param end The end of the bytes that may be read
+ * @param value Set to the value
+ * @return int 0 on success, -1 if the varint runs past end or past 32 bits
+ */
+int getVarint(const unsigned char **p, const unsigned char *end, uint32_t *value)
+{
+    uint32_t result = 0;
+
+    for (int shift = 0; shift < 35 && *p < end; shift += 7)
+    {
+        unsigned char byte = *(*p)++;
+        if (shift == 28 && byte > 0x0F)
+        {
+            return -1;
+        }
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Adds a name to the end of a name pool that has no intern table yet, without looking for a copy of it
+ *
+ * @param pool The name pool, with memory of its own
+ * @param name The name, shorter than NAME_LENGTH characters
+ * @param len The length of the name
+ * @param offset Set to the name's offset in the pool
+ * @return int 0 on success, -1 if memory ran out or the pool is full
+ */
+int appendName(name_pool *pool, const char *name, size_t len, uint32_t *offset)
+{
+    // INT30-C: Offsets are 32-bit, so the pool stops growing before they would wrap
+    if (len + 1 > UINT32_MAX / 2 - pool->used)
+    {
+        return -1;
+    }
+    if (pool->used + len + 1 > pool->capacity)
+    {
+        uint32_t capacity = pool->capacity;
+        while (capacity < pool->used + len + 1)
+        {
+            capacity *= 2;
+        }
+        char *base = realloc(pool->base, capacity);
+        if (base == NULL)
+        {
+            return -1;
+        }
+        pool->base = base;
+        pool->capacity = capacity;
+    }
+    memcpy(pool->base + pool->used, name, len + 1);
+    *offset = pool->used;
+    pool->used += (uint32_t)len + 1;
+    return 0;
+}
+
+/**
+ * @brief Maps a whole file privately into memory with one reference held by the caller
+ *
+ * The private, writable mapping lets classes be edited in memory without touching the file.
+ *
+ * @param path The file to map
+ * @param status Set to -1 if the file cannot be read, 1 if it is too short to hold a header
+ * @return file_map* The mapping, or NULL on failure
+ */
+file_map *mapFile(const char *path, int *status)
+{
+    struct stat st;
+    file_map *map;
+    void *addr;
+    uint64_t start = statsNow();
+    int fd = open(path, O_RDONLY);
+
+    *status = -1;
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    if ((size_t)st.st_size < CLASS_HEADER_SIZE)
+    {
+        close(fd);
+        *status = 1;
+        return NULL;
+    }
+
+    addr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping holds its own reference to the file
+    if (addr == MAP_FAILED)
+    {
+        return NULL;
+    }
+    if ((map = malloc(sizeof(file_map))) == NULL)
+    {
+        munmap(addr, (size_t)st.st_size);
+        return NULL;
+    }
+    map->addr = addr;
+    map->len = (size_t)st.st_size;
+    map->refs = 1;
+    map->stream = 0;
+    *status = 0;
+    statsAdd(STAT_CLASS_MAP, statsNow() - start, map->len);
+    return map;
+}
+
+/**
+ * @brief Drops one reference to a mapped file, unmapping it when no class uses it any more
+ *
+ * @param map The mapping
+ */
+void releaseMap(file_map *map)
+{
+    if (--map->refs == 0)
+    {
+        munmap(map->addr, map->len);
+        free(map);
+    }
+}
+
+/**
+ * @brief Releases the students of a class, whether they were allocated or mapped from a file
+ *
+ * @param cls The class; its code is kept and it is left with no students and no link to class_list
+ */
+void releaseClass(classroom *cls)
+{
+    if (cls->map != NULL)
+    {
+        releaseMap(cls->map);
+        cls->map = NULL;
+    }
+    // Chunks and names come from the class's own arena and pool, so releasing them does not walk the roster
+    arenaRelease(&cls->store);
+    releaseNamePool(&cls->names);
+    freeSnapshots(cls);
+    free(cls->chunks);
+    free(cls->dirty);
+    dropIndexes(cls);
+    // MEM01-C: The dangling pointers are cleared once their memory is released
+    cls->chunks = NULL;
+    cls->dirty = NULL;
+    cls->image = NULL;
+    cls->image_len = 0;
+    cls->num = 0;
+    cls->chunk_count = 0;
+    cls->chunk_capacity = 0;
+    cls->mapped_chunks = 0;
+    cls->dirty_count = 0;
+    cls->dirty_capacity = 0;
+    cls->saved_num = 0;
+    cls->file_id = 0;
+    cls->file_lsn = 0;
+}
+
+/**
+ * @brief Writes a class as a new class_list snapshot with a new, empty journal
+ *
+ * @param cls The class to write
+ * @return int 0 on success, 1 if a write failed
+ */
+int saveSnapshot(classroom *cls)
+{
+    uint64_t length;
+    uint64_t journal_id;
+    int failed = 0;
+    int fd;
+
+    // A running compaction would otherwise rename its older snapshot over this one
+    finishCompaction(1);
+
+    // MSC30-C: random() (seeded in logUser) only has to make a new journal id differ from the last one
+    do
+    {
+        journal_id = ((uint64_t)random() << 32) ^ (uint64_t)random() ^ (uint64_t)time(NULL);
+    } while (journal_id == 0 || journal_id == class_file_id);
+
+    // FIO24-C: file opened only once
+    FILE *fp = fopen(CLASS_FILE ".tmp", "wb");
+
+    if (fp == NULL)
+    {
+        return 1;
+    }
+    failed |= (compact_files ? writeCompactImage : writeClassImage)(fp, cls, journal_id, class_file_lsn, &length) != 0;
+    // FIO23-C: Buffered data is flushed and synced (and the file closed) before it is renamed into place, so
+    // a crash cannot leave class_list naming a file whose data never reached the disk
+    failed |= fflush(fp) != 0 || fsync(fileno(fp)) != 0;
+    failed |= fclose(fp) != 0;
+    failed |= !failed && rename(CLASS_FILE ".tmp", CLASS_FILE) != 0;
+    if (failed)
+    {
+        remove(CLASS_FILE ".tmp");
+        return 1;
+    }
+
+    // The old journal belongs to the old snapshot, which its id no longer matches, so replacing it after the
+    // rename is safe even if the program stops in between
+    fd = open(JOURNAL_FILE ".tmp", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    failed |= fd < 0 || writeJournalHeader(fd, journal_id) != 0 || fsync(fd) != 0;
+    failed |= fd >= 0 && close(fd) != 0;
+    failed |= !failed && rename(JOURNAL_FILE ".tmp", JOURNAL_FILE) != 0;
+    if (failed)
+    {
+        remove(JOURNAL_FILE ".tmp");
+        return 1;
+    }
+
+    class_file_id = journal_id;
+    snapshot_bytes = (off_t)length;
+    journal_bytes = JOURNAL_HEADER_SIZE;
+    cls->file_id = class_file_id;
+    cls->file_lsn = class_file_lsn;
+    cls->saved_num = cls->num;
+    cls->dirty_count = 0;
+    return 0;
+}
+
+/**
+ * @brief Appends the students changed since the last save to class_list's journal
+ *
+ * The entries and the commit entry that ends them go out in a single write and are synced before the save
+ * is reported. A save interrupted before its commit entry reached the disk is ignored by replayJournal; one
+ * that failed here is cut off again, or the next save writes a new snapshot if that fails too.
+ *
+ * @param cls The class, last saved to or loaded from class_list
+ * @return int 0 on success, 1 if a write failed
+ */
+int appendJournal(classroom *cls)
+{
+    unsigned char *buffer;
+    unsigned char *entry;
+    size_t used = 0;
+    uint64_t lsn = class_file_lsn;
+    uint32_t entries = 0;
+    off_t before = -1;
+    int failed = 0;
+    int fd;
+
+    // Each student is written once, in index order, after the entry that resizes the class
+    if (cls->dirty_count > 0)
+    {
+        qsort(cls->dirty, cls->dirty_count, sizeof(int), compareInts);
+    }
+    // MEM35-C: Room for the longest entry per changed student plus the resize and commit entries
+    if ((buffer = calloc((size_t)cls->dirty_count + 2, JOURNAL_ENTRY_MAX)) == NULL)
+    {
+        return 1;
+    }
+    if (cls->num != cls->saved_num)
+    {
+        entry = buffer + used;
+        putLE64(entry, ++lsn);
+        putLE32(entry + 8, JOURNAL_COUNT);
+        putLE32(entry + 12, (uint32_t)cls->num);
+        putLE64(entry + JOURNAL_ENTRY_FIXED - 8, checksum64(entry, JOURNAL_ENTRY_FIXED - 8, CHECKSUM_INIT));
+        used += JOURNAL_ENTRY_FIXED;
+        entries++;
+    }
+    for (int i = 0; i < cls->dirty_count; i++)
+    {
+        int index = cls->dirty[i];
+        if ((i > 0 && index == cls->dirty[i - 1]) || index >= cls->num)
+        {
+            continue; // Changed twice, or removed again since
+        }
+        const student_chunk *chunk = cls->chunks[index >> CHUNK_SHIFT];
+        int j = index & (CHUNK_STUDENTS - 1);
+        const char *name = cls->names.base + chunk->names[j];
+        size_t name_len = strnlen(name, NAME_LENGTH - 1);
+        size_t length = JOURNAL_ENTRY_FIXED + ((name_len + 7) & ~(size_t)7);
+
+        entry = buffer + used;
+        putLE64(entry, ++lsn);
+        putLE32(entry + 8, JOURNAL_SET);
+        putLE32(entry + 12, (uint32_t)index);
+        putLE32(entry + 16, chunk->genders[j]);
+        putLE32(entry + 20, chunk->ages[j]);
+        putLE32(entry + 24, (uint32_t)name_len);
+        memcpy(entry + 32, name, name_len);
+        putLE64(entry + length - 8, checksum64(entry, length - 8, CHECKSUM_INIT));
+        used += length;
+        entries++;
+    }
+
+    if (used > 0)
+    {
+        uint64_t start = statsNow();
+
+        entry = buffer + used;
+        putLE64(entry, lsn);
+        putLE32(entry + 8, JOURNAL_COMMIT);
+        putLE32(entry + 12, entries);
+        putLE64(entry + JOURNAL_ENTRY_FIXED - 8, checksum64(entry, JOURNAL_ENTRY_FIXED - 8, CHECKSUM_INIT));
+        used += JOURNAL_ENTRY_FIXED;
+
+        fd = open(JOURNAL_FILE, O_WRONLY | O_APPEND);
+        failed |= fd < 0 || (before = lseek(fd, 0, SEEK_END)) < 0;
+        failed |= !failed && write(fd, buffer, used) != (ssize_t)used;
+        failed |= !failed && fdatasync(fd) != 0;
+        // A partly written save is cut off, so that the next save's commit entry cannot complete it
+        if (failed && (before < 0 || ftruncate(fd, before) != 0 || fdatasync(fd) != 0))
+        {
+            cls->file_id = 0;
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        statsAdd(STAT_JOURNAL_APPEND, statsNow() - start, used);
+    }
+    free(buffer);
+    if (failed)
+    {
+        return 1;
+    }
+
+    journal_bytes += (off_t)used;
+    class_file_lsn = lsn;
+    cls->file_lsn = lsn;
+    cls->saved_num = cls->num;
+    cls->dirty_count = 0;
+    return 0;
+}
+
+/**
+ * @brief Tells which version of the journal format a journal header belongs to
+ *
+ * @param header The JOURNAL_HEADER_SIZE bytes at the start of the journal
+ * @return int 3 for the current format, 2 for entries without commit entries, 1 for fixed-size entries,
+ *             0 if it is not a journal
+ */
+int journalFormat(const unsigned char *header)
+{
+    if (memcmp(header, JOURNAL_MAGIC, 8) == 0)
+    {
+        return 3;
+    }
+    if (memcmp(header, JOURNAL_MAGIC_V2, 8) == 0)
+    {
+        return 2;
+    }
+    return memcmp(header, JOURNAL_MAGIC_V1, 8) == 0 ? 1 : 0;
+}
+
+/**
+ * @brief Reads the next journal entry and checks it
+ *
+ * @param fp The journal, positioned at an entry
+ * @param format The journal's format, from journalFormat
+ * @param entry Filled with the entry; must hold JOURNAL_ENTRY_MAX bytes
+ * @param length Set to the entry's length
+ * @return int 1 if a whole entry passed its checksum, 0 at the end of the journal or a torn entry
+ */
+int readJournalEntry(FILE *fp, int format, unsigned char *entry, size_t *length)
+{
+    size_t len = format == 1 ? JOURNAL_ENTRY_V1_SIZE : JOURNAL_ENTRY_FIXED;
+
+    if (fread(entry, len, 1, fp) != 1)
+    {
+        return 0;
+    }
+    if (format != 1 && getLE32(entry + 8) == JOURNAL_SET)
+    {
+        uint32_t name_len = getLE32(entry + 24);
+        // STR31-C: A name longer than the program can hold means the entry is damaged
+        if (name_len > NAME_LENGTH - 1)
+        {
+            return 0;
+        }
+        size_t extra = ((size_t)name_len + 7) & ~(size_t)7;
+        if (extra > 0 && fread(entry + len, extra, 1, fp) != 1)
+        {
+            return 0;
+        }
+        len += extra;
+    }
+    *length = len;
+    return getLE64(entry + len - 8) == checksum64(entry, len - 8, CHECKSUM_INIT);
+}
+
+/**
+ * @brief Applies the journal entries that came after a class_list snapshot
+ *
+ * Entries belonging to another snapshot are ignored. A save is applied only if its commit entry follows
+ * it intact, so an interrupted save is skipped as a whole; journal_bytes is set to the end of the last
+ * whole save, where the journal can be cut.
+ *
+ * @param cls The class loaded from the snapshot
+ * @param header The snapshot's header
+ * @param last_lsn Set to the LSN of the last change included in cls
+ * @return int 0 on success, 1 if the journal is in an old format (so the next save should start a new one),
+ *             -1 if memory ran out or an entry does not fit the class
+ */
+int replayJournal(classroom *cls, const class_header *header, uint64_t *last_lsn)
+{
+    unsigned char entry[JOURNAL_ENTRY_MAX];
+    unsigned char journal_header[JOURNAL_HEADER_SIZE];
+    class_header layout; // Version 1 entries hold a student in the layout of a version 1 class file record
+    student s;
+    uint64_t lsn = header->journal_lsn;
+    uint64_t entry_lsn = 0;
+    off_t committed = JOURNAL_HEADER_SIZE;
+    off_t offset = JOURNAL_HEADER_SIZE;
+    uint32_t entries = 0;
+    size_t length;
+    int format;
+    int status = 0;
+    uint64_t start = statsNow();
+    FILE *fp = fopen(JOURNAL_FILE, "rb");
+
+    memset(&layout, 0, sizeof(layout));
+    layout.gender_offset = CLASS_RECORD_GENDER;
+    layout.age_offset = CLASS_RECORD_AGE;
+    *last_lsn = lsn;
+    journal_bytes = 0;
+    snapshot_bytes = (off_t)classImageLength((int)header->record_count, header->names_size);
+    if (fp == NULL)
+    {
+        return 0;
+    }
+    if (fread(journal_header, JOURNAL_HEADER_SIZE, 1, fp) != 1 || (format = journalFormat(journal_header)) == 0
+        || getLE64(journal_header + 8) != header->journal_id)
+    {
+        fclose(fp);
+        return 0;
+    }
+
+    // First pass: find the end of the last save whose commit entry matches the entries before it
+    while (readJournalEntry(fp, format, entry, &length))
+    {
+        offset += (off_t)length;
+        if (format < 3)
+        {
+            committed = offset; // Older journals were written without commit entries
+        }
+        else if (getLE32(entry + 8) != JOURNAL_COMMIT)
+        {
+            entry_lsn = getLE64(entry);
+            entries++;
+        }
+        else if (getLE32(entry + 12) == entries && entries > 0 && getLE64(entry) == entry_lsn)
+        {
+            committed = offset;
+            entries = 0;
+        }
+        else
+        {
+            break;
+        }
+    }
+    journal_bytes = committed;
+
+    // Second pass: apply the committed saves
+    offset = JOURNAL_HEADER_SIZE;
+    if (fseek(fp, JOURNAL_HEADER_SIZE, SEEK_SET) != 0)
+    {
+        status = -1;
+    }
+    while (status == 0 && offset < committed && readJournalEntry(fp, format, entry, &length))
+    {
+        uint32_t op = getLE32(entry + 8);
+        uint32_t value = getLE32(entry + 12);
+
+        entry_lsn = getLE64(entry);
+        offset += (off_t)length;
+        if (entry_lsn <= lsn || op == JOURNAL_COMMIT)
+        {
+            continue; // Already folded into the snapshot by a compaction
+        }
+        // A snapshot opened by its header alone has its students brought in by the first change to it
+        if ((status = pageInClass(cls)) != 0)
+        {
+            break;
+        }
+        if (op == JOURNAL_COUNT && value <= MAX_STUDENTS)
+        {
+            status = resizeClass(cls, (int)value);
+        }
+        else if (op == JOURNAL_SET && value < (uint32_t)cls->num)
+        {
+            if (format == 1)
+            {
+                decodeStudent(entry + 16, &layout, &s);
+            }
+            else
+            {
+                uint32_t name_len = getLE32(entry + 24);
+                memcpy(s.name, entry + 32, name_len);
+                s.name[name_len] = '\0';
+                s.gender = (int)getLE32(entry + 16);
+                s.age = (int)getLE32(entry + 20);
+            }
+            if (!isValidGender(s.gender) || !isValidAge(s.age) || setStudent(cls, (int)value, &s) != 0)
+            {
+                status = -1;
+            }
+        }
+        else
+        {
+            status = -1;
+        }
+        lsn = entry_lsn;
+    }
+    fclose(fp);
+    *last_lsn = lsn;
+    statsAdd(STAT_JOURNAL_REPLAY, statsNow() - start, (uint64_t)journal_bytes);
+    return status == 0 && format < 3 ? 1 : status;
+}
+
+/**
+ * @brief Folds class_list's journal into a new snapshot in a background process
+ *
+ * The class is written as the new snapshot, exactly as of the last journal entry, to CLASS_FILE.compact.
+ * A child process then syncs it to disk and renames it into place while the program carries on.
+ * finishCompaction trims the journal once the child has finished.
+ *
+ * @param cls The class held in class_list
+ */
+void startCompaction(classroom *cls)
+{
+    uint64_t length;
+    pid_t pid;
+    int failed;
+
+    if (compaction_pid != 0)
+    {
+        return;
+    }
+    // POS47-C: The audit writer and any server clients are threads, so the child of the fork may only make
+    // async-signal-safe calls. Everything that allocates or uses stdio happens here, before the fork.
+    FILE *fp = fopen(CLASS_FILE ".compact", "wb");
+    if (fp == NULL)
+    {
+        return; // Compaction is only an optimisation; the journal stays valid without it
+    }
+    failed = (compact_files ? writeCompactImage : writeClassImage)(fp, cls, class_file_id, class_file_lsn, &length) != 0;
+    failed |= fclose(fp) != 0;
+    if (failed)
+    {
+        remove(CLASS_FILE ".compact");
+        return;
+    }
+    fflush(stdout); // Output buffered before the fork must not be written twice
+    if ((pid = fork()) == 0)
+    {
+        int fd = open(CLASS_FILE ".compact", O_WRONLY);
+
+        failed = fd < 0 || fsync(fd) != 0;
+        failed |= fd >= 0 && close(fd) != 0;
+        failed |= !failed && rename(CLASS_FILE ".compact", CLASS_FILE) != 0;
+        // ERR06-C: _exit skips the atexit handlers and stdio buffers that belong to the parent
+        _exit(failed ? 1 : 0);
+    }
+    if (pid < 0)
+    {
+        remove(CLASS_FILE ".compact");
+        return;
+    }
+    compaction_pid = pid;
+    compaction_lsn = class_file_lsn;
+    snapshot_bytes = (off_t)classImageLength(cls->num, cls->names.used);
+}
+
+/**
+ * @brief Collects a finished background compaction and drops the journal entries it folded in
+ *
+ * @param block 1 to wait for a running compaction, 0 to return at once if it is still running
+ */
+void finishCompaction(int block)
+{
+    int wstatus;
+    pid_t pid;
+
+    if (compaction_pid == 0)
+    {
+        return;
+    }
+    pid = waitpid(compaction_pid, &wstatus, block ? 0 : WNOHANG);
+    if (pid == 0)
+    {
+        return;
+    }
+    compaction_pid = 0;
+    if (pid < 0 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0)
+    {
+        remove(CLASS_FILE ".compact");
+        return; // The old snapshot and the whole journal are still in place
+    }
+    trimJournal(compaction_lsn);
+}
+
+/**
+ * @brief Rewrites class_list's journal without the entries up to lsn, which the snapshot now includes
+ *
+ * @param lsn The last LSN included in the snapshot
+ * @return int 0 on success, 1 if the journal could not be rewritten (it is then left as it was)
+ */
+int trimJournal(uint64_t lsn)
+{
+    unsigned char entry[JOURNAL_ENTRY_MAX];
+    unsigned char header[JOURNAL_HEADER_SIZE];
+    off_t kept = JOURNAL_HEADER_SIZE;
+    size_t length;
+    int format;
+    uint64_t start = statsNow();
+    int failed = 0;
+    FILE *in = fopen(JOURNAL_FILE, "rb");
+    FILE *out = fopen(JOURNAL_FILE ".tmp", "wb");
+
+    if (in == NULL || out == NULL || fread(header, JOURNAL_HEADER_SIZE, 1, in) != 1
+        || (format = journalFormat(header)) == 0)
+    {
+        failed = 1;
+    }
+    else
+    {
+        failed |= fwrite(header, JOURNAL_HEADER_SIZE, 1, out) != 1;
+        while (!failed && readJournalEntry(in, format, entry, &length))
+        {
+            if (getLE64(entry) > lsn)
+            {
+                failed |= fwrite(entry, length, 1, out) != 1;
+                kept += (off_t)length;
+            }
+        }
+    }
+    if (in != NULL)
+    {
+        fclose(in);
+    }
+    // FIO23-C: The trimmed journal is synced before it replaces the one holding the same saves
+    failed |= !failed && (fflush(out) != 0 || fsync(fileno(out)) != 0);
+    failed |= out != NULL && fclose(out) != 0;
+    failed |= !failed && rename(JOURNAL_FILE ".tmp", JOURNAL_FILE) != 0;
+    if (failed)
+    {
+        remove(JOURNAL_FILE ".tmp");
+        return 1;
+    }
+    journal_bytes = kept;
+    statsAdd(STAT_JOURNAL_TRIM, statsNow() - start, (uint64_t)kept);
+    return 0;
+}
+
+/**
+ * @brief Writes the header that ties a journal to its class_list snapshot
+ *
+ * @param fd The new journal file
+ * @param journal_id The id recorded in the snapshot
+ * @return int 0 on success, 1 if the write failed
+ */
+int writeJournalHeader(int fd, uint64_t journal_id)
+{
+    unsigned char header[JOURNAL_HEADER_SIZE];
+
+    memset(header, 0, JOURNAL_HEADER_SIZE);
+    memcpy(header, JOURNAL_MAGIC, 8);
+    putLE64(header + 8, journal_id);
+    return write(fd, header, JOURNAL_HEADER_SIZE) != JOURNAL_HEADER_SIZE;
+}
+
+/**
+ * @brief Records that a student was changed, so that the next save journals it
+ *
+ * @param cls The class
+ * @param index The position of the changed student
+ */
+void markDirty(classroom *cls, int index)
+{
+    if (cls->dirty_count == cls->dirty_capacity)
+    {
+        int capacity = cls->dirty_capacity > 0 ? cls->dirty_capacity * 2 : 64;
+        int *dirty = realloc(cls->dirty, capacity * sizeof(int));
+        if (dirty == NULL)
+        {
+            cls->file_id = 0; // Without the record of changes, the next save writes a full snapshot
+            return;
+        }
+        cls->dirty = dirty;
+        cls->dirty_capacity = capacity;
+    }
+    cls->dirty[cls->dirty_count++] = index;
+}
+
+/**
+ * @brief Changes the number of students in a class, adding zeroed students as needed
+ *
+ * Students past the new number keep their memory, so a class that shrinks can grow back without allocating.
+ * Added students have the empty name, which every name pool holds at offset 0.
+ *
+ * @param cls The class
+ * @param num The new number of students
+ * @return int 0 on success, -1 if memory ran out
+ */
+int resizeClass(classroom *cls, int num)
+{
+    if (reserveStudents(cls, num) != 0 || (cls->names.base == NULL && ownNamePool(&cls->names) != 0))
+    {
+        return -1;
+    }
+    // Students dropped from the end leave the search indexes, which only hold the first index_count students
+    for (int i = cls->index_count - 1; i >= num && cls->indexed; i--)
+    {
+        indexRemove(cls, i);
+    }
+    // Cleared a chunk at a time, since consecutive students are only contiguous within a chunk's columns
+    for (int i = cls->num; i < num; i = (i | (CHUNK_STUDENTS - 1)) + 1)
+    {
+        student_chunk *chunk = writableChunk(cls, i >> CHUNK_SHIFT);
+        int j = i & (CHUNK_STUDENTS - 1);
+        int end = (i | (CHUNK_STUDENTS - 1)) + 1;
+        size_t n = (size_t)((end < num ? end : num) - i);
+        if (chunk == NULL)
+        {
+            return -1;
+        }
+        memset(chunk->names + j, 0, n * sizeof(uint32_t));
+        memset(chunk->ages + j, 0, n);
+        memset(chunk->genders + j, 0, n);
+    }
+    cls->num = num;
+    return 0;
+}
+
+/**
+ * @brief Makes sure a class has room for count students
+ *
+ * Room is added a chunk at a time from the class's arena and the chunk table grows geometrically, so students
+ * already in the class never move and adding students one by one costs amortised O(1).
+ *
+ * @param cls The class
+ * @param count The number of students needed
+ * @return int 0 on success, -1 if memory ran out
+ */
+int reserveStudents(classroom *cls, int count)
+{
+    int needed = (int)(((long long)count + CHUNK_STUDENTS - 1) >> CHUNK_SHIFT);
+
+    if (needed > cls->chunk_capacity)
+    {
+        int capacity = cls->chunk_capacity > 0 ? cls->chunk_capacity : 4;
+        while (capacity < needed)
+        {
+            capacity *= 2;
+        }
+        student_chunk **chunks = realloc(cls->chunks, (size_t)capacity * sizeof(student_chunk *));
+        if (chunks == NULL)
+        {
+            return -1;
+        }
+        cls->chunks = chunks;
+        if (cls->chunk_gens != NULL)
+        {
+            uint32_t *gens = realloc(cls->chunk_gens, (size_t)capacity * sizeof(uint32_t));
+            if (gens == NULL)
+            {
+                return -1;
+            }
+            cls->chunk_gens = gens;
+        }
+        cls->chunk_capacity = capacity;
+    }
+    while (cls->chunk_count < needed)
+    {
+        // MEM35-C: Each chunk is allocated with room for exactly CHUNK_STUDENTS students
+        student_chunk *chunk = arenaAlloc(&cls->store, sizeof(student_chunk));
+        if (chunk == NULL)
+        {
+            return -1;
+        }
+        if (cls->chunk_gens != NULL)
+        {
+            cls->chunk_gens[cls->chunk_count] = cls->generation; // No snapshot holds a new chunk
+        }
+        cls->chunks[cls->chunk_count++] = chunk;
+    }
+    return 0;
+}
+
+/**
+ * @brief Makes a chunk of a class safe to write, copying it first if a snapshot may share it
+ *
+ * The copy comes from the class's arena; the chunk it replaces stays there for the snapshots that hold it.
+ *
+ * @param cls The class
+ * @param chunk The number of the chunk
+ * @return student_chunk* The chunk, now only the class's, or NULL if memory ran out
+ */
+student_chunk *writableChunk(classroom *cls, int chunk)
+{
+    student_chunk *copy;
+
+    if (cls->chunk_gens == NULL || cls->chunk_gens[chunk] == cls->generation)
+    {
+        return cls->chunks[chunk];
+    }
+    // MEM35-C: The copy is exactly one chunk
+    if ((copy = arenaAlloc(&cls->store, sizeof(student_chunk))) == NULL)
+    {
+        return NULL;
+    }
+    memcpy(copy, cls->chunks[chunk], sizeof(student_chunk));
+    cls->chunks[chunk] = copy;
+    cls->chunk_gens[chunk] = cls->generation;
+    return copy;
+}
+
+/**
+ * @brief Hands out memory from an arena, adding a block twice the size of the last one when it runs out
+ *
+ * @param a The arena
+ * @param size The number of bytes needed
+ * @return void* Memory aligned for any type, or NULL if memory ran out
+ */
+void *arenaAlloc(arena *a, size_t size)
+{
+    // MEM36-C: Sizes and the block header are rounded up so that every allocation stays suitably aligned
+    const size_t align = sizeof(max_align_t);
+    const size_t header = (sizeof(arena_block) + align - 1) & ~(align - 1);
+    arena_block *block = a->blocks;
+
+    size = (size + align - 1) & ~(align - 1);
+    if (block == NULL || block->size - block->used < size)
+    {
+        size_t block_size = a->next_size > 0 ? a->next_size : ARENA_FIRST_BLOCK;
+        while (block_size < size)
+        {
+            block_size *= 2;
+        }
+        if ((block = malloc(header + block_size)) == NULL)
+        {
+            return NULL;
+        }
+        block->next = a->blocks;
+        block->size = block_size;
+        block->used = 0;
+        a->blocks = block;
+        a->next_size = block_size < ARENA_MAX_BLOCK ? block_size * 2 : block_size;
+    }
+    void *p = (unsigned char *)block + header + block->used;
+    block->used += size;
+    return p;
+}
+
+/**
+ * @brief Releases everything an arena has handed out
+ *
+ * @param a The arena, left empty
+ */
+void arenaRelease(arena *a)
+{
+    while (a->blocks != NULL)
+    {
+        arena_block *next = a->blocks->next;
+        free(a->blocks);
+        a->blocks = next;
+    }
+    a->next_size = 0;
+}
+
+/**
+ * @brief Finds a name in a name pool, adding it if it is not there yet
+ *
+ * @param pool The name pool
+ * @param name The name, shorter than NAME_LENGTH characters
+ * @param offset Set to the name's offset in the pool
+ * @return int 0 on success, -1 if memory ran out or the pool is full
+ */
+int internName(name_pool *pool, const char *name, uint32_t *offset)
+{
+    size_t len = strlen(name);
+    uint32_t mask;
+    uint32_t i;
+
+    if (pool->slots == NULL && ownNamePool(pool) != 0)
+    {
+        return -1;
+    }
+    mask = pool->slot_count - 1;
+    for (i = hashName(name) & mask; pool->slots[i] != 0; i = (i + 1) & mask)
+    {
+        if (strcmp(pool->base + pool->slots[i] - 1, name) == 0)
+        {
+            *offset = pool->slots[i] - 1;
+            return 0;
+        }
+    }
+
+    // INT30-C: Offsets are 32-bit, so the pool stops growing before they would wrap
+    if (len + 1 > UINT32_MAX / 2 - pool->used)
+    {
+        return -1;
+    }
+    if (pool->used + len + 1 > pool->capacity)
+    {
+        uint32_t capacity = pool->capacity;
+        while (capacity < pool->used + len + 1)
+        {
+            capacity *= 2;
+        }
+        char *base = realloc(pool->base, capacity);
+        if (base == NULL)
+        {
+            return -1;
+        }
+        pool->base = base;
+        pool->capacity = capacity;
+    }
+    if (2 * (pool->interned + 1) > pool->slot_count)
+    {
+        // Keeps the load factor at or below 1/2 by doubling the intern table and reinserting every name
+        uint32_t slot_count = pool->slot_count * 2;
+        uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+        if (slots == NULL)
+        {
+            return -1;
+        }
+        for (uint32_t k = 0; k < pool->slot_count; k++)
+        {
+            if (pool->slots[k] != 0)
+            {
+                uint32_t j = hashName(pool->base + pool->slots[k] - 1) & (slot_count - 1);
+                while (slots[j] != 0)
+                {
+                    j = (j + 1) & (slot_count - 1);
+                }
+                slots[j] = pool->slots[k];
+            }
+        }
+        free(pool->slots);
+        pool->slots = slots;
+        pool->slot_count = slot_count;
+        for (i = hashName(name) & (slot_count - 1); slots[i] != 0; i = (i + 1) & (slot_count - 1))
+        {
+        }
+    }
+
+    memcpy(pool->base + pool->used, name, len + 1);
+    *offset = pool->used;
+    pool->slots[i] = pool->used + 1;
+    pool->used += (uint32_t)len + 1;
+    pool->interned++;
+    return 0;
+}
+
+/**
+ * @brief Looks a name up in a name pool's intern table without adding it
+ *
+ * @param pool The name pool, which must have an intern table
+ * @param name The name
+ * @param offset Set to the name's offset in the pool if it is there
+ * @return int 0 if the name is in the pool, -1 otherwise
+ */
+int findName(const name_pool *pool, const char *name, uint32_t *offset)
+{
+    uint32_t mask = pool->slot_count - 1;
+
+    for (uint32_t i = hashName(name) & mask; pool->slots[i] != 0; i = (i + 1) & mask)
+    {
+        if (strcmp(pool->base + pool->slots[i] - 1, name) == 0)
+        {
+            *offset = pool->slots[i] - 1;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Gives a name pool its own writable memory and intern table, ready for names to be added
+ *
+ * A pool that points into a mapped file is copied, and its names are entered into the new intern table; an
+ * empty pool starts with just the empty name.
+ *
+ * @param pool The name pool
+ * @return int 0 on success, -1 if memory ran out
+ */
+int ownNamePool(name_pool *pool)
+{
+    uint32_t used = pool->base != NULL ? pool->used : 1;
+    uint32_t capacity = NAME_POOL_MIN;
+    uint32_t slot_count = NAME_SLOTS_MIN;
+    uint32_t names = 0;
+    uint32_t *slots;
+    char *base;
+
+    if (pool->capacity > 0)
+    {
+        base = pool->base;
+        capacity = pool->capacity;
+    }
+    else
+    {
+        while (capacity < used)
+        {
+            capacity *= 2;
+        }
+        if ((base = malloc(capacity)) == NULL)
+        {
+            return -1;
+        }
+        if (pool->base != NULL)
+        {
+            memcpy(base, pool->base, used);
+        }
+        else
+        {
+            base[0] = '\0';
+        }
+    }
+
+    for (uint32_t at = 0; at < used; at += (uint32_t)strlen(base + at) + 1)
+    {
+        names++;
+    }
+    while (slot_count < 2 * names)
+    {
+        slot_count *= 2;
+    }
+    if ((slots = calloc(slot_count, sizeof(uint32_t))) == NULL)
+    {
+        if (base != pool->base)
+        {
+            free(base);
+        }
+        return -1;
+    }
+    names = 0;
+    for (uint32_t at = 0; at < used; at += (uint32_t)strlen(base + at) + 1)
+    {
+        uint32_t j = hashName(base + at) & (slot_count - 1);
+        while (slots[j] != 0 && strcmp(base + slots[j] - 1, base + at) != 0)
+        {
+            j = (j + 1) & (slot_count - 1);
+        }
+        if (slots[j] == 0)
+        {
+            slots[j] = at + 1;
+            names++;
+        }
+    }
+
+    pool->base = base;
+    pool->used = used;
+    pool->capacity = capacity;
+    pool->slots = slots;
+    pool->slot_count = slot_count;
+    pool->interned = names;
+    return 0;
+}
+
+/**
+ * @brief Frees a name pool's memory, unless it points into a mapped file
+ *
+ * @param pool The name pool, left empty
+ */
+void releaseNamePool(name_pool *pool)
+{
+    if (pool->capacity > 0)
+    {
+        free(pool->base);
+    }
+    free(pool->slots);
+    memset(pool, 0, sizeof(*pool));
+}
+
+/**
+ * @brief Hashes a name for a name pool's intern table (32-bit FNV-1a)
+ *
+ * @param name The name
+ * @return uint32_t The hash
+ */
+uint32_t hashName(const char *name)
+{
+    uint32_t h = 2166136261u;
+
+    for (const char *c = name; *c != '\0'; c++)
+    {
+        h = (h ^ (unsigned char)*c) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief Sets up an empty duplicate table with room for expected students
+ *
+ * @param table The table
+ * @param expected The number of students expected; the table grows past it as needed
+ * @return int 0 on success, -1 if memory ran out
+ */
+int initDuplicates(dup_table *table, int expected)
+{
+    uint32_t slots = DUP_MIN_SLOTS;
+
+    while (slots < (uint32_t)MAX_STUDENTS && (int64_t)slots < 2 * (int64_t)expected)
+    {
+        slots *= 2;
+    }
+    // MEM35-C: calloc leaves every slot empty
+    table->slots = calloc(slots, sizeof(dup_slot));
+    table->mask = slots - 1;
+    table->count = 0;
+    return table->slots == NULL ? -1 : 0;
+}
+
+/**
+ * @brief Looks a student up in a duplicate table by name, gender and age, adding them if they are not there
+ *
+ * Names match when they are equal ignoring ASCII case, leading and trailing spaces and runs of spaces
+ * (see nextNameChar). Students sharing an interned name are matched without comparing the names.
+ *
+ * @param cls The class
+ * @param table The table of the students of the class seen so far
+ * @param index The position of the student
+ * @return int The position of the earlier student they repeat, -1 if they were added, -2 if memory ran out
+ */
+int checkDuplicate(const classroom *cls, dup_table *table, int index)
+{
+    const student_chunk *chunk = cls->chunks[index >> CHUNK_SHIFT];
+    int j = index & (CHUNK_STUDENTS - 1);
+    const char *name = cls->names.base + chunk->names[j];
+    uint32_t hash = hashStudent(name, chunk->genders[j], chunk->ages[j]);
+
+    if ((uint32_t)(table->count + 1) * 2 > table->mask + 1 && growDuplicates(table) != 0)
+    {
+        return -2;
+    }
+    for (uint32_t at = hash & table->mask;; at = (at + 1) & table->mask)
+    {
+        dup_slot *slot = &table->slots[at];
+        if (slot->student == 0)
+        {
+            slot->hash = hash;
+            slot->student = index + 1;
+            table->count++;
+            return -1;
+        }
+        if (slot->hash == hash)
+        {
+            const student_chunk *other = cls->chunks[(slot->student - 1) >> CHUNK_SHIFT];
+            int k = (slot->student - 1) & (CHUNK_STUDENTS - 1);
+            const char *other_name = cls->names.base + other->names[k];
+            if (other->genders[k] == chunk->genders[j] && other->ages[k] == chunk->ages[j]
+                && (other_name == name || sameName(other_name, name)))
+            {
+                return slot->student - 1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Doubles the slots of a duplicate table, placing each student again by their stored hash
+ *
+ * @param table The table
+ * @return int 0 on success, -1 if memory ran out (the table is unchanged)
+ */
+int growDuplicates(dup_table *table)
+{
+    uint32_t slots = (table->mask + 1) * 2;
+    dup_slot *grown;
+
+    if (slots == 0 || (grown = calloc(slots, sizeof(dup_slot))) == NULL)
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i <= table->mask; i++)
+    {
+        if (table->slots[i].student != 0)
+        {
+            uint32_t at = table->slots[i].hash & (slots - 1);
+            while (grown[at].student != 0)
+            {
+                at = (at + 1) & (slots - 1);
+            }
+            grown[at] = table->slots[i];
+        }
+    }
+    free(table->slots);
+    table->slots = grown;
+    table->mask = slots - 1;
+    return 0;
+}
+
+/**
+ * @brief Frees a duplicate table
+ *
+ * @param table The table, which may never have been set up
+ */
+void freeDuplicates(dup_table *table)
+{
+    free(table->slots);
+    // MEM01-C: The dangling pointer is cleared once its memory is released
+    table->slots = NULL;
+    table->count = 0;
+}
+
+/**
+ * @brief Hashes a student's normalized name, gender and age for a duplicate table (32-bit FNV-1a)
+ *
+ * @param name The name
+ * @param gender The gender code
+ * @param age The age
+ * @return uint32_t The hash
+ */
+uint32_t hashStudent(const char *name, int gender, int age)
+{
+    uint32_t h = 2166136261u;
+    int c;
+
+    name += strspn(name, " \t");
+    while ((c = nextNameChar(&name)) != '\0')
+    {
+        h = (h ^ (unsigned char)c) * 16777619u;
+    }
+    h = (h ^ (unsigned char)gender) * 16777619u;
+    return (h ^ (unsigned char)age) * 16777619u;
+}
+
+/**
+ * @brief Compares two names as a duplicate table does, ignoring ASCII case and extra spaces
+ *
+ * @param a The first name
+ * @param b The second name
+ * @return int 1 if the names match, 0 otherwise
+ */
+int sameName(const char *a, const char *b)
+{
+    int c;
+
+    a += strspn(a, " \t");
+    b += strspn(b, " \t");
+    do
+    {
+        c = nextNameChar(&a);
+        if (c != nextNameChar(&b))
+        {
+            return 0;
+        }
+    } while (c != '\0');
+    return 1;
+}
+
+/**
+ * @brief Reads the next character of a name as duplicate detection sees it
+ *
+ * Letters are folded to lower case without the locale, so that a name hashes the same everywhere. A run of
+ * spaces and tabs reads as a single space, or as the end of the name if nothing follows it; callers skip
+ * the leading ones.
+ *
+ * @param name The position in the name, moved past the character read
+ * @return int The character, or '\0' at the end of the name
+ */
+int nextNameChar(const char **name)
+{
+    const char *c = *name;
+
+    if (*c == ' ' || *c == '\t')
+    {
+        while (*c == ' ' || *c == '\t')
+        {
+            c++;
+        }
+        *name = c;
+        return *c == '\0' ? '\0' : ' ';
+    }
+    if (*c == '\0')
+    {
+        return '\0';
+    }
+    *name = c + 1;
+    return *c >= 'A' && *c <= 'Z' ? *c - 'A' + 'a' : *c;
+}
+
+/**
+ * @brief Gathers a student of a class from its chunk's columns
+ *
+ * @param cls The class
+ * @param index The position of the student, below the room reserved for the class
+ * @param s The student to fill
+ */
+void getStudent(const classroom *cls, int index, student *s)
+{
+    const student_chunk *chunk = cls->chunks[index >> CHUNK_SHIFT];
+    int j = index & (CHUNK_STUDENTS - 1);
+
+    memset(s->name, 0, NAME_LENGTH);
+    strncpy(s->name, cls->names.base + chunk->names[j], NAME_LENGTH - 1);
+    s->gender = chunk->genders[j];
+    s->age = chunk->ages[j];
+}
+
+/**
+ * @brief Finds the name of a student of a class
+ *
+ * @param cls The class
+ * @param index The position of the student
+ * @return const char* The name, which lives in the class's name pool
+ */
+const char *studentName(const classroom *cls, int index)
+{
+    return cls->names.base + cls->chunks[index >> CHUNK_SHIFT]->names[index & (CHUNK_STUDENTS - 1)];
+}
+
+/**
+ * @brief Finds the age of a student of a class
+ *
+ * @param cls The class
+ * @param index The position of the student
+ * @return int The age
+ */
+int studentAge(const classroom *cls, int index)
+{
+    return cls->chunks[index >> CHUNK_SHIFT]->ages[index & (CHUNK_STUDENTS - 1)];
+}
+
+/**
+ * @brief Scatters a student into its chunk's columns, interning its name
+ *
+ * The search indexes are not touched; callers that change an indexed student use indexRemove and indexInsert.
+ *
+ * @param cls The class
+ * @param index The position of the student, below the room reserved for the class
+ * @param s The student, whose gender and age must be valid
+ * @return int 0 on success, -1 if memory ran out
+ */
+int setStudent(classroom *cls, int index, const student *s)
+{
+    student_chunk *chunk = writableChunk(cls, index >> CHUNK_SHIFT);
+    int j = index & (CHUNK_STUDENTS - 1);
+    uint32_t offset;
+
+    if (chunk == NULL || internName(&cls->names, s->name, &offset) != 0)
+    {
+        return -1;
+    }
+    chunk->names[j] = offset;
+    chunk->genders[j] = (unsigned char)s->gender;
+    chunk->ages[j] = (unsigned char)s->age;
+    return 0;
+}
+
+/**
+ * @brief Decodes a file record laid out as described by a class file header
+ *
+ * @param record The record
+ * @param header The header describing the record's field offsets
+ * @param s The student to fill
+ */
+void decodeStudent(const unsigned char *record, const class_header *header, student *s)
+{
+    memset(s->name, 0, NAME_LENGTH);
+    memcpy(s->name, record + header->name_offset, RECORD_NAME_LENGTH - 1);
+    s->gender = (int)getLE32(record + header->gender_offset);
+    s->age = (int)getLE32(record + header->age_offset);
+}
+
+/**
+ * @brief qsort comparison for ints in ascending order
+ */
+int compareInts(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief qsort comparison for C strings (given as char pointers) in byte order
+ */
+int compareStrings(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief qsort comparison for doubles in ascending order
+ */
+int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Serialises a class file header into CLASS_HEADER_SIZE bytes, ending with its own checksum
+ *
+ * @param buffer The CLASS_HEADER_SIZE byte buffer to write
+ * @param header The header fields
+ */
+void encodeClassHeader(unsigned char *buffer, const class_header *header)
+{
+    memset(buffer, 0, CLASS_HEADER_SIZE);
+    memcpy(buffer, CLASS_FILE_MAGIC, 8);
+    putLE32(buffer + 8, header->version);
+    putLE32(buffer + 12, header->header_size);
+    putLE32(buffer + 16, header->record_count);
+    putLE32(buffer + 20, header->record_size);
+    putLE32(buffer + 24, header->name_offset);
+    putLE32(buffer + 28, header->gender_offset);
+    putLE32(buffer + 32, header->age_offset);
+    putLE64(buffer + 40, header->records_offset);
+    putLE64(buffer + 48, header->records_checksum);
+    putLE64(buffer + 88, header->journal_id);
+    putLE64(buffer + 96, header->journal_lsn);
+    putLE32(buffer + 104, header->chunk_students);
+    putLE32(buffer + 108, header->names_size);
+    memcpy(buffer + 56, header->category, CLASS_CODE_LENGTH);
+    memcpy(buffer + 56 + CLASS_CODE_LENGTH, header->course_num, CLASS_CODE_LENGTH);
+    memcpy(buffer + 56 + 2 * CLASS_CODE_LENGTH, header->section_num, CLASS_CODE_LENGTH);
+    putLE64(buffer + CLASS_HEADER_SIZE - 8, checksum64(buffer, CLASS_HEADER_SIZE - 8, CHECKSUM_INIT));
+}
+
+/**
+ * @brief Parses and checks a class file header
+ *
+ * @param buffer The first CLASS_HEADER_SIZE bytes of the file
+ * @param header Filled with the decoded fields
+ * @return int 0 if the header is valid, 1 if the file is not in this format, -2 if it is corrupt or unsupported
+ */
+int decodeClassHeader(const unsigned char *buffer, class_header *header)
+{
+    if (memcmp(buffer, CLASS_FILE_MAGIC, 8) != 0)
+    {
+        return 1;
+    }
+    if (getLE64(buffer + CLASS_HEADER_SIZE - 8) != checksum64(buffer, CLASS_HEADER_SIZE - 8, CHECKSUM_INIT))
+    {
+        return -2;
+    }
+    header->version = getLE32(buffer + 8);
+    header->header_size = getLE32(buffer + 12);
+    header->record_count = getLE32(buffer + 16);
+    header->record_size = getLE32(buffer + 20);
+    header->name_offset = getLE32(buffer + 24);
+    header->gender_offset = getLE32(buffer + 28);
+    header->age_offset = getLE32(buffer + 32);
+    header->records_offset = getLE64(buffer + 40);
+    header->records_checksum = getLE64(buffer + 48);
+    header->journal_id = getLE64(buffer + 88); // Reserved (zero) in version 1 files
+    header->journal_lsn = getLE64(buffer + 96);
+    header->chunk_students = getLE32(buffer + 104); // Reserved (zero) before version 3
+    header->names_size = getLE32(buffer + 108);     // Reserved (zero) before version 4
+    // STR32-C: The class code fields are always null-terminated, even in a damaged file
+    memcpy(header->category, buffer + 56, CLASS_CODE_LENGTH);
+    memcpy(header->course_num, buffer + 56 + CLASS_CODE_LENGTH, CLASS_CODE_LENGTH);
+    memcpy(header->section_num, buffer + 56 + 2 * CLASS_CODE_LENGTH, CLASS_CODE_LENGTH);
+    header->category[CLASS_CODE_LENGTH - 1] = '\0';
+    header->course_num[CLASS_CODE_LENGTH - 1] = '\0';
+    header->section_num[CLASS_CODE_LENGTH - 1] = '\0';
+
+    if (header->version < CLASS_FILE_MIN_VERSION || header->version > CLASS_FILE_VERSION || header->header_size != CLASS_HEADER_SIZE
+        || header->records_offset % 4 != 0)
+    {
+        return -2;
+    }
+    // INT30-C: Field extents are computed in 64 bits so that corrupt offsets cannot wrap
+    if (header->version >= CLASS_FILE_COLUMNS)
+    {
+        uint64_t students = header->chunk_students;
+        uint64_t name_size = header->version >= CLASS_FILE_NAMES ? sizeof(uint32_t) : RECORD_NAME_LENGTH;
+        if (students == 0 || (header->version >= CLASS_FILE_NAMES && header->names_size == 0)
+            || header->name_offset + students * name_size > header->record_size
+            || header->gender_offset + students > header->record_size
+            || header->age_offset + students > header->record_size)
+        {
+            return -2;
+        }
+    }
+    else if ((uint64_t)header->name_offset + RECORD_NAME_LENGTH > header->record_size
+        || (uint64_t)header->gender_offset + 4 > header->record_size
+        || (uint64_t)header->age_offset + 4 > header->record_size)
+    {
+        return -2;
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks whether the roster chunks described by a header can be used in place as student_chunk structs
+ *
+ * @param header The class file header
+ * @return int 1 if the chunk layout is identical to student_chunk on this build, 0 otherwise
+ */
+int columnsMatchMemory(const class_header *header)
+{
+    const uint32_t probe = 1;
+
+    return header->version >= CLASS_FILE_NAMES
+        && *(const unsigned char *)&probe == 1 // Little-endian host, for the name offsets
+        && header->chunk_students == CHUNK_STUDENTS
+        && sizeof(student_chunk) == header->record_size
+        && offsetof(student_chunk, names) == header->name_offset
+        && offsetof(student_chunk, genders) == header->gender_offset
+        && offsetof(student_chunk, ages) == header->age_offset;
+}
+
+/**
+ * @brief Computes a 64-bit checksum a word at a time, fast enough to cover a whole class file
+ *
+ * @param buffer The bytes to checksum
+ * @param len The number of bytes
+ * @param seed CHECKSUM_INIT, or the checksum of the preceding bytes when they were a multiple of 8 bytes long
+ * @return uint64_t The checksum
+ */
+uint64_t checksum64(const void *buffer, size_t len, uint64_t seed)
+{
+    const unsigned char *p = buffer;
+    uint64_t h = seed;
+    uint64_t word;
+
+    while (len >= 8)
+    {
+        memcpy(&word, p, 8); // EXP36-C: memcpy avoids an unaligned uint64_t access
+        h = (h ^ word) * 0x100000001B3ULL;
+        h ^= h >> 29;
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+    {
+        h = (h ^ *p++) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+/**
+ * @brief Computes the checksum of part of a mapping, handing the pages back as it goes if the file is streamed
+ *
+ * @param buffer The bytes to checksum, in map
+ * @param len The number of bytes
+ * @param map The mapping that holds them (may be NULL)
+ * @return uint64_t The checksum, the same as checksum64 from CHECKSUM_INIT
+ */
+uint64_t checksumMapped(const unsigned char *buffer, size_t len, const file_map *map)
+{
+    const size_t window = STREAM_CHUNKS * sizeof(student_chunk); // A multiple of 8, so the checksum carries over
+    uint64_t h = CHECKSUM_INIT;
+
+    while (map != NULL && map->stream && len > window)
+    {
+        h = checksum64(buffer, window, h);
+        releasePages(map, buffer, buffer + window);
+        buffer += window;
+        len -= window;
+    }
+    return checksum64(buffer, len, h);
+}
+
+/**
+ * @brief Stores a 32-bit value in little-endian byte order
+ */
+void putLE32(unsigned char *p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+/**
+ * @brief Stores a 64-bit value in little-endian byte order
+ */
+void putLE64(unsigned char *p, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+/**
+ * @brief Reads a 32-bit little-endian value
+ */
+uint32_t getLE32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**
+ * @brief Reads a 64-bit little-endian value
+ */
+uint64_t getLE64(const unsigned char *p)
+{
+    return (uint64_t)getLE32(p) | (uint64_t)getLE32(p + 4) << 32;
+}
+
+/**
+ * @brief Calculates the cost of the current class with the pricing table's tiers and tax rates
+ *
+ * The cost per student entered here is the rate of every student that no pricing tier covers.
+ *
+ * @param cls The selected class (may be NULL)
+ */
+void calculateCost(classroom *cls)
+{
+    pricing_table table = pricing;
+    money rates[RATE_SLOTS];
+    class_price price;
+    char total[MONEY_BUFFER];
+    int currency;
+
+    if (cls == NULL || cls->num < 1)
+    {
+        printf("\nNo student data to calculate. You may enter new, or load existing data.\n");
+        return;
+    }
+    if (requireStudents(cls, "Calculate Cost of Class") != 0)
+    {
+        return;
+    }
+    if (readBaseRate("Calculate Cost of Class", &currency, &table.base_rate) != 0)
+    {
+        return;
+    }
+
+    buildRateTable(&table, rates);
+    // INT32-C: The price is computed in 64-bit money with every product and sum checked, so it is either exact or refused
+    if (priceClass(cls, rates, classTaxRate(&table, cls), &price) != 0)
+    {
+        audit("cost", cls, "students=%d overflow", cls->num);
+        printf("\nERROR: Resulting calculation with given input would exceed maximum value, smaller values must be used.\n");
+        return;
+    }
+    formatMoney(price.total, total);
+    audit("cost", cls, "students=%d total=%s %s ok", price.students, total, currency == 2 ? "EUR" : "USD");
+    printCost(&table, &price, currency);
+}
+
+/**
+ * @brief Prints a price as Calculate Cost of Class shows it
+ *
+ * @param table The pricing table the price was calculated with
+ * @param price The price
+ * @param currency 1 for USD, 2 for EUR
+ */
+void printCost(const pricing_table *table, const class_price *price, int currency)
+{
+    if (table->tier_count > 0)
+    {
+        printf("\n\t%d pricing tiers applied.", table->tier_count);
+    }
+    printf("\n\tTotal Cost: ");
+    printMoney(currency, price->subtotal);
+    printf("\n\tTax at %d.%02d%%: ", price->tax_rate / 100, price->tax_rate % 100);
+    printMoney(currency, price->tax);
+    printf("\n\tTotal Cost w/ %d.%02d%% Tax Rate: ", price->tax_rate / 100, price->tax_rate % 100);
+    printMoney(currency, price->total);
+    printf("\n");
+}
+
+/**
+ * @brief Prices every class in the catalog in one batch spread over the available cores
+ */
+void priceCatalog(void)
+{
+    pricing_table table = pricing;
+    money rates[RATE_SLOTS];
+    pricing_job job;
+    int currency;
+
+    if (catalog.count == 0)
+    {
+        printf("\nERROR: The catalog is empty. You may enter new, or load existing data.\n");
+        return;
+    }
+    // The students are paged in here, one class at a time, since the pricing threads share the catalog's mapping
+    for (int i = 0; i < catalog.count; i++)
+    {
+        if (requireStudents(catalog.classes[i], "Price All Classes") != 0)
+        {
+            return;
+        }
+    }
+    if (readBaseRate("Price All Classes", &currency, &table.base_rate) != 0)
+    {
+        return;
+    }
+
+    buildRateTable(&table, rates);
+    memset(&job, 0, sizeof(job));
+    job.classes = catalog.classes;
+    job.count = catalog.count;
+    job.table = &table;
+    job.rates = rates;
+    // MEM35-C: One price per class in the catalog
+    if ((job.prices = calloc((size_t)job.count, sizeof(class_price))) == NULL)
+    {
+        printf("\nERROR: Out of memory.\nERROR: Price All Classes function failed. Please try again.\n");
+        return;
+    }
+    runWorkers(pricingWorker, &job, job.count, &job.next);
+    audit("price-all", NULL, "classes=%d %s", job.count, currency == 2 ? "EUR" : "USD");
+    printf("\n");
+    printPriceReport(job.prices, job.count, currency);
+    free(job.prices);
+}
+
+/**
+ * @brief Asks for the currency and the cost per student of a cost calculation
+ *
+ * @param function The menu action asking, named in its error messages
+ * @param currency Set to 1 for dollars or 2 for euros
+ * @param rate Set to the cost per student
+ * @return int 0 on success, -1 if the input was invalid (the user has been told)
+ */
+int readBaseRate(const char *function, int *currency, money *rate)
+{
+    // ARR32-C: valid size input for arrays
+    char curr_type[2];
+    char money_buffer[MONEY_INPUT];
+    int truncated;
+
+    printf("\n\tCurrency Type [1=Dollars, 2=Euro]: ");
+    readInput(curr_type, 2, NULL);
+    // ERR33-C: Checking to see if string input is valid
+    if (!(curr_type[0] == '1' || curr_type[0] == '2'))
+    {
+        printf("\nERROR: Invalid input. Currency Type should be an integer (1-2).\nERROR: %s function failed. Please try again.\n", function);
+        return -1;
+    }
+    *currency = curr_type[0] - '0';
+
+    printf("\tPlease enter the cost per student: ");
+    printMoney(*currency, -1);
+    readInput(money_buffer, MONEY_INPUT, &truncated);
+    if (truncated || parseMoney(money_buffer, rate) != 0)
+    {
+        printf("\nERROR: Ivalid input. Input should have been a positive amount with at most %d decimals.\nERROR: %s function failed. Please try again.\n", MONEY_DIGITS, function);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Prints an amount of money after its currency sign
+ *
+ * @param currency 1 for dollars, 2 for euros
+ * @param amount The amount, or a negative value to print just the sign
+ */
+void printMoney(int currency, money amount)
+{
+    char buffer[MONEY_BUFFER];
+    // STR00-C: This scenario necessitates the wchar_t type
+    wchar_t euro = L'€';
+
+    // STR38-C: wchar_t functions used to print character to stdout
+    if (currency == 2)
+    {
+        putwchar(euro);
+    }
+    else
+    {
+        putchar('$');
+    }
+    if (amount >= 0)
+    {
+        formatMoney(amount, buffer);
+        printf("%s", buffer);
+    }
+}
+
+/**
+ * @brief Parses a non-negative amount with up to MONEY_DIGITS decimals into fixed point
+ *
+ * Tax rates are parsed the same way, since basis points are a percentage with MONEY_DIGITS decimals.
+ *
+ * @param text The amount, such as "12" or "12.5"
+ * @param value Set to the amount in MONEY_SCALE units
+ * @return int 0 on success, -1 if the text is not an amount or is too large
+ */
+int parseMoney(const char *text, money *value)
+{
+    money whole = 0;
+    money fraction = 0;
+    int digits = 0;
+    const char *p = text;
+
+    if (*p < '0' || *p > '9')
+    {
+        return -1;
+    }
+    for (; *p >= '0' && *p <= '9'; p++)
+    {
+        // INT32-C: The whole part is checked before it is scaled, so neither step can overflow
+        if (whole > (INT64_MAX / MONEY_SCALE - 9) / 10)
+        {
+            return -1;
+        }
+        whole = whole * 10 + (*p - '0');
+    }
+    if (*p == '.')
+    {
+        for (p++; *p >= '0' && *p <= '9' && digits < MONEY_DIGITS; p++, digits++)
+        {
+            fraction = fraction * 10 + (*p - '0');
+        }
+    }
+    if (*p != '\0')
+    {
+        return -1;
+    }
+    for (; digits < MONEY_DIGITS; digits++)
+    {
+        fraction *= 10;
+    }
+    *value = whole * MONEY_SCALE + fraction;
+    return 0;
+}
+
+/**
+ * @brief Formats a non-negative amount of money with MONEY_DIGITS decimals
+ *
+ * @param amount The amount in MONEY_SCALE units
+ * @param buffer The MONEY_BUFFER byte buffer to fill
+ */
+void formatMoney(money amount, char *buffer)
+{
+    snprintf(buffer, MONEY_BUFFER, "%lld.%0*lld", (long long)(amount / MONEY_SCALE), MONEY_DIGITS, (long long)(amount % MONEY_SCALE));
+}
+
+/**
+ * @brief Reads a pricing table from a text file
+ *
+ * Each line is blank, a # comment, or one of:
+ *   rate AMOUNT                 the cost of a student in no tier
+ *   tier age LOW HIGH AMOUNT    the cost of a student aged LOW to HIGH
+ *   tier gender LOW HIGH AMOUNT the cost of a student whose gender code is LOW to HIGH
+ *   tax CATEGORY PERCENT        the tax rate of the classes of a category, or of any other class for *
+ * Tiers are tried in the order given.
+ *
+ * @param path The pricing file
+ * @param table Filled with the pricing table
+ * @return int 0 on success, -1 if the file cannot be read or has an invalid line (reported on stderr)
+ */
+int loadPricing(const char *path, pricing_table *table)
+{
+    // FIO24-C: file opened only once
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    char keyword[16];
+    char field[16];
+    char amount[32];
+    long line_no = 0;
+    int low;
+    int high;
+    money value;
+    int failed = 0;
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "ERROR: Could not open pricing file '%s'.\n", path);
+        return -1;
+    }
+    memset(table, 0, sizeof(*table));
+    table->default_tax = DEFAULT_TAX_RATE;
+
+    while (!failed && fgets(line, sizeof(line), fp) != NULL)
+    {
+        const char *reason = NULL;
+        char extra;
+
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        // FIO20-C: Lines are parsed into bounded fields, and anything after the expected fields is rejected
+        if (sscanf(line, " %15s", keyword) != 1 || keyword[0] == '#')
+        {
+            continue;
+        }
+        if (strcmp(keyword, "rate") == 0)
+        {
+            if (sscanf(line, " %*s %31s %c", amount, &extra) != 1 || parseMoney(amount, &value) != 0)
+            {
+                reason = "expected rate AMOUNT";
+            }
+            else
+            {
+                table->base_rate = value;
+            }
+        }
+        else if (strcmp(keyword, "tier") == 0)
+        {
+            if (sscanf(line, " %*s %15s %d %d %31s %c", field, &low, &high, amount, &extra) != 4
+                || (strcmp(field, "age") != 0 && strcmp(field, "gender") != 0) || low > high
+                || parseMoney(amount, &value) != 0)
+            {
+                reason = "expected tier age|gender LOW HIGH AMOUNT";
+            }
+            else if (table->tier_count == MAX_TIERS)
+            {
+                reason = "too many tiers";
+            }
+            else
+            {
+                price_tier *tier = &table->tiers[table->tier_count++];
+                tier->field = strcmp(field, "age") == 0 ? TIER_AGE : TIER_GENDER;
+                tier->low = low;
+                tier->high = high;
+                tier->rate = value;
+            }
+        }
+        else if (strcmp(keyword, "tax") == 0)
+        {
+            classroom key;
+            memset(&key, 0, sizeof(key));
+            if (sscanf(line, " %*s %15s %31s %c", field, amount, &extra) != 2 || parseMoney(amount, &value) != 0
+                || value > MAX_TAX_RATE)
+            {
+                reason = "expected tax CATEGORY|* PERCENT, at most 1000%";
+            }
+            else if (strcmp(field, "*") == 0)
+            {
+                table->default_tax = (int)value;
+            }
+            else if (strlen(field) >= CLASS_CODE_LENGTH)
+            {
+                reason = "category too long";
+            }
+            else if (table->tax_count == MAX_TAXES)
+            {
+                reason = "too many tax rates";
+            }
+            else
+            {
+                tax_rate *tax = &table->taxes[table->tax_count++];
+                memset(tax->category, 0, CLASS_CODE_LENGTH);
+                strcpy(tax->category, field);
+                tax->rate = (int)value;
+            }
+        }
+        else
+        {
+            reason = "unknown keyword";
+        }
+        if (reason != NULL)
+        {
+            fprintf(stderr, "ERROR: Pricing file '%s' line %ld rejected: %s.\n", path, line_no, reason);
+            failed = 1;
+        }
+    }
+    fclose(fp);
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Works out the rate of every combination of gender code and age from a pricing table's tiers
+ *
+ * Pricing a class then only needs a histogram of its students, however many tiers there are.
+ *
+ * @param table The pricing table
+ * @param rates Filled with RATE_SLOTS rates, indexed by gender * (MAX_AGE + 1) + age
+ */
+void buildRateTable(const pricing_table *table, money *rates)
+{
+    for (int gender = 0; gender < 4; gender++)
+    {
+        for (int age = 0; age <= MAX_AGE; age++)
+        {
+            money rate = table->base_rate;
+            for (int t = 0; t < table->tier_count; t++)
+            {
+                const price_tier *tier = &table->tiers[t];
+                int value = tier->field == TIER_AGE ? age : gender;
+                if (value >= tier->low && value <= tier->high)
+                {
+                    rate = tier->rate;
+                    break;
+                }
+            }
+            rates[gender * (MAX_AGE + 1) + age] = rate;
+        }
+    }
+}
+
+/**
+ * @brief Looks up the tax rate of a class by its category
+ *
+ * @param table The pricing table
+ * @param cls The class
+ * @return int The tax rate in basis points
+ */
+int classTaxRate(const pricing_table *table, const classroom *cls)
+{
+    for (int i = 0; i < table->tax_count; i++)
+    {
+        if (strncmp(table->taxes[i].category, cls->category, CLASS_CODE_LENGTH) == 0)
+        {
+            return table->taxes[i].rate;
+        }
+    }
+    return table->default_tax;
+}
+
+/**
+ * @brief Prices a class: a histogram of its students by gender and age, weighted by the rate table
+ *
+ * @param cls The class
+ * @param rates The rate table from buildRateTable
+ * @param tax_rate The class's tax rate in basis points
+ * @param price Filled with the class's code, students, subtotal, tax and total
+ * @return int 0 on success, PRICE_OVERFLOW if the price does not fit in money
+ */
+int priceClass(const classroom *cls, const money *rates, int tax_rate, class_price *price)
+{
+    uint64_t counts[RATE_SLOTS] = {0};
+
+    memset(price, 0, sizeof(*price));
+    formatClassCode(cls, price->code);
+    price->students = cls->num;
+    price->tax_rate = tax_rate;
+    for (int i = 0; i < cls->num; i += CHUNK_STUDENTS)
+    {
+        const student_chunk *chunk = cls->chunks[i >> CHUNK_SHIFT];
+        int n = cls->num - i < CHUNK_STUDENTS ? cls->num - i : CHUNK_STUDENTS;
+        // ARR30-C: Genders and ages are always valid, so every histogram index is in range
+        for (int j = 0; j < n; j++)
+        {
+            counts[chunk->genders[j] * (MAX_AGE + 1) + chunk->ages[j]]++;
+        }
+    }
+    return priceHistogram(counts, rates, price);
+}
+
+/**
+ * @brief Prices some of the students of a class, as priceClass prices all of them
+ *
+ * @param cls The class
+ * @param students The positions of the students to price
+ * @param count The number of students to price
+ * @param rates The rate table from buildRateTable
+ * @param tax_rate The class's tax rate in basis points
+ * @param price Filled with the class's code, the students priced, subtotal, tax and total
+ * @return int 0 on success, PRICE_OVERFLOW if the price does not fit in money
+ */
+int priceStudents(const classroom *cls, const int *students, int count, const money *rates, int tax_rate, class_price *price)
+{
+    uint64_t counts[RATE_SLOTS] = {0};
+
+    memset(price, 0, sizeof(*price));
+    formatClassCode(cls, price->code);
+    price->students = count;
+    price->tax_rate = tax_rate;
+    for (int k = 0; k < count; k++)
+    {
+        const student_chunk *chunk = cls->chunks[students[k] >> CHUNK_SHIFT];
+        int j = students[k] & (CHUNK_STUDENTS - 1);
+        counts[chunk->genders[j] * (MAX_AGE + 1) + chunk->ages[j]]++;
+    }
+    return priceHistogram(counts, rates, price);
+}
+
+/**
+ * @brief Prices a histogram of students by gender and age, weighted by the rate table, with tax
+ *
+ * @param counts RATE_SLOTS counts of students, indexed as the rate table is
+ * @param rates The rate table from buildRateTable
+ * @param price Holds the tax rate in basis points; filled with the subtotal, tax and total
+ * @return int 0 on success, PRICE_OVERFLOW if the price does not fit in money
+ */
+int priceHistogram(const uint64_t *counts, const money *rates, class_price *price)
+{
+    int tax_rate = price->tax_rate;
+    money subtotal = 0;
+
+    // INT32-C: Each product and sum is checked against INT64_MAX before it is formed
+    for (int k = 0; k < RATE_SLOTS; k++)
+    {
+        if (counts[k] > 0 && rates[k] > 0 && counts[k] > (uint64_t)((INT64_MAX - subtotal) / rates[k]))
+        {
+            price->status = PRICE_OVERFLOW;
+            return PRICE_OVERFLOW;
+        }
+        subtotal += (money)counts[k] * rates[k];
+    }
+    // The tax is rounded to the nearest cent, splitting the subtotal so that the product cannot overflow
+    money whole = subtotal / TAX_SCALE;
+    money part = subtotal % TAX_SCALE;
+    if (tax_rate > 0 && whole > (INT64_MAX - tax_rate) / tax_rate)
+    {
+        price->status = PRICE_OVERFLOW;
+        return PRICE_OVERFLOW;
+    }
+    price->subtotal = subtotal;
+    price->tax = whole * tax_rate + (part * tax_rate + TAX_SCALE / 2) / TAX_SCALE;
+    if (price->tax > INT64_MAX - subtotal)
+    {
+        price->status = PRICE_OVERFLOW;
+        return PRICE_OVERFLOW;
+    }
+    price->total = subtotal + price->tax;
+    return 0;
+}
+
+/**
+ * @brief Runs a job's items on one worker thread per core, each worker taking the next item in turn
+ *
+ * The calling thread works too, so the job completes even if no thread can be started.
+ *
+ * @param work The worker, which takes items from next until count is reached (pricingWorker, loadWorker)
+ * @param job The job passed to each worker
+ * @param count The number of items in the job
+ * @param next The job's counter of the next item to be handed out
+ * @return int The number of worker threads used, including the calling one
+ */
+int runWorkers(void *(*work)(void *), void *job, int count, atomic_int *next)
+{
+    pthread_t workers[MAX_WORKER_THREADS];
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cores < 1 ? 1 : cores > MAX_WORKER_THREADS ? MAX_WORKER_THREADS : (int)cores;
+    int started = 0;
+
+    if (threads > count)
+    {
+        threads = count > 0 ? count : 1;
+    }
+    atomic_init(next, 0);
+    while (started < threads - 1 && pthread_create(&workers[started], NULL, work, job) == 0)
+    {
+        started++;
+    }
+    work(job);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    return started + 1;
+}
+
+/**
+ * @brief Prices the classes of a job until none are left
+ *
+ * Classes from the catalog are only read. Classes from files are mapped, priced and released by the
+ * worker that takes them, so no two threads ever touch the same class.
+ *
+ * @param arg The pricing_job
+ * @return void* NULL
+ */
+void *pricingWorker(void *arg)
+{
+    pricing_job *job = arg;
+    int i;
+
+    // CON43-C: Each class is handed to exactly one thread by the atomic counter, and each price has a single writer
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count)
+    {
+        class_price *price = &job->prices[i];
+        if (job->classes != NULL)
+        {
+            priceClass(job->classes[i], job->rates, classTaxRate(job->table, job->classes[i]), price);
+            continue;
+        }
+
+        classroom cls;
+        memset(&cls, 0, sizeof(cls));
+        int status = readClassFile(job->paths[i], &cls, NULL, 0);
+        if (status == 0)
+        {
+            priceClass(&cls, job->rates, classTaxRate(job->table, &cls), price);
+        }
+        else
+        {
+            memset(price, 0, sizeof(*price));
+            price->status = status;
+        }
+        releaseClass(&cls);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Prices every class file in a directory and prints the report in dollars
+ *
+ * @param dir The directory; files in it that are not class files are reported as unreadable
+ * @param table The pricing table
+ * @return int 0 on success, 1 if the directory cannot be read or memory ran out
+ */
+int priceDirectory(const char *dir, const pricing_table *table)
+{
+    money rates[RATE_SLOTS];
+    pricing_job job;
+    int failed;
+
+    memset(&job, 0, sizeof(job));
+    failed = listDirectory(dir, &job.paths, &job.count);
+    if (failed > 0)
+    {
+        fprintf(stderr, "ERROR: Could not open directory '%s'.\n", dir);
+        return 1;
+    }
+    if (!failed && job.count > 0)
+    {
+        buildRateTable(table, rates);
+        job.table = table;
+        job.rates = rates;
+        failed = (job.prices = calloc((size_t)job.count, sizeof(class_price))) == NULL;
+    }
+    if (!failed)
+    {
+        runWorkers(pricingWorker, &job, job.count, &job.next);
+        for (int i = 0; i < job.count; i++)
+        {
+            if (job.prices[i].status == -1 || job.prices[i].status == -2)
+            {
+                // The file name stands in for the class code of a file that could not be read
+                snprintf(job.prices[i].code, CLASS_CODE_BUFFER, "%s", strrchr(job.paths[i], '/') + 1);
+            }
+        }
+        printPriceReport(job.prices, job.count, 1);
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+    }
+    for (int i = 0; i < job.count; i++)
+    {
+        free(job.paths[i]);
+    }
+    free(job.paths);
+    free(job.prices);
+    return failed != 0;
+}
+
+/**
+ * @brief Lists the regular files in a directory, skipping hidden ones, in name order
+ *
+ * The order does not depend on the order the directory returns its entries in, so reports and merges made
+ * from the list are repeatable.
+ *
+ * @param dir The directory
+ * @param paths Set to the allocated paths, each allocated too (NULL if there are none)
+ * @param count Set to the number of paths
+ * @return int 0 on success, 1 if the directory cannot be opened, -1 if memory ran out (paths holds the files
+ *             listed so far)
+ */
+int listDirectory(const char *dir, char ***paths, int *count)
+{
+    struct dirent *entry;
+    struct stat st;
+    int capacity = 0;
+    int failed = 0;
+    DIR *d = opendir(dir);
+
+    *paths = NULL;
+    *count = 0;
+    if (d == NULL)
+    {
+        return 1;
+    }
+    while (!failed && (entry = readdir(d)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        // MEM35-C: Each path is sized for the directory, a separator, the file name and a terminator
+        size_t len = strlen(dir) + strlen(entry->d_name) + 2;
+        char *path = malloc(len);
+        if (path == NULL)
+        {
+            failed = 1;
+            break;
+        }
+        snprintf(path, len, "%s/%s", dir, entry->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            free(path);
+            continue;
+        }
+        if (*count == capacity)
+        {
+            int grown = capacity > 0 ? capacity * 2 : 64;
+            char **list = realloc(*paths, (size_t)grown * sizeof(char *));
+            if (list == NULL)
+            {
+                free(path);
+                failed = 1;
+                break;
+            }
+            *paths = list;
+            capacity = grown;
+        }
+        (*paths)[(*count)++] = path;
+    }
+    closedir(d);
+    if (*count > 0)
+    {
+        qsort(*paths, *count, sizeof(char *), compareStrings);
+    }
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Loads every class file in a directory in parallel and merges the classes into the catalog
+ *
+ * Each file is read and fully checked by whichever worker takes it (see loadWorker). The classes are then
+ * merged in file name order, so when two files hold the same class the later one is kept. A file that
+ * cannot be read is reported and skipped without stopping the others.
+ *
+ * @param dir The directory
+ * @return int 0 on success, 1 if the directory cannot be read or memory ran out
+ */
+int loadDirectory(const char *dir)
+{
+    load_job job;
+    int loaded = 0;
+    int replaced = 0;
+    long students = 0;
+    int threads = 0;
+    uint64_t start = statsNow();
+
+    memset(&job, 0, sizeof(job));
+    int failed = listDirectory(dir, &job.paths, &job.count);
+    if (failed > 0)
+    {
+        fprintf(stderr, "ERROR: Could not open directory '%s'.\n", dir);
+        return 1;
+    }
+    // MEM35-C: One class and one status per file
+    if (!failed && job.count > 0)
+    {
+        job.classes = calloc((size_t)job.count, sizeof(classroom));
+        job.status = calloc((size_t)job.count, sizeof(int));
+        failed = job.classes == NULL || job.status == NULL;
+    }
+    if (!failed && job.count > 0)
+    {
+        threads = runWorkers(loadWorker, &job, job.count, &job.next);
+    }
+
+    for (int i = 0; i < job.count; i++)
+    {
+        classroom *slot;
+        if (failed || job.status[i] != 0)
+        {
+            if (!failed)
+            {
+                fprintf(stderr, "ERROR: %s: %s\n", job.paths[i], job.status[i] == -1 ? "Read failed." : job.status[i] == -2 ? "Class file is damaged or from an unsupported version." : "Out of memory.");
+            }
+        }
+        else if ((slot = catalogClass(&catalog, &job.classes[i])) == NULL)
+        {
+            fprintf(stderr, "ERROR: %s: Out of memory.\n", job.paths[i]);
+        }
+        else
+        {
+            // MEM34-C: A class already in the catalog with the same code is released before it is replaced
+            replaced += slot->num > 0 || slot->image != NULL || slot->chunks != NULL;
+            releaseClass(slot);
+            *slot = job.classes[i];
+            memset(&job.classes[i], 0, sizeof(classroom));
+            loaded++;
+            students += slot->num;
+        }
+        if (job.classes != NULL)
+        {
+            releaseClass(&job.classes[i]);
+        }
+        free(job.paths[i]);
+    }
+    if (failed)
+    {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+    }
+    else
+    {
+        printf("Loaded %d of %d class files (%ld students, %d duplicate class codes replaced) from %s in %.3f s on %d threads.\n",
+               loaded, job.count, students, replaced, dir, (double)(statsNow() - start) / 1e9, threads);
+    }
+    audit("load-dir", NULL, "dir=%s files=%d loaded=%d failed=%d", dir, job.count, loaded, job.count - loaded);
+    free(job.paths);
+    free(job.classes);
+    free(job.status);
+    return failed != 0;
+}
+
+/**
+ * @brief Reads and checks the class files of a job until none are left
+ *
+ * Every file gets its own mapping, arena and name pool, so the workers share nothing but the counter.
+ *
+ * @param arg The load_job
+ * @return void* NULL
+ */
+void *loadWorker(void *arg)
+{
+    load_job *job = arg;
+    int i;
+
+    // CON43-C: Each file is handed to exactly one thread by the atomic counter, and each class has a single writer
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count)
+    {
+        job->status[i] = readClassFile(job->paths[i], &job->classes[i], NULL, 0);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Exports the students of a class file, or of every class file in a directory, as CSV or JSON lines
+ *
+ * Classes are read one at a time in file name order, each released before the next is read. A class file
+ * in the current format is streamed straight out of its mapping with its pages handed back behind the
+ * export (see exportClass), so memory stays at the export buffer however large the classes are; files in
+ * the compact and older formats are decoded whole, one class at a time. A file that cannot be read is
+ * reported and skipped without stopping the others.
+ *
+ * @param path The class file or directory
+ * @param format EXPORT_CSV or EXPORT_JSON
+ * @param output The file to write, or NULL for stdout
+ * @return int 0 on success, 1 if a file was skipped or the export could not be written
+ */
+int exportFiles(const char *path, int format, const char *output)
+{
+    struct stat st;
+    export_stream out;
+    char **paths = NULL;
+    int count = 0;
+    int exported = 0;
+    int failed = 0;
+    int fd = STDOUT_FILENO;
+    uint64_t start = statsNow();
+
+    if (stat(path, &st) != 0)
+    {
+        fprintf(stderr, "ERROR: Could not open '%s'.\n", path);
+        return 1;
+    }
+    // FIO24-C: file opened only once
+    if (output != NULL && (fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        fprintf(stderr, "ERROR: Could not open '%s'.\n", output);
+        return 1;
+    }
+    if (beginExport(&out, fd, format) != 0)
+    {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        if (output != NULL)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+
+    if (S_ISDIR(st.st_mode))
+    {
+        failed = listDirectory(path, &paths, &count);
+        if (failed != 0)
+        {
+            fprintf(stderr, failed > 0 ? "ERROR: Could not open directory '%s'.\n" : "ERROR: %s: Out of memory.\n", path);
+        }
+    }
+    else
+    {
+        count = 1;
+    }
+    for (int i = 0; i < count && !failed && !out.failed; i++)
+    {
+        const char *file = paths != NULL ? paths[i] : path;
+        int status = exportFile(&out, file);
+        if (status != 0)
+        {
+            fprintf(stderr, "ERROR: %s: %s\n", file, status == -1 ? "Read failed." : "Class file is damaged or from an unsupported version.");
+        }
+        exported += status == 0;
+    }
+    for (int i = 0; paths != NULL && i < count; i++)
+    {
+        free(paths[i]);
+    }
+    free(paths);
+
+    out.failed |= endExport(&out) != 0;
+    if (output != NULL && close(fd) != 0)
+    {
+        out.failed = 1;
+    }
+    if (out.failed)
+    {
+        fprintf(stderr, "ERROR: Could not write the export to %s.\n", output != NULL ? output : "stdout");
+    }
+    double seconds = (double)(statsNow() - start) / 1e9;
+    fprintf(stderr, "Exported %ld students from %d of %d class files in %s to %s in %.3f s (%.1f MB/s).\n", out.students, exported, count,
+            path, output != NULL ? output : "stdout", seconds, seconds > 0 ? (double)out.written / 1e6 / seconds : 0.0);
+    return failed || out.failed || exported < count;
+}
+
+/**
+ * @brief Exports the students of one class file, with its journal applied
+ *
+ * @param out The export
+ * @param path The class file
+ * @return int 0 if the class was exported (or its export could not be written; see out->failed), -1 if the
+ *             file cannot be read or memory ran out, -2 if it is damaged or from an unsupported version
+ */
+int exportFile(export_stream *out, const char *path)
+{
+    classroom cls;
+    class_header header;
+    uint64_t last_lsn = 0;
+    int status;
+
+    memset(&cls, 0, sizeof(cls));
+    memset(&header, 0, sizeof(header));
+    // A file in the current format is opened by its header, so that it can be checked as a stream too
+    status = readClassFile(path, &cls, &header, 1);
+    if (status == 0 && cls.image != NULL)
+    {
+        cls.map->stream = 1;
+        status = pageInClass(&cls);
+    }
+    if (status == 0 && header.journal_id != 0 && replayJournal(&cls, &header, &last_lsn) < 0)
+    {
+        status = -2;
+    }
+    if (status == 0)
+    {
+        // A class its journal changed may hold the changes in its private pages, which must be kept
+        exportClass(out, &cls, last_lsn == header.journal_lsn);
+    }
+    releaseClass(&cls);
+    return status;
+}
+
+/**
+ * @brief Prints the prices of a batch of classes, one line each, followed by their totals
+ *
+ * @param prices The prices
+ * @param count The number of prices
+ * @param currency 1 for dollars, 2 for euros
+ */
+void printPriceReport(const class_price *prices, int count, int currency)
+{
+    char subtotal[MONEY_BUFFER];
+    char tax[MONEY_BUFFER];
+    char total[MONEY_BUFFER];
+    money sums[3] = {0, 0, 0};
+    long students = 0;
+    int priced = 0;
+    int overflow = 0;
+
+    printf("%-*s %9s %6s %16s %16s %16s\n", CLASS_CODE_BUFFER, "Class", "Students", "Tax%", "Cost", "Tax", "Total");
+    for (int i = 0; i < count; i++)
+    {
+        const class_price *p = &prices[i];
+        if (p->status != 0)
+        {
+            printf("%-*s ERROR: %s\n", CLASS_CODE_BUFFER, p->code,
+                   p->status == PRICE_OVERFLOW ? "price exceeds the maximum value" : p->status == -2 ? "class file is damaged or from an unsupported version" : "not a readable class file");
+            continue;
+        }
+        formatMoney(p->subtotal, subtotal);
+        formatMoney(p->tax, tax);
+        formatMoney(p->total, total);
+        printf("%-*s %9d %3d.%02d %16s %16s %16s\n", CLASS_CODE_BUFFER, p->code, p->students, p->tax_rate / 100, p->tax_rate % 100, subtotal, tax, total);
+        // INT32-C: The running totals stop at INT64_MAX rather than wrap
+        overflow |= p->subtotal > INT64_MAX - sums[0] || p->tax > INT64_MAX - sums[1] || p->total > INT64_MAX - sums[2];
+        if (!overflow)
+        {
+            sums[0] += p->subtotal;
+            sums[1] += p->tax;
+            sums[2] += p->total;
+        }
+        students += p->students;
+        priced++;
+    }
+    if (overflow)
+    {
+        printf("Total of %d classes, %ld students: exceeds the maximum value\n", priced, students);
+        return;
+    }
+    formatMoney(sums[0], subtotal);
+    formatMoney(sums[1], tax);
+    formatMoney(sums[2], total);
+    printf("Total of %d classes, %ld students (%s): cost %s, tax %s, total %s\n", priced, students, currency == 2 ? "EUR" : "USD", subtotal, tax, total);
+}
+
+/**
+ * @brief Times the roster operations on synthetic classes and prints one JSON object per operation and size
+ *
+ * Each operation runs on its own, outside the prompt: student entry (growing a class one student at a time,
+ * as addStudents does), saving a snapshot, loading it back (mapping, validation and journal replay), saving
+ * and loading it as a compact class file, rendering the student list to a file, sorting it by name, filtering
+ * it, and pricing the class. The files go to a scratch directory that is removed afterwards. Peak RSS is that of the whole run so far.
+ *
+ * @param sizes Comma-separated class sizes, such as "1000,100000"
+ * @return int 0 on success, 1 if the sizes are invalid or an operation failed
+ */
+int runBenchmarks(const char *sizes)
+{
+    char scratch[] = "/tmp/class_bench.XXXXXX";
+    char list_path[] = "bench_list.txt";
+    pricing_table table = pricing;
+    money rates[RATE_SLOTS];
+    classroom cls;
+    double *samples;
+    int failed = 0;
+    int bad_size = 0;
+    int home = open(".", O_RDONLY);
+
+    // MEM35-C: One sample per run, and no size is run more than BENCH_MAX_RUNS times
+    if (home < 0 || (samples = malloc(BENCH_MAX_RUNS * sizeof(double))) == NULL)
+    {
+        fprintf(stderr, "ERROR: Could not start the benchmarks.\n");
+        return 1;
+    }
+    if (mkdtemp(scratch) == NULL || chdir(scratch) != 0)
+    {
+        fprintf(stderr, "ERROR: Could not create a scratch directory for the benchmarks.\n");
+        free(samples);
+        close(home);
+        return 1;
+    }
+    table.base_rate = 100 * MONEY_SCALE;
+    buildRateTable(&table, rates);
+    memset(&cls, 0, sizeof(cls));
+    parseClassCode("BENCH-100-001", &cls);
+
+    for (const char *p = sizes; *p != '\0' && !failed && !bad_size; p += *p == ',')
+    {
+        char *end;
+        long num = strtol(p, &end, 10);
+        // ERR34-C: strtol's end pointer shows whether a whole size was read
+        if (end == p || (*end != ',' && *end != '\0') || num < 1 || num > MAX_STUDENTS)
+        {
+            fprintf(stderr, "ERROR: Invalid benchmark size '%s'. Sizes are 1-%d, separated by commas.\n", p, MAX_STUDENTS);
+            bad_size = 1;
+            break;
+        }
+        p = end;
+        int runs = num <= BENCH_WORK / BENCH_MAX_RUNS ? BENCH_MAX_RUNS : BENCH_WORK / num < BENCH_MIN_RUNS ? BENCH_MIN_RUNS : (int)(BENCH_WORK / num);
+        class_header header;
+        class_price price;
+        struct stat st;
+        uint64_t last_lsn;
+        double start;
+
+        for (int r = 0; r < runs && !failed; r++)
+        {
+            releaseClass(&cls);
+            start = benchNow();
+            failed |= benchRoster(&cls, (int)num, (uint32_t)r + 1);
+            samples[r] = benchNow() - start;
+        }
+        if (!failed)
+        {
+            benchReport("entry", (int)num, samples, runs, 0);
+        }
+
+        for (int r = 0; r < runs && !failed; r++)
+        {
+            start = benchNow();
+            failed |= saveSnapshot(&cls);
+            samples[r] = benchNow() - start;
+        }
+        if (!failed)
+        {
+            benchReport("save", (int)num, samples, runs, (uint64_t)snapshot_bytes);
+        }
+
+        for (int r = 0; r < runs && !failed; r++)
+        {
+            classroom loaded;
+            memset(&loaded, 0, sizeof(loaded));
+            start = benchNow();
+            failed |= mapClassFile(CLASS_FILE, &loaded, &header) != 0;
+            failed |= !failed && replayJournal(&loaded, &header, &last_lsn) < 0;
+            samples[r] = benchNow() - start;
+            failed |= loaded.num != cls.num;
+            releaseClass(&loaded);
+        }
+        if (!failed)
+        {
+            benchReport("load", (int)num, samples, runs, (uint64_t)snapshot_bytes);
+        }
+
+        compact_files = 1;
+        for (int r = 0; r < runs && !failed; r++)
+        {
+            start = benchNow();
+            failed |= saveSnapshot(&cls);
+            samples[r] = benchNow() - start;
+        }
+        compact_files = 0;
+        if (!failed)
+        {
+            benchReport("save_compact", (int)num, samples, runs, (uint64_t)snapshot_bytes);
+        }
+
+        for (int r = 0; r < runs && !failed; r++)
+        {
+            classroom loaded;
+            memset(&loaded, 0, sizeof(loaded));
+            start = benchNow();
+            failed |= loadCompactClassFile(CLASS_FILE, &loaded, &header) != 0;
+            failed |= !failed && replayJournal(&loaded, &header, &last_lsn) < 0;
+            samples[r] = benchNow() - start;
+            failed |= loaded.num != cls.num;
+            releaseClass(&loaded);
+        }
+        failed |= stat(CLASS_FILE, &st) != 0;
+        if (!failed)
+        {
+            benchReport("load_compact", (int)num, samples, runs, (uint64_t)st.st_size);
+        }
+
+        for (int r = 0; r < runs && !failed; r++)
+        {
+            start = benchNow();
+            int fd = open(list_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            failed |= fd < 0 || writeStudentList(fd, &cls, NULL, 0, cls.num) != 0;
+            failed |= fd >= 0 && close(fd) != 0;
+            samples[r] = benchNow() - start;
+        }
+        failed |= stat(list_path, &st) != 0;
+        if (!failed)
+        {
+            benchReport("list", (int)num, samples, runs, (uint64_t)st.st_size);
+        }
+
+        // MEM35-C: One position per student for the name order
+        int *order = malloc((num > 0 ? num : 1) * sizeof(int));
+        failed |= order == NULL;
+        for (int r = 0; r < runs && !failed; r++)
+        {
+            start = benchNow();
+            failed |= sortByName(&cls, order) != 0;
+            samples[r] = benchNow() - start;
+        }
+        if (!failed)
+        {
+            benchReport("sort_name", (int)num, samples, runs, 0);
+        }
+
+        // A filter that compares a name runs its instructions; one on gender and age alone is a table lookup
+        const char *error;
+        student_filter *filter = malloc(sizeof(student_filter));
+        failed |= filter == NULL || compileFilter("age >= 21 && gender == 2 || name == \"anbel corda\"", filter, &error) != 0;
+        for (int r = 0; r < runs && !failed; r++)
+        {
+            start = benchNow();
+            failed |= filterClass(filter, &cls, order) < 0;
+            samples[r] = benchNow() - start;
+        }
+        free(filter);
+        free(order);
+        if (!failed)
+        {
+            benchReport("filter", (int)num, samples, runs, 0);
+        }
+
+        for (int r = 0; r < runs && !failed; r++)
+        {
+            start = benchNow();
+            failed |= priceClass(&cls, rates, classTaxRate(&table, &cls), &price) != 0;
+            samples[r] = benchNow() - start;
+        }
+        if (!failed)
+        {
+            benchReport("cost", (int)num, samples, runs, 0);
+        }
+    }
+    if (failed)
+    {
+        fprintf(stderr, "ERROR: A benchmarked operation failed.\n");
+    }
+
+    releaseClass(&cls);
+    free(samples);
+    remove(CLASS_FILE);
+    remove(JOURNAL_FILE);
+    remove(list_path);
+    // FIO45-C: The scratch directory is left through the descriptor of the starting one, not by its name
+    failed |= fchdir(home) != 0;
+    close(home);
+    rmdir(scratch);
+    return failed || bad_size;
+}
+
+/**
+ * @brief Grows a class to num synthetic students one at a time, as student entry does
+ *
+ * Names are built from syllables by a seeded xorshift generator, so every run of a size enters the same
+ * mix of repeated and distinct names; ages and genders cover their whole ranges.
+ *
+ * @param cls The class, with no students
+ * @param num The number of students to add
+ * @param seed The generator seed, not 0
+ * @return int 0 on success, 1 if memory ran out
+ */
+int benchRoster(classroom *cls, int num, uint32_t seed)
+{
+    static const char *const syllables[16] = {"an", "bel", "cor", "da", "el", "fin", "gar", "ho",
+                                              "is", "jo", "ka", "lin", "mar", "nor", "ol", "per"};
+    student s;
+    uint32_t x = seed;
+
+    memset(&s, 0, sizeof(s));
+    for (int i = 0; i < num; i++)
+    {
+        size_t len = 0;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        // Two words of two or three syllables each
+        for (int word = 0, bits = (int)x; word < 2; word++)
+        {
+            int count = 2 + (bits & 1);
+            bits >>= 1;
+            for (int k = 0; k < count; k++, bits >>= 4)
+            {
+                size_t n = strlen(syllables[bits & 15]);
+                memcpy(s.name + len, syllables[bits & 15], n);
+                len += n;
+            }
+            s.name[len++] = word == 0 ? ' ' : '\0';
+        }
+        s.gender = 1 + (int)(x % 3);
+        s.age = 1 + (int)((x >> 8) % MAX_AGE);
+
+        if (reserveStudents(cls, i + 1) != 0 || setStudent(cls, i, &s) != 0)
+        {
+            return 1;
+        }
+        cls->num = i + 1;
+        indexInsert(cls, i);
+        markDirty(cls, i);
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads the monotonic clock
+ *
+ * @return double Milliseconds since an arbitrary start
+ */
+double benchNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+/**
+ * @brief Prints the timings of one benchmarked operation as a single-line JSON object
+ *
+ * Throughput is worked out from the median run.
+ *
+ * @param op The operation's name
+ * @param num The number of students in the class
+ * @param samples The duration of each run in milliseconds; sorted in place
+ * @param runs The number of runs
+ * @param bytes The bytes each run moved, or 0 if it does no file I/O
+ */
+void benchReport(const char *op, int num, double *samples, int runs, uint64_t bytes)
+{
+    struct rusage usage;
+    double total = 0;
+
+    qsort(samples, runs, sizeof(double), compareDoubles);
+    for (int r = 0; r < runs; r++)
+    {
+        total += samples[r];
+    }
+    // Percentiles by nearest rank
+    double p50 = samples[(runs * 50 + 99) / 100 - 1];
+    double p90 = samples[(runs * 90 + 99) / 100 - 1];
+    double p99 = samples[(runs * 99 + 99) / 100 - 1];
+    // FLP03-C: A median of 0 ms (below the clock's resolution) reports no throughput rather than dividing by 0
+    double seconds = p50 / 1000.0;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("{\"op\":\"%s\",\"students\":%d,\"runs\":%d,\"bytes\":%llu,\"mean_ms\":%.3f,\"p50_ms\":%.3f,\"p90_ms\":%.3f,"
+           "\"p99_ms\":%.3f,\"max_ms\":%.3f,\"students_per_s\":%.0f,\"mb_per_s\":%.1f,\"peak_rss_kb\":%ld}\n",
+           op, num, runs, (unsigned long long)bytes, total / runs, p50, p90, p99, samples[runs - 1],
+           seconds > 0 ? num / seconds : 0.0, seconds > 0 ? (double)bytes / 1e6 / seconds : 0.0, usage.ru_maxrss);
+    fflush(stdout);
+}
+
+/**
+ * @brief Reads the monotonic clock for the operation statistics
+ *
+ * @return uint64_t Nanoseconds since an arbitrary start
+ */
+uint64_t statsNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Counts one call of an operation with its duration and the bytes it moved
+ *
+ * File I/O bytes are also added to io_bytes, so that each menu action is credited with the I/O done under it.
+ *
+ * @param op The operation's counter, STAT_MENU + choice or one of the other STAT_ values
+ * @param ns The duration in nanoseconds
+ * @param bytes The bytes read or written
+ */
+void statsAdd(int op, uint64_t ns, uint64_t bytes)
+{
+    op_stat *stat = &op_stats[op];
+    unsigned long long max = atomic_load_explicit(&stat->max_ns, memory_order_relaxed);
+
+    // CON43-C: The counters are only ever changed by atomic operations, so concurrent workers never lose an update
+    atomic_fetch_add_explicit(&stat->calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat->ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat->bytes, bytes, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&stat->max_ns, &max, ns, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    if (op >= STAT_IMPORT_READ)
+    {
+        atomic_fetch_add_explicit(&io_bytes, bytes, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Outputs the operation statistics of this session
+ */
+void showStatistics(void)
+{
+    printf("\n");
+    writeStatistics(stdout, 0);
+}
+
+/**
+ * @brief Writes every operation that has been called at least once, with its calls, time and bytes
+ *
+ * Menu actions exclude the time spent waiting at their prompts and include the bytes of the file I/O
+ * done under them.
+ *
+ * @param fp Where to write
+ * @param json 1 for one JSON object per line, 0 for a table
+ */
+void writeStatistics(FILE *fp, int json)
+{
+    // FLP06-C: Nanosecond counts are converted to double before they are divided down to milliseconds
+    double session_ms = (double)(statsNow() - session_start) / 1e6;
+
+    if (json)
+    {
+        fprintf(fp, "{\"op\":\"session\",\"total_ms\":%.3f,\"io_bytes\":%llu}\n", session_ms,
+                (unsigned long long)atomic_load_explicit(&io_bytes, memory_order_relaxed));
+    }
+    else
+    {
+        fprintf(fp, "Session time: %.3f s\n%-28s %8s %12s %10s %10s %14s\n", session_ms / 1000, "Operation", "Calls",
+                "Total ms", "Mean ms", "Max ms", "Bytes");
+    }
+    for (int op = 0; op < STAT_COUNT; op++)
+    {
+        unsigned long long calls = atomic_load_explicit(&op_stats[op].calls, memory_order_relaxed);
+        double total_ms = (double)atomic_load_explicit(&op_stats[op].ns, memory_order_relaxed) / 1e6;
+        double max_ms = (double)atomic_load_explicit(&op_stats[op].max_ns, memory_order_relaxed) / 1e6;
+        unsigned long long bytes = atomic_load_explicit(&op_stats[op].bytes, memory_order_relaxed);
+
+        if (calls == 0)
+        {
+            continue;
+        }
+        if (json)
+        {
+            fprintf(fp, "{\"op\":\"%s\",\"calls\":%llu,\"total_ms\":%.3f,\"mean_ms\":%.3f,\"max_ms\":%.3f,\"bytes\":%llu}\n",
+                    stat_names[op], calls, total_ms, total_ms / calls, max_ms, bytes);
+        }
+        else
+        {
+            fprintf(fp, "%-28s %8llu %12.3f %10.3f %10.3f %14llu\n", stat_names[op], calls, total_ms, total_ms / calls, max_ms, bytes);
+        }
+    }
+}
+
+/**
+ * @brief Writes the operation statistics to the --stats-file file; registered with atexit
+ */
+void dumpStatistics(void)
+{
+    // FIO24-C: file opened only once
+    FILE *fp = fopen(stats_file, "w");
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "ERROR: Could not write statistics file '%s'.\n", stats_file);
+        return;
+    }
+    writeStatistics(fp, 1);
+    if (fclose(fp) != 0)
+    {
+        fprintf(stderr, "ERROR: Could not write statistics file '%s'.\n", stats_file);
+    }
+}
+
+/**
+ * @brief Serves the catalog to local clients over a Unix domain socket until SIGINT or SIGTERM
+ *
+ * Each client gets its own thread and sends one request per line (see handleRequest). Requests that only
+ * read the catalog run in parallel under the read side of catalog_lock; requests that change it, or save
+ * it, take the write side and so run one at a time. Every response is a status line ("OK ..." or
+ * "ERROR: ..."), an optional body, and a NUL byte.
+ *
+ * @param path The socket path; a stale socket left at it by an earlier server is replaced
+ * @return int 0 when stopped by a signal, 1 if the socket cannot be set up
+ */
+int runServer(const char *path)
+{
+    struct sockaddr_un addr;
+    struct sigaction action;
+    struct stat st;
+    pthread_attr_t attr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    // STR31-C: The path must fit in sun_path with its terminator
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "ERROR: Socket path '%s' is longer than %zu characters.\n", path, sizeof(addr.sun_path) - 1);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || listen(fd, SERVER_BACKLOG) != 0)
+    {
+        fprintf(stderr, "ERROR: Could not listen on '%s': %s.\n", path, strerror(errno));
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+
+    // SIG30-C: The handler only sets a sig_atomic_t flag. Without SA_RESTART, accept returns EINTR so the flag is seen.
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    // A client that disconnects mid-response makes write fail with EPIPE instead of killing the server
+    signal(SIGPIPE, SIG_IGN);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    printf("Serving %d classes on %s.\n", catalog.count, path);
+    fflush(stdout);
+
+    while (!server_stop)
+    {
+        pthread_t thread;
+        int *client = NULL;
+        int cfd = accept(fd, NULL, NULL);
+
+        if (cfd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            break;
+        }
+        if (atomic_fetch_add(&client_count, 1) >= MAX_CLIENTS || (client = malloc(sizeof(int))) == NULL)
+        {
+            static const char busy[] = "ERROR: Too many clients, try again later.\n";
+            writeAll(cfd, busy, sizeof(busy), STAT_SOCKET_WRITE); // sizeof includes the terminating NUL that ends a response
+            close(cfd);
+            atomic_fetch_sub(&client_count, 1);
+            free(client);
+            continue;
+        }
+        *client = cfd;
+        if (pthread_create(&thread, &attr, serveClient, client) != 0)
+        {
+            close(cfd);
+            atomic_fetch_sub(&client_count, 1);
+            free(client);
+        }
+    }
+    pthread_attr_destroy(&attr);
+    close(fd);
+    unlink(path);
+
+    // CON31-C: Holding the write lock from here on lets a change in progress finish, and keeps any other from starting while the process exits
+    pthread_rwlock_wrlock(&catalog_lock);
+    finishCompaction(1);
+    printf("Server stopped.\n");
+    return 0;
+}
+
+/**
+ * @brief Signal handler that asks runServer to stop accepting clients
+ *
+ * @param sig The signal
+ */
+void stopServer(int sig)
+{
+    (void)sig;
+    server_stop = 1;
+}
+
+/**
+ * @brief Answers one client's requests until it sends QUIT or disconnects
+ *
+ * @param arg The client's socket, in a malloc'd int that this thread frees
+ * @return void* NULL
+ */
+void *serveClient(void *arg)
+{
+    int fd = *(int *)arg;
+    char line[SERVER_LINE];
+    reply_buffer *out = calloc(1, sizeof(reply_buffer));
+    FILE *in;
+
+    free(arg);
+    // FIO24-C: The socket is read through stdio and written directly; closing in also closes it
+    if (out == NULL || (out->data = malloc(LIST_BUFFER_SIZE)) == NULL || (in = fdopen(fd, "r")) == NULL)
+    {
+        close(fd);
+        if (out != NULL)
+        {
+            free(out->data);
+        }
+        free(out);
+        atomic_fetch_sub(&client_count, 1);
+        return NULL;
+    }
+    out->fd = fd;
+    out->capacity = LIST_BUFFER_SIZE;
+    while (fgets(line, SERVER_LINE, in) != NULL)
+    {
+        size_t len = strlen(line);
+        int c;
+
+        out->len = 0;
+        out->failed = 0;
+        out->out_of_memory = 0;
+        if (len > 0 && line[len - 1] != '\n' && !feof(in))
+        {
+            // The rest of an overlong line is dropped so that it is not read as another request
+            while ((c = getc(in)) != '\n' && c != EOF)
+            {
+            }
+            replyf(out, "ERROR: Request longer than %d characters.\n", SERVER_LINE - 2);
+        }
+        else
+        {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (handleRequest(out, line) != 0)
+            {
+                replyEnd(out);
+                break;
+            }
+        }
+        if (replyEnd(out) != 0)
+        {
+            break; // The client went away
+        }
+    }
+    fclose(in);
+    free(out->data);
+    free(out);
+    atomic_fetch_sub(&client_count, 1);
+    return NULL;
+}
+
+/**
+ * @brief Carries out one client request
+ *
+ * Requests (class codes are CATEGORY-COURSE-SECTION):
+ *   CLASSES                   list the classes in the catalog
+ *   DETAILS CODE              show a class's code and number of students
+ *   LIST CODE [FIRST [COUNT]] list a class's students, optionally from position FIRST (from 1)
+ *   COST CODE AMOUNT          price a class at AMOUNT per student not covered by a pricing tier
+ *   ADD CODE NAME,GENDER,AGE  add a student, creating the class if it is new
+ *   SAVE CODE                 save a class to class_list
+ *   LOAD                      load the class in class_list into the catalog
+ *   QUIT                      end the session
+ *
+ * @param out The client's reply buffer
+ * @param line The request, without its line ending (modified)
+ * @return int 1 if the client asked to quit, 0 otherwise
+ */
+int handleRequest(reply_buffer *out, char *line)
+{
+    char command[16];
+    char code[CLASS_CODE_BUFFER];
+    classroom key;
+    classroom *cls;
+    int consumed = 0;
+
+    memset(&key, 0, sizeof(key));
+    if (sscanf(line, " %15s %n", command, &consumed) != 1)
+    {
+        replyf(out, "ERROR: Empty request.\n");
+        return 0;
+    }
+    char *args = line + consumed;
+
+    if (strcasecmp(command, "QUIT") == 0)
+    {
+        replyf(out, "OK Goodbye.\n");
+        return 1;
+    }
+    if (strcasecmp(command, "CLASSES") == 0)
+    {
+        pthread_rwlock_rdlock(&catalog_lock);
+        replyf(out, "OK %d classes.\n", catalog.count);
+        for (int i = 0; i < catalog.count; i++)
+        {
+            formatClassCode(catalog.classes[i], code);
+            replyf(out, "%-*s %d students\n", CLASS_CODE_BUFFER, code, catalog.classes[i]->num);
+        }
+        pthread_rwlock_unlock(&catalog_lock);
+        return 0;
+    }
+    if (strcasecmp(command, "LOAD") == 0)
+    {
+        pthread_rwlock_wrlock(&catalog_lock);
+        int status = loadClassList(&cls);
+        audit("load", status == 0 ? cls : NULL, "file=%s via=socket %s", CLASS_FILE, status == 0 ? "ok" : "failed");
+        if (status == 0)
         {
-            while ((c = getchar()) != '\n' && c != EOF); // There's at least one trailing \n
+            formatClassCode(cls, code);
+            replyf(out, "OK Class %s of %d students loaded.\n", code, cls->num);
         }
-        // ERR33-C: Checking to see if a integer was parsed from the string (and if it's valid)
-        if (sscanf(num_buffer, "%d", &(p->age)) != 1 || p->age < 0) 
+        else
         {
-            printf("\nERROR: Ivalid input. Input should have be a positive integer (1-99).\nERROR: Add Students function failed. Please try again.\n");
-            *num = 0; // Number of students set to zero, making the data unreadable
-            read_failed = 1;
-            break;
-        } 
+            replyf(out, "ERROR: %s\n", status == -1 ? "Read failed." : status == -2 ? "Class file is damaged or from an unsupported version." : "Out of memory.");
+        }
+        pthread_rwlock_unlock(&catalog_lock);
+        return 0;
+    }
 
-        printf("\nStudent added! %d students left to add.\n", *num - i - 1);
-        p++;
+    // The remaining requests start with a class code
+    size_t code_len = strcspn(args, " \t");
+    if (code_len == 0 || code_len >= CLASS_CODE_BUFFER)
+    {
+        replyf(out, "ERROR: Unknown request or missing class code. Requests: CLASSES, DETAILS, LIST, COST, ADD, SAVE, LOAD, QUIT.\n");
+        return 0;
     }
-    if (read_failed != 1) {
-        printf("All students have been added.\n");
+    memcpy(code, args, code_len);
+    code[code_len] = '\0';
+    args += code_len + strspn(args + code_len, " \t");
+    if (parseClassCode(code, &key) != 0)
+    {
+        replyf(out, "ERROR: Invalid class code %s.\n", code);
+        return 0;
+    }
+
+    if (strcasecmp(command, "ADD") == 0 || strcasecmp(command, "SAVE") == 0)
+    {
+        pthread_rwlock_wrlock(&catalog_lock);
+        updateClass(out, command, &key, args);
     }
-    prompt(1, num);
+    else
+    {
+        pthread_rwlock_rdlock(&catalog_lock);
+        cls = findClass(&catalog, &key);
+        if (cls != NULL && cls->image != NULL && strcasecmp(command, "DETAILS") != 0)
+        {
+            // A class opened by its header alone has its students paged in under the write lock, which is
+            // then kept for the request; the class is looked up again since the catalog may have changed
+            pthread_rwlock_unlock(&catalog_lock);
+            pthread_rwlock_wrlock(&catalog_lock);
+            if ((cls = findClass(&catalog, &key)) != NULL && pageInClass(cls) != 0)
+            {
+                replyf(out, "ERROR: Class %s is damaged.\n", code);
+                pthread_rwlock_unlock(&catalog_lock);
+                return 0;
+            }
+        }
+        if (cls == NULL)
+        {
+            replyf(out, "ERROR: No class %s in the catalog.\n", code);
+        }
+        else
+        {
+            readClass(out, command, cls, args);
+        }
+    }
+    pthread_rwlock_unlock(&catalog_lock);
+    return 0;
 }
 
 /**
- * @brief Outputs the details of the class.
+ * @brief Carries out a request that only reads a class: DETAILS, LIST or COST
  *
- * @param num The number of students in the class
+ * @param out The client's reply buffer
+ * @param command The request's command
+ * @param cls The class; the caller holds catalog_lock for reading, and sends the reply once it lets go of it
+ * @param args The rest of the request
  */
-void viewClassDetails(int *num) {
-    if (*num < 1)
+void readClass(reply_buffer *out, const char *command, const classroom *cls, const char *args)
+{
+    char code[CLASS_CODE_BUFFER];
+
+    formatClassCode(cls, code);
+    if (strcasecmp(command, "DETAILS") == 0)
     {
-        printf("\nERROR: No class data to display. You may enter new, or load existing data.\n");
+        replyf(out, "OK\nCategory: %s\nCourse:   %s\nSection:  %s\nStudents: %d\n", cls->category, cls->course_num,
+               cls->section_num, cls->num);
+    }
+    else if (strcasecmp(command, "LIST") == 0)
+    {
+        long first = 1;
+        long count = cls->num;
+        int fields = sscanf(args, "%ld %ld", &first, &count);
+        if ((fields >= 1 && (first < 1 || first > cls->num + 1L)) || (fields == 2 && count < 0))
+        {
+            replyf(out, "ERROR: FIRST should be 1-%d and COUNT not negative.\n", cls->num + 1);
+            return;
+        }
+        if (count > cls->num - (first - 1))
+        {
+            count = cls->num - (first - 1);
+        }
+        replyf(out, "OK %ld students.\n", count);
+        // The list is formatted into the reply, which is only sent once the caller lets go of catalog_lock
+        for (long k = first - 1; k < first - 1 + count && replyReserve(out, LIST_ENTRY_MAX) == 0; k++)
+        {
+            out->len = (size_t)(formatStudent(out->data + out->len, cls, (int)k) - out->data);
+        }
+    }
+    else if (strcasecmp(command, "COST") == 0)
+    {
+        pricing_table table = pricing;
+        money rates[RATE_SLOTS];
+        class_price price;
+        char subtotal[MONEY_BUFFER];
+        char tax[MONEY_BUFFER];
+        char total[MONEY_BUFFER];
+
+        if (parseMoney(args, &table.base_rate) != 0)
+        {
+            replyf(out, "ERROR: AMOUNT should be a positive amount with at most %d decimals.\n", MONEY_DIGITS);
+            return;
+        }
+        buildRateTable(&table, rates);
+        if (priceClass(cls, rates, classTaxRate(&table, cls), &price) != 0)
+        {
+            replyf(out, "ERROR: The cost of %s exceeds the maximum value.\n", code);
+            return;
+        }
+        formatMoney(price.subtotal, subtotal);
+        formatMoney(price.tax, tax);
+        formatMoney(price.total, total);
+        audit("cost", cls, "students=%d total=%s via=socket ok", price.students, total);
+        replyf(out, "OK\nStudents: %d\nCost: %s\nTax at %d.%02d%%: %s\nTotal: %s\n", price.students, subtotal,
+               price.tax_rate / 100, price.tax_rate % 100, tax, total);
     }
     else
     {
-        printf("\nCategory: %s\nCourse:   %s\nSection:  %s\n", category, course_num, section_num);
+        replyf(out, "ERROR: Unknown request %s.\n", command);
     }
-    prompt(1, num);
 }
 
 /**
- * @brief Outputs the current class data
+ * @brief Carries out a request that changes or saves a class: ADD or SAVE
  *
- * @param student_ptr The pointer to the first of num student structs
- * @param num The number of students in the class
+ * @param out The client's reply buffer
+ * @param command The request's command
+ * @param key The class code
+ * @param args The rest of the request (modified)
  */
-void viewClassList(student *student_ptr, int *num)
+void updateClass(reply_buffer *out, const char *command, const classroom *key, char *args)
 {
-    if (*num < 1)
+    char code[CLASS_CODE_BUFFER];
+    classroom *cls = findClass(&catalog, key);
+    student s;
+
+    formatClassCode(key, code);
+    if (cls != NULL && pageInClass(cls) != 0)
     {
-        printf("\nERROR: No student data to display. You may enter new, or load existing data.\n");
+        replyf(out, "ERROR: Class %s is damaged.\n", code);
+        return;
     }
-    else
+    if (strcasecmp(command, "SAVE") == 0)
     {
-        for (int i = 0; i < *num; i++)
+        if (cls == NULL)
+        {
+            replyf(out, "ERROR: No class %s in the catalog.\n", code);
+        }
+        else if (saveClass(cls) != 0)
+        {
+            audit("save", cls, "file=%s via=socket failed", CLASS_FILE);
+            replyf(out, "ERROR: Write failed.\n");
+        }
+        else
         {
-            printf("\nStudent Name:\t%s\n", student_ptr->name);
+            audit("save", cls, "file=%s via=socket students=%d ok", CLASS_FILE, cls->num);
+            replyf(out, "OK Class %s saved.\n", code);
+        }
+        return;
+    }
 
-            if (student_ptr->gender == 1)
-            {
-                printf("\tGender:\tMale\n");
-            }
-            else if (student_ptr->gender == 2)
-            {
-                printf("\tGender:\tFemale\n");
-            }
-            else
-            {
-                printf("\tGender:\tOther\n");
-            }
+    memset(&s, 0, sizeof(s));
+    const char *reason = parseStudentRecord(args, &s);
+    if (reason != NULL)
+    {
+        replyf(out, "ERROR: Student rejected: %s.\n", reason);
+        return;
+    }
+    if (cls == NULL && (cls = catalogClass(&catalog, key)) == NULL)
+    {
+        replyf(out, "ERROR: Out of memory.\n");
+        return;
+    }
+    int index = cls->num;
+    if (index == MAX_STUDENTS || reserveStudents(cls, index + 1) != 0 || setStudent(cls, index, &s) != 0)
+    {
+        replyf(out, "ERROR: No room for another student in %s.\n", code);
+        return;
+    }
+    cls->num = index + 1;
+    indexInsert(cls, index);
+    markDirty(cls, index);
+    audit("add", cls, "added=1 via=socket students=%d", cls->num);
+    replyf(out, "OK Student %d added to %s.\n", cls->num, code);
+}
+
+/**
+ * @brief Appends formatted text to a client's reply, growing the reply to fit it
+ *
+ * @param out The reply buffer
+ * @param format The printf format
+ */
+void replyf(reply_buffer *out, const char *format, ...)
+{
+    va_list args;
+    int len;
+
+    // FIO47-C: The format strings are the program's own; vsnprintf bounds the text to the room reserved
+    if (replyReserve(out, LIST_ENTRY_MAX) != 0)
+    {
+        return;
+    }
+    va_start(args, format);
+    len = vsnprintf(out->data + out->len, out->capacity - out->len, format, args);
+    va_end(args);
+    if (len > 0 && (size_t)len >= out->capacity - out->len && replyReserve(out, (size_t)len + 1) == 0)
+    {
+        // The text was cut short, so it is formatted again now that there is room for all of it
+        va_start(args, format);
+        vsnprintf(out->data + out->len, out->capacity - out->len, format, args);
+        va_end(args);
+    }
+    if (len > 0 && !out->out_of_memory)
+    {
+        out->len += (size_t)len;
+    }
+}
 
-            printf("\tAge:\t%d\n", student_ptr->age);
+/**
+ * @brief Makes room for more of a client's reply, doubling the buffer as often as needed
+ *
+ * @param out The reply buffer
+ * @param need The bytes needed past the reply so far
+ * @return int 0 on success, -1 if memory ran out (out_of_memory is set and the reply is dropped)
+ */
+int replyReserve(reply_buffer *out, size_t need)
+{
+    size_t capacity = out->capacity;
 
-            // Increment student
-            // ARR39-C: Valid incrementation to a pointer
-            student_ptr++;
+    if (out->out_of_memory)
+    {
+        return -1;
+    }
+    while (capacity - out->len < need)
+    {
+        // INT30-C: The doubling stops before it can wrap
+        if (capacity > SIZE_MAX / 2)
+        {
+            capacity = 0;
+            break;
         }
+        capacity *= 2;
     }
+    if (capacity != out->capacity)
+    {
+        char *grown = capacity != 0 ? realloc(out->data, capacity) : NULL;
+        if (grown == NULL)
+        {
+            out->out_of_memory = 1;
+            out->len = 0;
+            return -1;
+        }
+        out->data = grown;
+        out->capacity = capacity;
+    }
+    return 0;
+}
 
-    prompt(1, num); // Return to user prompt
+/**
+ * @brief Writes out what a client's reply has buffered
+ *
+ * @param out The reply buffer
+ * @return int 0 on success, -1 if this or an earlier write failed
+ */
+int replyFlush(reply_buffer *out)
+{
+    if (!out->failed && out->len > 0 && writeAll(out->fd, out->data, out->len, STAT_SOCKET_WRITE) != 0)
+    {
+        out->failed = 1;
+    }
+    out->len = 0;
+    return out->failed ? -1 : 0;
 }
 
 /**
- * @brief Saves the student data to class_list.txt
+ * @brief Ends a client's reply with the NUL byte that marks the end of a response, and sends it
  *
- * @param p The pointer to the student data
- * @param num The number of students in the class
+ * @param out The reply buffer
+ * @return int 0 on success, -1 if the reply could not be sent
  */
-void save(student *p, int *num)
+int replyEnd(reply_buffer *out)
 {
-    // FIO24-C: file opened only once
-    FILE *fp = fopen("class_list", "w+");
+    int status;
 
-    if (fp)
+    if (out->out_of_memory)
     {
-        fwrite(num, sizeof(int), 1, fp);
-        fwrite(p, sizeof(student), *num, fp);
-        fwrite(category, sizeof(char), CLASS_CODE_LENGTH, fp);
-        fwrite(course_num, sizeof(char), CLASS_CODE_LENGTH, fp);
-        fwrite(section_num, sizeof(char), CLASS_CODE_LENGTH, fp);
-        fclose(fp);
+        // The buffer still holds at least LIST_BUFFER_SIZE bytes, plenty for the error
+        out->len = (size_t)snprintf(out->data, out->capacity, "ERROR: Out of memory.\n");
     }
-    printf("\nClass Saved.\n");
-    prompt(1, num);
+    if (out->len == out->capacity)
+    {
+        replyFlush(out);
+    }
+    out->data[out->len++] = '\0';
+    status = replyFlush(out);
+    // MEM31-C: A buffer grown for a large reply is given back rather than kept while the client is idle
+    if (out->capacity > LIST_BUFFER_SIZE)
+    {
+        char *shrunk = realloc(out->data, LIST_BUFFER_SIZE);
+        if (shrunk != NULL)
+        {
+            out->data = shrunk;
+            out->capacity = LIST_BUFFER_SIZE;
+        }
+    }
+    return status;
 }
 
 /**
- * @brief Loads in student data from class_list.txt
+ * @brief Sends each line of stdin to a server as a request and prints its response
  *
- * @param p The pointer to the student data
- * @param num The number of students in the class
- * @param flag Flag to indicate if data needs to be freed
+ * @param path The server's socket path
+ * @return int 0 when input ends, 1 if the server cannot be reached or goes away
  */
-void load(student *p, int *num, int flag)
+int runClient(const char *path)
 {
-    *num = 0;
-    // FIO24-C: file opened only once
-    FILE *fp = fopen("class_list", "r");
-    if (fp) // ERR33-C: If fopen fails, the user is alerted and the program returns to the prompt 
-    { 
-        fread(num, sizeof(int), 1, fp);
-        // fseek(fp, 0L, SEEK_END);
-        // long size = ftell(fp);
-        // *num = size / (sizeof(student));
-        // fseek(fp, 0L, SEEK_SET);
-
-        if (flag == 1) {
-            free(data); // MEM34-C: The data variable was dynamically allocated and thus can be freed
-        }
-        data = (student *) malloc((*num) * sizeof(student));
-        p = data;
-        
-        fread(data, sizeof(student), *num, fp);
-        fread(category, sizeof(char), CLASS_CODE_LENGTH, fp);
-        fread(course_num, sizeof(char), CLASS_CODE_LENGTH, fp);
-        fread(section_num, sizeof(char), CLASS_CODE_LENGTH, fp);
-        printf("\nClass of %d students loaded.\n", *num);
+    struct sockaddr_un addr;
+    char line[SERVER_LINE];
+    char buffer[LIST_BUFFER_SIZE];
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        fprintf(stderr, "ERROR: Could not connect to '%s'.\n", path);
+        return 1;
     }
-    else
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
     {
-        printf("\nERROR: Read Failed!\nERROR: Load Class File function failed. Please try again.\n");
+        fprintf(stderr, "ERROR: Could not connect to '%s': %s.\n", path, strerror(errno));
+        close(fd);
+        return 1;
     }
+    signal(SIGPIPE, SIG_IGN);
+
+    while (fgets(line, SERVER_LINE, stdin) != NULL)
+    {
+        size_t len = strlen(line);
+        int done = 0;
 
-    prompt(1, num);
+        if (len == 0 || line[len - 1] != '\n')
+        {
+            line[len++] = '\n'; // fgets left room for the terminator, which the newline replaces
+        }
+        if (writeAll(fd, line, len, STAT_SOCKET_WRITE) != 0)
+        {
+            break;
+        }
+        int quit = strncasecmp(line, "QUIT", 4) == 0 && (line[4] == '\n' || line[4] == '\r' || line[4] == ' ');
+        fflush(stdout);
+        // The response runs up to its NUL byte
+        while (!done)
+        {
+            ssize_t got = read(fd, buffer, LIST_BUFFER_SIZE);
+            if (got < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (got <= 0)
+            {
+                fprintf(stderr, "ERROR: The server closed the connection.\n");
+                close(fd);
+                return 1;
+            }
+            char *end = memchr(buffer, '\0', (size_t)got);
+            done = end != NULL;
+            writeAll(STDOUT_FILENO, buffer, done ? (size_t)(end - buffer) : (size_t)got, STAT_LIST_WRITE);
+        }
+        if (quit)
+        {
+            break;
+        }
+    }
+    close(fd);
+    return 0;
 }
 
 /**
- * @brief Utlizies macro statements to calculate the costs to maintain a student class
+ * @brief Starts the audit writer thread, which appends every audited action to AUDIT_FILE
  *
- * @param p The Pointer to the first of num student structs
- * @param num The number of students in the class
+ * The log is only ever appended to, one line per action, and rotated once it reaches AUDIT_ROTATE bytes
+ * (see rotateAudit). stopAudit writes out what is still queued when the program exits.
+ *
+ * @return int 0 on success, -1 if the log cannot be opened or the thread started
  */
-void calculateCost(int *num)
+int startAudit(void)
 {
-    // ARR32-C: valid size input for arrays
-    char curr_type[2];
-    char num_buffer[6];
-    char c;
-    char dollar = '$';
-    // STR00-C: This scenario necessitates the wchar_t type
-    wchar_t euro = L'€';
+    // FIO24-C: file opened only once and is private to admins
+    int fd = open(AUDIT_FILE, O_WRONLY | O_APPEND | O_CREAT, 0600);
 
-    if (*num < 1)
+    if (fd < 0)
     {
-        printf("\nNo student data to calculate. You may enter new, or load existing data.\n");
+        return -1;
     }
-    else
+    for (unsigned i = 0; i < AUDIT_QUEUE; i++)
+    {
+        atomic_init(&audit_queue[i].seq, i);
+    }
+    // CON39-C: The thread is joined by stopAudit, never detached
+    if (pthread_create(&audit_thread, NULL, auditWriter, (void *)(intptr_t)fd) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    audit_running = 1;
+    // ERR06-C: The queue is written out by an atexit handler, so every way out of main keeps the audit trail
+    if (atexit(stopAudit) != 0)
+    {
+        stopAudit();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Stops the audit writer once it has written out every queued record
+ */
+void stopAudit(void)
+{
+    if (audit_running)
+    {
+        audit_running = 0;
+        atomic_store(&audit_stop, 1);
+        pthread_join(audit_thread, NULL);
+    }
+}
+
+/**
+ * @brief Adds a record of an action to the audit queue without waiting for it to be written
+ *
+ * Safe to call from any thread: the record's place is claimed with a compare-and-swap, so no lock is ever
+ * taken. When the queue is full the record is dropped and counted instead of holding up the caller.
+ *
+ * @param event The action, such as "save"
+ * @param cls The class it acted on (may be NULL)
+ * @param format The printf format of the action's details, such as its result
+ */
+void audit(const char *event, const classroom *cls, const char *format, ...)
+{
+    char code[CLASS_CODE_BUFFER];
+    va_list args;
+    audit_slot *slot;
+    unsigned pos;
+    size_t len;
+
+    if (!audit_running)
+    {
+        return;
+    }
+    pos = atomic_load_explicit(&audit_head, memory_order_relaxed);
+    for (;;)
     {
-        printf("\n\tCurrency Type [1=Dollars, 2=Euro]: ");
-        fgets(curr_type, 2, stdin);
-        while ((c = getchar()) != '\n' && c != EOF); // There's at least one trailing \n
-        // ERR33-C: Checking to see if string input is valid
-        if (!(curr_type[0] == '1' || curr_type[0] == '2')) {
-            printf("\nERROR: Invalid input. Currency Type should be an integer (1-2).\nERROR: Calculate Cost of Class function failed. Please try again.\n");
+        slot = &audit_queue[pos & (AUDIT_QUEUE - 1)];
+        int diff = (int)(atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&audit_head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            atomic_fetch_add_explicit(&audit_dropped, 1, memory_order_relaxed);
             return;
         }
-
-        int *cost_per = malloc(sizeof(int));
-        printf("\tPlease enter the cost per student: ");
-        
-        // Print correct currency type
-        // STR38-C: wchar_t functions used to print character to stdout
-        if (curr_type[0] == '1') {
-            putchar(dollar);
+        else
+        {
+            pos = atomic_load_explicit(&audit_head, memory_order_relaxed);
         }
-        else if (curr_type[0] == '2') {
-            putwchar(euro);
+    }
+
+    timespec_get(&slot->when, TIME_UTC);
+    if (cls != NULL)
+    {
+        formatClassCode(cls, code);
+    }
+    // FIO47-C: The format strings are the program's own; snprintf bounds the record to its slot
+    len = (size_t)snprintf(slot->text, AUDIT_TEXT, cls != NULL ? "%s class=%s " : "%s ", event, code);
+    if (len < AUDIT_TEXT)
+    {
+        va_start(args, format);
+        vsnprintf(slot->text + len, AUDIT_TEXT - len, format, args);
+        va_end(args);
+    }
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+/**
+ * @brief Writes the audit queue out to the audit log in batches until stopAudit is called
+ *
+ * If the log cannot be opened again after a rotation, records wait in the queue (and are counted as dropped
+ * once it fills) while the open is retried.
+ *
+ * @param arg The audit log's file descriptor
+ * @return void* NULL
+ */
+void *auditWriter(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    off_t size = lseek(fd, 0, SEEK_END);
+    char *batch = malloc(AUDIT_BATCH);
+    struct timespec idle = {0, AUDIT_IDLE_NS};
+
+    while (batch != NULL)
+    {
+        size_t len = 0;
+        size_t line;
+        unsigned dropped;
+
+        if (fd < 0)
+        {
+            if ((fd = open(AUDIT_FILE, O_WRONLY | O_APPEND | O_CREAT, 0600)) >= 0)
+            {
+                fprintf(stderr, "\nAudit log '%s' reopened.\n", AUDIT_FILE);
+                size = lseek(fd, 0, SEEK_END);
+            }
+            else if (atomic_load(&audit_stop))
+            {
+                fprintf(stderr, "\nERROR: %u audit records were not written: the audit log '%s' could not be reopened.\n",
+                        atomic_load(&audit_head) - audit_tail + atomic_load(&audit_dropped), AUDIT_FILE);
+                break;
+            }
+            else
+            {
+                nanosleep(&idle, NULL);
+                continue;
+            }
         }
+        // ARR30-C: Room for one more line is always kept, for the line that counts dropped records
+        while (len + 2 * AUDIT_LINE <= AUDIT_BATCH)
+        {
+            audit_slot *slot = &audit_queue[audit_tail & (AUDIT_QUEUE - 1)];
+            char stamp[32];
+            struct tm utc;
 
-        // Get calculateCost-per-student
-        if (strlen(fgets(num_buffer, 6, stdin)) == 5 && num_buffer[4] != '\n') {
-            while ((c = getchar()) != '\n' && c != EOF);
+            if (atomic_load_explicit(&slot->seq, memory_order_acquire) != audit_tail + 1)
+            {
+                break;
+            }
+            gmtime_r(&slot->when.tv_sec, &utc);
+            strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+            line = (size_t)snprintf(batch + len, AUDIT_LINE, "%s.%03ldZ session=%ld user=%s %s\n", stamp,
+                                    slot->when.tv_nsec / 1000000, audit_session, audit_user, slot->text);
+            len += line < AUDIT_LINE ? line : AUDIT_LINE - 1;
+            atomic_store_explicit(&slot->seq, audit_tail + AUDIT_QUEUE, memory_order_release);
+            audit_tail++;
         }
-        if (sscanf(num_buffer, "%d", cost_per) != 1 || *cost_per < 0) 
+        if ((dropped = atomic_exchange_explicit(&audit_dropped, 0, memory_order_relaxed)) != 0)
         {
-            printf("\nERROR: Ivalid input. Input should have been a positive integer.\nERROR: Calculate Cost of Class function failed. Please try again.\n");
-            return;
-        } 
+            line = (size_t)snprintf(batch + len, AUDIT_LINE, "audit queue full: %u records dropped\n", dropped);
+            len += line < AUDIT_LINE ? line : AUDIT_LINE - 1;
+        }
 
-        // INT32-C: The cost per student and number of students is checked to ensure multiplying them together would not exceed the maximum
-        // integer value, which could cause issues in execution.
-        if (INT_MAX / *cost_per < *num)
+        if (len > 0)
         {
-            printf("\nERROR: Resulting calculation with given input would exceed maximum integer value, smaller values must be used.\n");
-            return;
+            uint64_t start = statsNow();
+            // The log is appended to in one write per batch; a failed write loses only that batch
+            for (size_t done = 0; done < len; )
+            {
+                ssize_t written = write(fd, batch + done, len - done);
+                if (written < 0 && errno != EINTR)
+                {
+                    break;
+                }
+                done += written > 0 ? (size_t)written : 0;
+            }
+            statsAdd(STAT_AUDIT_WRITE, statsNow() - start, len);
+            if ((size += (off_t)len) >= AUDIT_ROTATE)
+            {
+                if ((fd = rotateAudit(fd)) < 0)
+                {
+                    fprintf(stderr, "\nERROR: Could not open a new audit log '%s'. Retrying; actions are queued until it opens.\n", AUDIT_FILE);
+                }
+                size = 0;
+            }
         }
+        else if (atomic_load(&audit_stop))
+        {
+            break;
+        }
+        else
+        {
+            nanosleep(&idle, NULL);
+        }
+    }
+    free(batch);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Rotates the audit log: AUDIT_FILE becomes AUDIT_FILE.1, each older log moves up one and the oldest
+ *        is replaced
+ *
+ * @param fd The audit log's file descriptor, closed here
+ * @return int The descriptor of the new, empty audit log, or -1 if it cannot be opened
+ */
+int rotateAudit(int fd)
+{
+    char from[PATH_BUFFER];
+    char to[PATH_BUFFER];
 
-        // Print results
-        if (curr_type[0] == '1') {
-            printf("\n\tTotal Cost: $%d\n", CALCULATE_COST(*cost_per, *num));
-            printf("\tTotal Cost w/ %.1f%% Tax Rate: $",  student_tax);
-            CALCULATE_TAX(*cost_per, *num); // Make call to multi-statement macro to calculate taxes
-            printf("\n");
+    close(fd);
+    for (int i = AUDIT_KEEP - 1; i >= 0; i--)
+    {
+        if (i == 0)
+        {
+            snprintf(from, sizeof(from), "%s", AUDIT_FILE);
         }
-        else if (curr_type[0] == '2') {
-            printf("\n\tTotal Cost: ");
-            putwchar(euro); // STR38-C: wchar_t functions used to print character to stdout
-            printf("%d\n\tTotal Cost w/ %.1f%% Rate: ", CALCULATE_COST(*cost_per, *num), student_tax);
-            putwchar(euro); // STR38-C: wchar_t functions used to print character to stdout
-            CALCULATE_TAX(*cost_per, *num); // Make call to multi-statement macro to calculate taxes
-            printf("\n");
+        else
+        {
+            snprintf(from, sizeof(from), "%s.%d", AUDIT_FILE, i);
         }
-        // MEM34-C: The cost_per variable was dynamically allocated and thus can be freed
-        // MEM30-C: Since cost_per is being freed here, it will not be accessed anymore
-        free(cost_per);
+        snprintf(to, sizeof(to), "%s.%d", AUDIT_FILE, i + 1);
+        rename(from, to); // A log that does not exist yet is simply skipped
     }
-    prompt(1, num);
+    return open(AUDIT_FILE, O_WRONLY | O_APPEND | O_CREAT, 0600);
 }
 
-// MSC41-C: This code to log the last user is erased immediately after the file it is written to is closed, ensuring its security
-// (at least within the application).
+// MSC41-C: The input buffer holding the typed code is erased once the code has been copied to audit_user. That
+// copy is kept for the whole session and written on every audit log line, so the code is only as private as
+// the audit log, which is created readable by its owner alone.
 /**
- * @brief Logs the last user to access the class list to a separate file with a randomized value to ensure uniqueness
+ * @brief Asks who is using the system and gives them a randomized session number, under which the audit log
+ *        records everything they do
+ *
+ * Called before startAudit, so the audit writer only ever reads the user and session once they are set.
  */
 void logUser()
 {
@@ -553,37 +9591,42 @@ void logUser()
         randGen1 %= 100000;
     else
         randGen1 %= randGen2;
+    audit_session = randGen1;
 
-    printf("Enter a unique code that is 20 characters or less to log who last used the system (only admins will have access to that file): ");
+    printf("Enter a unique code that is 20 characters or less to log who uses the system (only admins will have access to that file): ");
     fgets(code, sizeof(code), stdin);
     if (feof(stdin) || (strlen(code) != 0 && code[strlen(code)-1] == '\n')){
         
     }else{
         printf("Please enter a valid input");
+        printf("\nWARNING: This session will be logged as anonymous (\"%s\") in the audit log.\n", audit_user);
+        erase(code, sizeof(code));
         return;
     }
-    
-    // FIO24-C: file opened only once and is private to admins
-    FILE *fp = fopen("user_log.txt", "w+");
 
-    if (fp)
+    // STR02-C: The code is copied up to its line ending, with anything that would split an audit log line replaced
+    size_t len = strcspn(code, "\r\n");
+    for (size_t i = 0; i < len && i < AUDIT_USER - 1; i++)
     {
-        putw(randGen1, fp);
-        fwrite(code, sizeof(code), 1, fp);
-        fclose(fp);
+        audit_user[i] = (unsigned char)code[i] > ' ' && code[i] != 0x7F ? code[i] : '_';
+    }
+    if (len > 0)
+    {
+        audit_user[len < AUDIT_USER - 1 ? len : AUDIT_USER - 1] = '\0';
     }
-    erase(code);
+    erase(code, sizeof(code));
 }
 
 /**
  * @brief Erases the content held within a pointer.
  *
  * @param pointer
+ * @param size The number of bytes to erase
  * @return void*
  */
-void *erase(void *pointer)
+void *erase(void *pointer, size_t size)
 {
-    int size_to_remove = sizeof(pointer);
+    size_t size_to_remove = size;
     volatile unsigned char *p = pointer;
 
     while (size_to_remove--)